@@ -0,0 +1,161 @@
+//
+//  longRangeBench.cpp
+//  example
+//
+
+#include "longRangeBench.h"
+#include "ofxLabFlexBarnesHut.h"
+
+// side of the square the particles are scattered over
+static const float WORLD_SIZE = 1000;
+
+
+//--------------------------------------------------------------
+// the exact pull on every particle, the same softened gravity as the tree
+static void directSum( const vector<ofxLabFlexParticle*>& particles,
+                       const ofxLabFlexBarnesHut& barnesHut,
+                       vector<ofVec2f>& forces )
+{
+    float soft2 = barnesHut.getSoftening() * barnesHut.getSoftening();
+
+    forces.assign( particles.size(), ofVec2f() );
+    for( unsigned int i=0; i<particles.size(); ++i ) {
+        const ofxLabFlexParticle* p = particles[i];
+        float ax = 0;
+        float ay = 0;
+
+        for( unsigned int j=0; j<particles.size(); ++j ) {
+            if( j == i ) {
+                continue;
+            }
+
+            float dx = particles[j]->x - p->x;
+            float dy = particles[j]->y - p->y;
+            float r2 = dx * dx + dy * dy + soft2;
+            if( r2 <= 0 ) {
+                continue;
+            }
+
+            float f = particles[j]->mass / (r2 * sqrtf( r2 ));
+            ax += dx * f;
+            ay += dy * f;
+        }
+
+        forces[i].set( ax * barnesHut.getStrength(), ay * barnesHut.getStrength() );
+    }
+}
+
+
+//--------------------------------------------------------------
+// the tree's pull on every particle
+static void treeSum( const vector<ofxLabFlexParticle*>& particles,
+                     ofxLabFlexBarnesHut& barnesHut,
+                     vector<ofVec2f>& forces )
+{
+    for( unsigned int i=0; i<particles.size(); ++i ) {
+        particles[i]->acceleration.set( 0, 0 );
+    }
+
+    barnesHut.apply( particles );
+
+    forces.resize( particles.size() );
+    for( unsigned int i=0; i<particles.size(); ++i ) {
+        forces[i] = particles[i]->acceleration;
+    }
+}
+
+
+//--------------------------------------------------------------
+// rms of the error over rms of the exact forces
+static float relativeError( const vector<ofVec2f>& forces,
+                            const vector<ofVec2f>& exact )
+{
+    double error = 0;
+    double total = 0;
+    for( unsigned int i=0; i<exact.size(); ++i ) {
+        error += (forces[i] - exact[i]).lengthSquared();
+        total += exact[i].lengthSquared();
+    }
+    return total > 0 ? sqrt( error / total ) : 0;
+}
+
+
+//--------------------------------------------------------------
+static void benchScatter( int count )
+{
+    vector<ofxLabFlexParticle> storage( count );
+    vector<ofxLabFlexParticle*> particles( count );
+    for( int i=0; i<count; ++i ) {
+        storage[i].set( ofRandom( WORLD_SIZE ), ofRandom( WORLD_SIZE ), 0 );
+        particles[i] = &storage[i];
+    }
+
+    ofxLabFlexBarnesHut barnesHut;
+    vector<ofVec2f> exact;
+    vector<ofVec2f> forces;
+
+    unsigned long long start = ofGetElapsedTimeMicros();
+    directSum( particles, barnesHut, exact );
+    float directMillis = (ofGetElapsedTimeMicros() - start) / 1000.0f;
+
+    ofLog( OF_LOG_NOTICE, ofToString( count ) + " particles, direct sum " + ofToString( directMillis ) + "ms" );
+
+    const float thetas[] = { 0.3f, 0.5f, 0.7f, 1.0f };
+    for( int t=0; t<4; ++t ) {
+        barnesHut.setTheta( thetas[t] );
+
+        start = ofGetElapsedTimeMicros();
+        treeSum( particles, barnesHut, forces );
+        float treeMillis = (ofGetElapsedTimeMicros() - start) / 1000.0f;
+
+        ofLog( OF_LOG_NOTICE, "    theta " + ofToString( thetas[t] ) +
+                              ": " + ofToString( treeMillis ) + "ms" +
+                              ", " + ofToString( directMillis / treeMillis ) + "x faster" +
+                              ", error " + ofToString( relativeError( forces, exact ) * 100 ) + "%" );
+    }
+}
+
+
+//--------------------------------------------------------------
+// most of the particles on one spot, which no amount of splitting separates
+static void benchStacked( int count )
+{
+    vector<ofxLabFlexParticle> storage( count );
+    vector<ofxLabFlexParticle*> particles( count );
+    for( int i=0; i<count; ++i ) {
+        if( i % 10 == 0 ) {
+            storage[i].set( ofRandom( WORLD_SIZE ), ofRandom( WORLD_SIZE ), 0 );
+        } else {
+            storage[i].set( WORLD_SIZE / 2, WORLD_SIZE / 2, 0 );
+        }
+        particles[i] = &storage[i];
+    }
+
+    ofxLabFlexBarnesHut barnesHut;
+    vector<ofVec2f> exact;
+    vector<ofVec2f> forces;
+
+    unsigned long long start = ofGetElapsedTimeMicros();
+    directSum( particles, barnesHut, exact );
+    float directMillis = (ofGetElapsedTimeMicros() - start) / 1000.0f;
+
+    start = ofGetElapsedTimeMicros();
+    treeSum( particles, barnesHut, forces );
+    float treeMillis = (ofGetElapsedTimeMicros() - start) / 1000.0f;
+
+    ofLog( OF_LOG_NOTICE, ofToString( count ) + " particles, 90% stacked, direct sum " + ofToString( directMillis ) + "ms" +
+                          ", tree " + ofToString( treeMillis ) + "ms" +
+                          ", error " + ofToString( relativeError( forces, exact ) * 100 ) + "%" );
+}
+
+
+//--------------------------------------------------------------
+void runLongRangeBench()
+{
+    ofSeedRandom( 0 );
+
+    benchScatter( 1000 );
+    benchScatter( 4000 );
+    benchScatter( 16000 );
+    benchStacked( 16000 );
+}
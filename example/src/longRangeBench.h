@@ -0,0 +1,14 @@
+//
+//  longRangeBench.h
+//  example
+//
+//  Times ofxLabFlexBarnesHut against summing every pair directly and
+//  measures how far off its forces are.  Press b in the example, the
+//  results go to the log.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+void runLongRangeBench();
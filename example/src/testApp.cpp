@@ -1,4 +1,5 @@
 #include "testApp.h"
+#include "longRangeBench.h"
 
 //--------------------------------------------------------------
 void testApp::setup(){
@@ -7,10 +8,7 @@ void testApp::setup(){
     ofSetVerticalSync(true);
     
     // just used to draw the wireframe
-    squareMesh.tl = ofVec2f(0, 0);
-    squareMesh.tr = ofVec2f(400, 0);
-    squareMesh.bl = ofVec2f(0, 400);
-    squareMesh.br = ofVec2f(400, 400);
+    squareMesh.setCorners( ofVec2f(0, 0), ofVec2f(400, 0), ofVec2f(0, 400), ofVec2f(400, 400) );
     
     ofVec2f squareBounds( 400, 400 );
     squareWorld.setupSquare( squareBounds );
@@ -92,7 +90,8 @@ void testApp::update(){
 //--------------------------------------------------------------
 void testApp::draw(){
     stringstream ss;
-    ss << "FPS: " << ofGetFrameRate();
+    ss << "FPS: " << ofGetFrameRate() << endl;
+    ss << "b: benchmark long range forces, results in the log";
     ofDrawBitmapString(ss.str(), ofPoint(50,50));
 
     ofRectangle stencil( 0, 0,
@@ -137,7 +136,11 @@ void testApp::wallCallbackQuad( ofxLabFlexParticle* p )
 
 //--------------------------------------------------------------
 void testApp::keyPressed(int key){
-
+    
+    // time the long range forces against summing every pair
+    if( key == 'b' ) {
+        runLongRangeBench();
+    }
 }
 
 //--------------------------------------------------------------
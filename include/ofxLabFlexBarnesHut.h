@@ -0,0 +1,208 @@
+//
+//  ofxLabFlexBarnesHut.h
+//  ofxLabFlexParticleSystem
+//
+//  Long range attraction (or repulsion) between all particles and any number
+//  of fixed attractors, for ofxLabFlexParticleSystem's LONG_RANGE_FORCES
+//  option.  Summing every pair is O(n^2); instead the particles and
+//  attractors are put in a quadtree, and a cell far enough away is treated as
+//  one body at its centre of mass.  A cell is far enough when its size over
+//  its distance is below the opening angle theta, so theta 0 opens every cell
+//  and gives the exact sum, and bigger values trade accuracy for speed.  A
+//  cell is always opened when the particle is inside the bounds of its
+//  bodies, whatever theta, so a particle never pulls on itself through a
+//  cell.  Bodies too close together to split apart, eg. particles stacked
+//  on one spot, pull as one body instead of pair by pair.
+//
+//  The tree is rebuilt every frame from the Z-order of the bodies: each cell
+//  is a contiguous run of sorted bodies, the top few levels are split on the
+//  calling thread and the subtrees below them are built in parallel.  The
+//  tree covers the bounding box of the bodies, so it works in any world
+//  type, but wrapped edges don't pull across the wrap.
+//
+
+#pragma once
+
+#include "ofxLabFlexParticle.h"
+#include "ofxLabFlexMortonSort.h"
+#include "ofxLabFlexThreadPool.h"
+
+struct ofxLabFlexAttractor {
+    float   x;
+    float   y;
+    float   mass;       // >= 0, use a negative strength to repel
+};
+
+class ofxLabFlexBarnesHut
+{
+public:
+
+    static const float DEFAULT_THETA;
+    static const float DEFAULT_SOFTENING;
+
+    /**
+     * ofxLabFlexBarnesHut constructor, particles attract each other with a
+     * strength of 1
+     */
+    ofxLabFlexBarnesHut();
+
+    /**
+     * @param theta     Opening angle, 0 is exact, around .5 is typical
+     */
+    void setTheta( float theta );
+
+    /**
+     * @return      The opening angle
+     */
+    float getTheta() const;
+
+    /**
+     * Keep close bodies from pulling infinitely hard, forces fall off as
+     * 1 / (distance^2 + softening^2)
+     *
+     * @param softening     Distance, in world units
+     */
+    void setSoftening( float softening );
+
+    /**
+     * @return      The softening distance
+     */
+    float getSoftening() const;
+
+    /**
+     * @param strength  Gravitational constant, negative repels
+     */
+    void setStrength( float strength );
+
+    /**
+     * @return      The gravitational constant
+     */
+    float getStrength() const;
+
+    /**
+     * @param attract   false if only the attractors pull on the particles
+     */
+    void setParticlesAttract( bool attract );
+
+    /**
+     * @return      false if only the attractors pull on the particles
+     */
+    bool getParticlesAttract() const;
+
+    /**
+     * Add a fixed body that pulls on the particles
+     *
+     * @param attractor     Position and mass
+     * @return              Index, for setAttractor()
+     */
+    int addAttractor( const ofxLabFlexAttractor& attractor );
+
+    /**
+     * Move or reweigh an attractor
+     *
+     * @param index         Index from addAttractor()
+     * @param attractor     Position and mass
+     */
+    void setAttractor( int index,
+                       const ofxLabFlexAttractor& attractor );
+
+    /**
+     * Remove all attractors
+     */
+    void clearAttractors();
+
+    /**
+     * @return      Number of attractors
+     */
+    int getNumAttractors() const;
+
+    /**
+     * @param index     Index from addAttractor()
+     * @return          The attractor
+     */
+    const ofxLabFlexAttractor& getAttractor( int index ) const;
+
+    /**
+     * Build the tree from the particles' positions and add the pull on every
+     * particle to its acceleration
+     *
+     * @param particles     The particles, in any order
+     * @param pool          Threads to use, NULL runs on the calling thread
+     */
+    void apply( const vector<ofxLabFlexParticle*>& particles,
+                ofxLabFlexThreadPool* pool = NULL );
+
+    /**
+     * @return      Cells in the tree of the last apply()
+     */
+    int getNumNodes() const;
+
+protected:
+
+    struct Node {
+        float   x;          // centre of mass
+        float   y;
+        float   mass;
+        float   minX;       // bounds of the bodies in the cell
+        float   minY;
+        float   maxX;
+        float   maxY;
+        float   size;       // side of the cell
+        int     begin;      // bodies, in sorted order
+        int     end;
+        int     child[4];   // -1 for none, a leaf has none
+        bool    leaf;
+    };
+
+    // a cell below the top levels whose subtree is built in parallel
+    struct Subtree {
+        int     node;       // top level node it replaces
+        int     begin;
+        int     end;
+        int     level;
+    };
+
+    // build the cell of bodies [begin, end), returns its index in nodes.
+    // With top set, cells at the split level are left for buildSubtrees()
+    int buildNode( vector<Node>& nodes,
+                   int begin,
+                   int end,
+                   int level,
+                   bool top );
+
+    // centre of mass and bounds of a cell from its children or bodies
+    void sumNode( const vector<Node>& nodes,
+                  Node& node ) const;
+
+    void buildSubtrees( int begin,
+                        int end );
+
+    void evaluateRange( int begin,
+                        int end,
+                        const vector<ofxLabFlexParticle*>* particles );
+
+    float                   _theta;
+    float                   _softening;
+    float                   _strength;
+    bool                    _bParticlesAttract;
+
+    vector<ofxLabFlexAttractor> _attractors;
+
+    // bodies, gathered and then in Z-order
+    ofxLabFlexMortonSort    _mortonSort;
+    vector<float>           _sourceX;
+    vector<float>           _sourceY;
+    vector<float>           _sourceMass;
+    vector<int>             _order;
+    vector<float>           _bodyX;
+    vector<float>           _bodyY;
+    vector<float>           _bodyMass;
+    vector<int>             _bodySource;    // particle index, -1 for attractors
+    vector<int>             _particleBody;  // and back, -1 if particles don't attract
+    float                   _rootSize;
+
+    vector<Node>            _nodes;
+    vector<Subtree>         _pending;
+    vector< vector<Node> >  _subtrees;
+
+};
@@ -0,0 +1,109 @@
+//
+//  ofxLabFlexBroadphase.h
+//  ofxLabFlexParticleSystem
+//
+//  Finds the pairs of particles that are close to each other without testing
+//  every pair.  Points are counting sorted into a hashed uniform grid (so it
+//  works in OPEN worlds with no bounds), then each point only looks at the
+//  3x3 cells around it.  The cell size has to be at least the largest
+//  distance a pair can be apart.
+//
+
+#pragma once
+
+#include "ofxLabFlexThreadPool.h"
+
+/**
+ * Two particles close to each other, as indices into the arrays given to
+ * ofxLabFlexBroadphase
+ */
+struct ofxLabFlexNeighbourPair {
+    int     a;
+    int     b;
+};
+
+
+class ofxLabFlexBroadphase
+{
+public:
+
+    /**
+     * ofxLabFlexBroadphase constructor, empty until build()
+     */
+    ofxLabFlexBroadphase();
+
+    /**
+     * Sort points into the grid.  The arrays must stay valid until the last
+     * findPairs() call.
+     *
+     * @param x         x coordinates
+     * @param y         y coordinates
+     * @param count     Number of points
+     * @param cellSize  Size of a grid cell
+     */
+    void build( const float* x,
+                const float* y,
+                int count,
+                float cellSize );
+
+    /**
+     * Find every pair a < b closer than cutoff, or closer than
+     * radius[a] + radius[b] + cutoff when radii are given.  Pairs come out in
+     * the same order whatever the number of threads.
+     *
+     * @param radius    Optional radii, may be NULL
+     * @param cutoff    Distance, or margin added to the radii
+     * @param pairs     Receives the pairs, replacing its contents
+     * @param pool      Threads to use, NULL runs on the calling thread
+     */
+    void findPairs( const float* radius,
+                    float cutoff,
+                    vector<ofxLabFlexNeighbourPair>& pairs,
+                    ofxLabFlexThreadPool* pool = NULL );
+
+    /**
+     * @return      Number of points in the last build()
+     */
+    int getCount() const;
+
+    /**
+     * @return      Point indices sorted by grid cell, nearby points are close
+     *              together in this list
+     */
+    const vector<int>& getSorted() const;
+
+protected:
+
+    // hashed bucket of a cell
+    int getBucket( int cellX,
+                   int cellY ) const;
+
+    // findPairs() over a range of _sorted, one grain at a time into
+    // _rangePairs[begin / grain]
+    void findPairsRange( int begin,
+                         int end,
+                         const float* radius,
+                         float cutoff,
+                         int grain );
+    void findPairsChunk( int begin,
+                         int end,
+                         const float* radius,
+                         float cutoff,
+                         vector<ofxLabFlexNeighbourPair>& out ) const;
+
+    const float*            _x;
+    const float*            _y;
+    int                     _count;
+    float                   _cellSize;
+    float                   _invCellSize;
+
+    // points of bucket i are _sorted[_bucketStart[i].._bucketStart[i+1])
+    int                     _bucketMask;
+    vector<int>             _bucketStart;
+    vector<int>             _sorted;
+    vector<int>             _pointBucket;
+
+    // per range output of findPairs(), joined in order at the end
+    vector< vector<ofxLabFlexNeighbourPair> >   _rangePairs;
+
+};
@@ -0,0 +1,119 @@
+//
+//  ofxLabFlexCollisionSolver.h
+//  ofxLabFlexParticleSystem
+//
+//  Position based overlap solver for ofxLabFlexParticleSystem's
+//  SOLVE_COLLISIONS option.  Overlapping particles are found among candidate
+//  pairs (see ofxLabFlexNeighbourList) and pushed apart directly (weighted by inverse mass) instead of
+//  accelerated, over a few Jacobi iterations: every particle gathers the
+//  corrections of all its contacts from the same positions, so particles can
+//  be processed in parallel without locks and the result doesn't depend on
+//  the number of threads.
+//
+//  How far each pair was pushed apart is cached by uniqueID and used to
+//  warm start the pair on the next frame, so resting crowds settle in fewer
+//  iterations instead of jittering.
+//
+
+#pragma once
+
+#include "ofxLabFlexParticle.h"
+#include "ofxLabFlexNeighbourList.h"
+
+class ofxLabFlexCollisionSolver
+{
+public:
+
+    struct CachedContact {
+        unsigned long   idA;
+        unsigned long   idB;
+        float           lambda;
+
+        bool operator<( const CachedContact& other ) const {
+            return idA < other.idA || (idA == other.idA && idB < other.idB);
+        }
+    };
+
+    /**
+     * ofxLabFlexCollisionSolver constructor
+     */
+    ofxLabFlexCollisionSolver();
+
+    /**
+     * Separate overlapping particles.  Positions are corrected, and the
+     * correction is added to the velocity so the pair doesn't keep pushing
+     * into each other.
+     *
+     * @param particles     The particles, in any order
+     * @param candidates    Pairs of indices into particles that may touch,
+     *                      at least every pair closer than their two radii
+     * @param iterations    Jacobi iterations, more is stiffer
+     * @param minMass       Masses are clamped to at least this
+     * @param pool          Threads to use, NULL runs on the calling thread
+     */
+    void solve( const vector<ofxLabFlexParticle*>& particles,
+                const vector<ofxLabFlexNeighbourPair>& candidates,
+                int iterations,
+                float minMass,
+                ofxLabFlexThreadPool* pool = NULL );
+
+    /**
+     * Forget the cached contacts
+     */
+    void clear();
+
+    /**
+     * @return      Overlapping pairs found in the last solve()
+     */
+    int getNumContacts() const;
+
+    /**
+     * @return      The contacts that warm start the next solve(), sorted
+     */
+    const vector<CachedContact>& getCachedContacts() const;
+
+    /**
+     * Replace the contacts that warm start the next solve(), eg. from a
+     * checkpoint
+     *
+     * @param contacts  Contacts with idA < idB, in any order
+     */
+    void setCachedContacts( const vector<CachedContact>& contacts );
+
+protected:
+
+    struct Contact {
+        int     a;
+        int     b;
+        float   lambda;     // total separation applied to this pair
+        float   nx;         // from b to a
+        float   ny;
+        float   error;      // overlap still to resolve this iteration
+    };
+
+    // solver passes, over a range of contacts or particles
+    void measureContacts( int begin,
+                          int end );
+    void gatherCorrections( int begin,
+                            int end );
+
+    // particle data, gathered contiguous for the solve
+    vector<float>           _x;
+    vector<float>           _y;
+    vector<float>           _nextX;
+    vector<float>           _nextY;
+    vector<float>           _radius;
+    vector<float>           _invMass;
+    vector<unsigned long>   _ids;
+
+    vector<Contact>         _contacts;
+    int                     _numTouching;
+
+    // contacts of particle i are _particleContacts[_contactStart[i].._contactStart[i+1])
+    vector<int>             _contactStart;
+    vector<int>             _particleContacts;
+
+    // contacts of the last frame, sorted
+    vector<CachedContact>   _cache;
+
+};
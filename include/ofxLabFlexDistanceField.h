@@ -0,0 +1,183 @@
+//
+//  ofxLabFlexDistanceField.h
+//  ofxLabFlexParticleSystem
+//
+//  Boundary of a DISTANCE_FIELD world.  The free area is painted from
+//  polygons and image masks, then baked into a grid of signed distances to
+//  the boundary (positive inside, negative outside) with the gradient.  After
+//  that containment, penetration depth and the bounce normal are one bilinear
+//  lookup, whatever shape the boundary is.
+//
+//  File layout of save()/load():
+//      header      ofxLabFlexDistanceFieldHeader
+//      samples     cols * rows ofxLabFlexDistanceSample, row by row
+//
+
+#pragma once
+
+#include "ofxLabFlexPolygon.h"
+#include "ofxLabFlexThreadPool.h"
+
+/**
+ * One baked grid point
+ */
+struct ofxLabFlexDistanceSample {
+    float   distance;       // world units, positive inside
+    float   gradientX;      // unit vector pointing further inside
+    float   gradientY;
+};
+
+/**
+ * On disk header of a baked field
+ */
+struct ofxLabFlexDistanceFieldHeader {
+    char                magic[4];       // "LFSD"
+    unsigned int        version;
+    unsigned int        cols;
+    unsigned int        rows;
+    float               bounds[4];      // x, y, width, height
+    float               cellSize;
+    unsigned int        reserved;
+    unsigned long long  sourceHash;     // hash of the painted mask, see loadOrBake()
+};
+
+
+class ofxLabFlexDistanceField
+{
+public:
+
+    // file format version, newer files are refused
+    static const unsigned int FILE_VERSION;
+
+    /**
+     * ofxLabFlexDistanceField constructor, call setup() before painting
+     */
+    ofxLabFlexDistanceField();
+
+    /**
+     * Size the grid.  Everything starts outside.
+     *
+     * @param bounds        World area covered by the field
+     * @param cellSize      Distance between grid points in world units
+     */
+    void setup( const ofRectangle& bounds,
+                float cellSize );
+
+    /**
+     * Mark the inside of a polygon as free (or blocked with subtract)
+     *
+     * @param polygon       Built polygon
+     * @param subtract      Cut the polygon out of the free area instead
+     */
+    void addPolygon( const ofxLabFlexPolygon& polygon,
+                     bool subtract = false );
+
+    /**
+     * Mark the pixels of a mask over threshold as free (or blocked with
+     * subtract).  The first channel is used.
+     *
+     * @param mask          The image
+     * @param area          Where the image sits in the world
+     * @param threshold     Pixel values above this count
+     * @param subtract      Cut the mask out of the free area instead
+     */
+    void addMask( const ofPixels& mask,
+                  const ofRectangle& area,
+                  unsigned char threshold = 127,
+                  bool subtract = false );
+
+    /**
+     * Compute distances and gradients from what has been painted.  Exact
+     * euclidean distance transform, rows then columns, each split across the
+     * pool's threads.
+     *
+     * @param pool      Threads to use, NULL runs on the calling thread
+     */
+    void bake( ofxLabFlexThreadPool* pool = NULL );
+
+    /**
+     * Load the field from path if it was baked from the same painted mask,
+     * otherwise bake it and write it there for next time.
+     *
+     * @param path      Cache file, passed through ofToDataPath()
+     * @param pool      Threads to use if it has to bake
+     *
+     * @return          true if the field is ready
+     */
+    bool loadOrBake( const string& path,
+                     ofxLabFlexThreadPool* pool = NULL );
+
+    /**
+     * Write the baked field to disk
+     *
+     * @param path      File to write, passed through ofToDataPath()
+     * @return          true if the file was written
+     */
+    bool save( const string& path ) const;
+
+    /**
+     * Read a field written by save().  The painted mask isn't stored, so
+     * nothing can be added to a loaded field.
+     *
+     * @param path      File to read, passed through ofToDataPath()
+     * @return          true if the field was loaded
+     */
+    bool load( const string& path );
+
+    /**
+     * @return      true once the field is baked or loaded
+     */
+    bool isBaked() const;
+
+    /**
+     * Bilinear lookup.  Points outside the bounds use the nearest edge of the
+     * grid.
+     *
+     * @param x         The x coordinate (world)
+     * @param y         The y coordinate (world)
+     * @param normal    Receives the direction further inside, not normalized
+     *
+     * @return          Signed distance to the boundary, positive inside
+     */
+    float sample( float x,
+                  float y,
+                  ofVec2f& normal ) const;
+
+    /**
+     * @return      World area covered by the field
+     */
+    const ofRectangle& getBounds() const;
+
+protected:
+
+    // world position of a grid point
+    float getX( int col ) const;
+    float getY( int row ) const;
+
+    // bake passes, one range of rows or columns
+    void transformRows( int begin,
+                        int end );
+    void transformCols( int begin,
+                        int end );
+    void gradientRows( int begin,
+                       int end );
+
+    // hash of the painted mask and the grid
+    unsigned long long getSourceHash() const;
+
+    ofRectangle                         _bounds;
+    float                               _cellSize;
+    int                                 _cols;
+    int                                 _rows;
+
+    vector<unsigned char>               _inside;
+
+    // squared cell distances to the nearest outside / inside cell while baking
+    vector<float>                       _toOutside;
+    vector<float>                       _toInside;
+
+    vector<ofxLabFlexDistanceSample>    _samples;
+    unsigned long long                  _sourceHash;
+    bool                                _bBaked;
+
+};
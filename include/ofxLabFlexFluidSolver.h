@@ -0,0 +1,146 @@
+//
+//  ofxLabFlexFluidSolver.h
+//  ofxLabFlexParticleSystem
+//
+//  Stable fluids on the grid of an ofxLabFlexVectorField.  The field's cells
+//  are the fluid's velocity: every update() moves them along themselves
+//  (semi-Lagrangian advection), spreads them out (diffusion, with a
+//  viscosity) and removes their divergence (pressure projection), so the
+//  field swirls and carries on moving instead of staying where it was
+//  stamped.  Brushes like addClockwiseCircle() and fadeField() work as
+//  before and inject into the fluid between updates.
+//
+//  The velocity is kept as separate x and y float arrays while solving.
+//  Diffusion and pressure use Jacobi iterations, so every cell of a pass
+//  only reads the previous iteration and the inner loops have no branches;
+//  each pass is split into strips of rows across the thread pool.  The
+//  edges of the field are walls.
+//
+//  FLOAT_32 fields are read and written directly, the compact storage types
+//  go through getCell() / setCell() and lose precision every update.
+//
+
+#pragma once
+
+#include "ofxLabFlexVectorField.h"
+#include "ofxLabFlexThreadPool.h"
+
+class ofxLabFlexFluidSolver
+{
+public:
+
+    static const int DEFAULT_DIFFUSION_ITERATIONS = 10;
+    static const int DEFAULT_PRESSURE_ITERATIONS = 20;
+
+    /**
+     * ofxLabFlexFluidSolver constructor, does nothing until setup()
+     */
+    ofxLabFlexFluidSolver();
+
+    /**
+     * Pick the field to drive.  Call again if the field is set up with a
+     * different size.
+     * NOTE: no memory management is done by the solver
+     *
+     * @param field     The field, at least 2x2 cells
+     * @param pool      Threads to use, NULL runs on the calling thread
+     */
+    void setup( ofxLabFlexVectorField* field,
+                ofxLabFlexThreadPool* pool = NULL );
+
+    /**
+     * NOTE: no memory management is done by the solver
+     *
+     * @param pool      Threads to use, NULL runs on the calling thread
+     */
+    void setThreadPool( ofxLabFlexThreadPool* pool );
+
+    /**
+     * How fast the field carries itself along
+     *
+     * @param speed     Cells per second moved by a cell value of 1
+     */
+    void setSpeed( float speed );
+
+    /**
+     * @param viscosity     Cells^2 per second, 0 skips diffusion
+     */
+    void setViscosity( float viscosity );
+
+    /**
+     * @param iterations    Jacobi iterations for diffusion, more is smoother
+     */
+    void setDiffusionIterations( int iterations );
+
+    /**
+     * @param iterations    Jacobi iterations for the pressure, more leaves
+     *                      less divergence
+     */
+    void setPressureIterations( int iterations );
+
+    /**
+     * Forget the pressure carried over from the last update()
+     */
+    void reset();
+
+    /**
+     * Advance the fluid and write it back to the field
+     *
+     * @param dt        Seconds since the last update()
+     */
+    void update( float dt );
+
+protected:
+
+    typedef void (ofxLabFlexFluidSolver::*RowPass)( int, int );
+
+    // run a pass over every row, split across the pool
+    void runRows( RowPass pass );
+
+    // each pass works on rows [begin, end)
+    void loadRows( int begin,
+                   int end );
+    void storeRows( int begin,
+                    int end );
+    void advectRows( int begin,
+                     int end );
+    void diffuseRows( int begin,
+                      int end );
+    void divergenceRows( int begin,
+                         int end );
+    void pressureRows( int begin,
+                       int end );
+    void gradientRows( int begin,
+                       int end );
+
+    ofxLabFlexVectorField*  _field;
+    ofxLabFlexThreadPool*   _pool;
+
+    int                     _width;
+    int                     _height;
+
+    float                   _speed;
+    float                   _viscosity;
+    int                     _diffusionIterations;
+    int                     _pressureIterations;
+
+    // this update()'s settings, for the passes
+    float                   _dt;
+    float                   _diffusion;     // dt * viscosity
+
+    ofVec2f*                _cells;         // FLOAT_32 field cells, or NULL
+
+    // velocity, the previous iteration or source of a pass, and its result
+    vector<float>           _u;
+    vector<float>           _v;
+    vector<float>           _uSource;
+    vector<float>           _vSource;
+    vector<float>           _uNext;
+    vector<float>           _vNext;
+
+    // pressure is kept between updates as the first guess of the next
+    vector<float>           _pressure;
+    vector<float>           _pressureNext;
+    vector<float>           _divergence;
+
+};
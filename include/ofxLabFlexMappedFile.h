@@ -0,0 +1,84 @@
+//
+//  ofxLabFlexMappedFile.h
+//  ofxLabFlexParticleSystem
+//
+//  Thin cross platform wrapper around a memory mapped file.  Used by the
+//  binary formats in this addon so large files can be used in place, with the
+//  OS paging them in on demand instead of reading them up front.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+class ofxLabFlexMappedFile
+{
+public:
+
+    /**
+     * ofxLabFlexMappedFile constructor, nothing is mapped until open()
+     */
+    ofxLabFlexMappedFile();
+
+    /**
+     * Unmaps the file if it is still open
+     */
+    virtual ~ofxLabFlexMappedFile();
+
+    /**
+     * Map an entire file into memory.  The mapping is copy on write, so the
+     * pages can be modified in memory but the file on disk is never changed.
+     *
+     * @param path      Path to the file, passed through ofToDataPath()
+     *
+     * @return          true if the file was mapped, false otherwise
+     */
+    bool open( const string& path );
+
+    /**
+     * Unmap the file.  Any pointer returned by getData() is invalid afterwards
+     */
+    void close();
+
+    /**
+     * @return          true if a file is currently mapped
+     */
+    bool isOpen() const;
+
+    /**
+     * @return          Start of the mapped file, NULL if nothing is mapped
+     */
+    unsigned char * getData() const;
+
+    /**
+     * @return          Size of the mapped file in bytes
+     */
+    size_t getSize() const;
+
+    /**
+     * Hint to the OS that a range of the file will be needed soon so it can
+     * start paging it in.  This never blocks and is a no-op where unsupported.
+     *
+     * @param offset    Byte offset into the file
+     * @param length    Number of bytes
+     */
+    void willNeed( size_t offset,
+                   size_t length ) const;
+
+private:
+
+    // a mapping can't be shared between two owners, share the owner instead
+    ofxLabFlexMappedFile( const ofxLabFlexMappedFile& );
+    ofxLabFlexMappedFile& operator=( const ofxLabFlexMappedFile& );
+
+    unsigned char *     _data;
+    size_t              _size;
+
+#if defined _WIN64 || defined _WIN32
+    void *              _file;
+    void *              _mapping;
+#else
+    int                 _file;
+#endif
+
+};
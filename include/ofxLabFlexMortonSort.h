@@ -0,0 +1,62 @@
+//
+//  ofxLabFlexMortonSort.h
+//  ofxLabFlexParticleSystem
+//
+//  Sorts points along a Z-order (Morton) curve.  Positions are quantized to
+//  16 bits per axis over their bounding box, the bits of x and y are
+//  interleaved into one 32 bit code, and the codes are LSD radix sorted a
+//  byte at a time.  Points close in space end up close in the sorted order,
+//  so walking them in that order touches memory nearly sequentially.  Points
+//  that are still in order from the last sort only cost the key pass.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+class ofxLabFlexMortonSort
+{
+public:
+
+    /**
+     * ofxLabFlexMortonSort constructor
+     */
+    ofxLabFlexMortonSort();
+
+    /**
+     * Find the Z-order of a set of points.  The sort is stable, points with
+     * the same code keep their order.
+     *
+     * @param x         x coordinates
+     * @param y         y coordinates
+     * @param count     Number of points
+     * @param order     Receives the point indices in Z-order
+     */
+    void sort( const float* x,
+               const float* y,
+               int count,
+               vector<int>& order );
+
+    /**
+     * Interleave the bits of two 16 bit coordinates, x in the even bits
+     *
+     * @param x         Quantized x
+     * @param y         Quantized y
+     * @return          The Morton code
+     */
+    static unsigned int encode( unsigned int x,
+                                unsigned int y );
+
+    /**
+     * @return      Codes of the points of the last sort(), in sorted order
+     */
+    const vector<unsigned int>& getKeys() const;
+
+protected:
+
+    // codes of the points and their radix sort scratch space
+    vector<unsigned int>    _keys;
+    vector<unsigned int>    _tempKeys;
+    vector<int>             _temp;
+
+};
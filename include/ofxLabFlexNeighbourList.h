@@ -0,0 +1,102 @@
+//
+//  ofxLabFlexNeighbourList.h
+//  ofxLabFlexParticleSystem
+//
+//  Verlet neighbour list: the pairs found by the broadphase are kept from
+//  frame to frame.  They are found with an extra skin margin, so as long as
+//  no particle has moved (or grown) by more than half the skin since the
+//  build, every pair that can be within range now is still in the list and
+//  the grid doesn't need to be rebuilt.  Slow scenes rebuild every few
+//  frames instead of every frame.
+//
+
+#pragma once
+
+#include "ofxLabFlexBroadphase.h"
+
+class ofxLabFlexNeighbourList
+{
+public:
+
+    /**
+     * ofxLabFlexNeighbourList constructor, empty until update()
+     */
+    ofxLabFlexNeighbourList();
+
+    /**
+     * Set the margin pairs are found with.  Bigger skins rebuild less often
+     * but hold more pairs.  0 rebuilds on every update().  Takes effect on
+     * the next rebuild.
+     *
+     * @param skin      Extra distance, in world units
+     */
+    void setSkin( float skin );
+
+    /**
+     * @return      The skin margin
+     */
+    float getSkin() const;
+
+    /**
+     * Make sure the list holds every pair closer than cutoff, or closer than
+     * radius[a] + radius[b] + cutoff when radii are given.  Rebuilds when
+     * the points have moved too far, or when count, cutoff or version
+     * changed.  Pairs may be further apart than that, callers still have to
+     * check the distance.
+     *
+     * @param x         x coordinates
+     * @param y         y coordinates
+     * @param radius    Optional radii, may be NULL
+     * @param count     Number of points
+     * @param cutoff    Distance, or margin added to the radii
+     * @param version   Changes whenever index i stops being the same point
+     * @param pool      Threads to use, NULL runs on the calling thread
+     * @return          true if the list was rebuilt
+     */
+    bool update( const float* x,
+                 const float* y,
+                 const float* radius,
+                 int count,
+                 float cutoff,
+                 unsigned int version,
+                 ofxLabFlexThreadPool* pool = NULL );
+
+    /**
+     * Force a rebuild on the next update()
+     */
+    void invalidate();
+
+    /**
+     * @return      Pairs a < b from the last update()
+     */
+    const vector<ofxLabFlexNeighbourPair>& getPairs() const;
+
+    /**
+     * @return      Number of times the list was rebuilt
+     */
+    int getNumBuilds() const;
+
+protected:
+
+    // true if some point moved or grew by more than half the skin
+    bool hasMoved( const float* x,
+                   const float* y,
+                   const float* radius ) const;
+
+    float                   _skin;
+
+    // what the list was built from
+    bool                    _bValid;
+    unsigned int            _version;
+    int                     _count;
+    float                   _cutoff;
+    bool                    _bRadius;
+    vector<float>           _refX;
+    vector<float>           _refY;
+    vector<float>           _refRadius;
+
+    ofxLabFlexBroadphase                _broadphase;
+    vector<ofxLabFlexNeighbourPair>     _pairs;
+    int                     _numBuilds;
+
+};
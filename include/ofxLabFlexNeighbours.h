@@ -0,0 +1,160 @@
+//
+//  ofxLabFlexNeighbours.h
+//  ofxLabFlexParticleSystem
+//
+//  Runs user pair functions (flocking, SPH style pressure, ...) over every
+//  pair of particles closer than a cutoff.  Pairs come from a Verlet list
+//  over positions gathered into contiguous arrays, and are split across the
+//  thread pool.  Each thread adds its results into its own buffers, which
+//  are summed per particle once the kernel is done, so neither the kernel
+//  nor the threads ever need a lock.
+//
+
+#pragma once
+
+#include "ofxLabFlexParticle.h"
+#include "ofxLabFlexNeighbourList.h"
+
+#if defined _WIN64 || defined _WIN32
+#include <functional>
+#else
+#include <tr1/functional>
+#endif
+
+/**
+ * One side of a pair, as seen by a neighbour kernel
+ */
+struct ofxLabFlexNeighbour {
+    const ofxLabFlexParticle*   self;
+    const ofxLabFlexParticle*   other;
+    int                         selfIndex;      // for ofxLabFlexNeighbours::getValue()
+    int                         otherIndex;
+    ofVec2f                     delta;          // other - self
+    float                       distance;
+};
+
+/**
+ * What a neighbour kernel adds to the self particle of a pair
+ */
+struct ofxLabFlexNeighbourContribution {
+    ofVec2f     acceleration;   // summed into the particle's acceleration
+    float       value;          // summed into the kernel's per particle value
+};
+
+
+class ofxLabFlexNeighbours
+{
+public:
+
+    // called twice for every pair closer than the kernel's cutoff, once from
+    // each side.  Called from any thread, so it must only read the particles.
+    // The contribution starts zeroed.
+    typedef std::tr1::function<void ( const ofxLabFlexNeighbour&, ofxLabFlexNeighbourContribution& )> Kernel;
+
+    /**
+     * ofxLabFlexNeighbours constructor, no kernels
+     */
+    ofxLabFlexNeighbours();
+
+    /**
+     * Add a kernel.  Kernels run in the order they were added, and each one
+     * only starts once the previous kernel's values are complete, so a
+     * pressure kernel can read the densities summed by the kernel before it.
+     *
+     * @param kernel    Pair function
+     * @param cutoff    Pairs further apart than this are skipped
+     * @return          Kernel index, for getValue() and removeKernel()
+     */
+    int addKernel( const Kernel& kernel,
+                   float cutoff );
+
+    /**
+     * Stop running a kernel.  Other kernel indices stay the same.
+     *
+     * @param kernel    Index from addKernel()
+     */
+    void removeKernel( int kernel );
+
+    /**
+     * @return      true if there is any kernel to run
+     */
+    bool hasKernels() const;
+
+    /**
+     * Set the skin of the pair list, see ofxLabFlexNeighbourList::setSkin()
+     *
+     * @param skin      Extra distance, in world units
+     */
+    void setSkin( float skin );
+
+    /**
+     * Rebuild the pair list on the next run(), for when particles were
+     * moved behind its back
+     */
+    void invalidate();
+
+    /**
+     * Run every kernel over the particles and add the accelerations to them
+     *
+     * @param particles     The particles, their index here is the one the
+     *                      kernels see
+     * @param version       Changes whenever the particles list changes
+     * @param pool          Threads to use, NULL runs on the calling thread
+     */
+    void run( const vector<ofxLabFlexParticle*>& particles,
+              unsigned int version,
+              ofxLabFlexThreadPool* pool = NULL );
+
+    /**
+     * Value summed for a particle by a kernel in the last run().  Safe to
+     * call from a later kernel.
+     *
+     * @param kernel    Index from addKernel()
+     * @param index     ofxLabFlexNeighbour::selfIndex or otherIndex
+     * @return          The sum, 0 if the kernel didn't run
+     */
+    float getValue( int kernel,
+                    int index ) const;
+
+    /**
+     * @return      Pairs in the list used by the last run(), within the
+     *              largest cutoff plus the skin
+     */
+    int getNumPairs() const;
+
+protected:
+
+    struct KernelInfo {
+        Kernel          func;
+        float           cutoff;
+        vector<float>   values;
+    };
+
+    // run _kernels[_current] over a range of _pairs into thread's buffers
+    void runPairs( int begin,
+                   int end,
+                   int thread );
+
+    // sum the thread buffers of a range of particles
+    void reduce( int begin,
+                 int end );
+
+    vector<KernelInfo>      _kernels;
+
+    // particle data, gathered contiguous for the run
+    const vector<ofxLabFlexParticle*>*  _particles;
+    vector<float>           _x;
+    vector<float>           _y;
+
+    ofxLabFlexNeighbourList _list;
+    const vector<ofxLabFlexNeighbourPair>*  _pairs;
+
+    // kernel being run and the per thread accumulation buffers,
+    // thread t's entry for particle i is at t * count + i
+    int                     _current;
+    int                     _threads;
+    vector<float>           _accelX;
+    vector<float>           _accelY;
+    vector<float>           _value;
+
+};
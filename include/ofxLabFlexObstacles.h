@@ -0,0 +1,142 @@
+//
+//  ofxLabFlexObstacles.h
+//  ofxLabFlexParticleSystem
+//
+//  Static obstacles that block particles: circles, capsules (a segment with a
+//  radius) and closed polygons.  Obstacles are binned into a uniform grid by
+//  their bounding boxes, so a particle is only tested against the obstacles in
+//  the cells it overlaps and the cost doesn't grow with the obstacle count.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+class ofxLabFlexObstacles
+{
+public:
+
+    enum Type {
+        CIRCLE = 0,
+        CAPSULE,
+        POLYGON
+    };
+
+    /**
+     * ofxLabFlexObstacles constructor, starts empty
+     */
+    ofxLabFlexObstacles();
+
+    /**
+     * Add a circle
+     *
+     * @param center    Center of the circle
+     * @param radius    Radius of the circle
+     * @return          Index of the obstacle, passed to the obstacle callback
+     */
+    int addCircle( const ofVec2f& center,
+                   float radius );
+
+    /**
+     * Add a capsule, every point within radius of the segment a-b
+     *
+     * @param a         One end of the segment
+     * @param b         The other end
+     * @param radius    Half the capsule's thickness
+     * @return          Index of the obstacle
+     */
+    int addCapsule( const ofVec2f& a,
+                    const ofVec2f& b,
+                    float radius );
+
+    /**
+     * Add a closed polygon, the last point connects back to the first.
+     * Concave is fine.
+     *
+     * @param points    At least 3 points
+     * @return          Index of the obstacle, -1 if there were too few points
+     */
+    int addPolygon( const vector<ofVec2f>& points );
+
+    /**
+     * Remove every obstacle
+     */
+    void clear();
+
+    /**
+     * Bin the obstacles into the grid.  Adding an obstacle undoes this,
+     * ofxLabFlexParticleSystem::update() builds with the default cell size
+     * if needed.
+     *
+     * @param cellSize      Size of a grid cell in world units, 0 uses the
+     *                      average obstacle size
+     */
+    void build( float cellSize = 0 );
+
+    /**
+     * @return      true if the grid matches the current obstacles
+     */
+    bool isBuilt() const;
+
+    /**
+     * @return      Number of obstacles
+     */
+    int getNumObstacles() const;
+
+    /**
+     * Test a circle (a particle) against the obstacles near it.
+     *
+     * @param x         Center x
+     * @param y         Center y
+     * @param radius    Radius of the circle
+     * @param normal    Receives the unit direction out of the deepest obstacle
+     * @param depth     Receives how far the circle overlaps it
+     *
+     * @return          Index of the obstacle overlapped the most, -1 if none
+     */
+    int collide( float x,
+                 float y,
+                 float radius,
+                 ofVec2f& normal,
+                 float& depth ) const;
+
+    /**
+     * Draw the obstacle outlines
+     */
+    void draw();
+
+protected:
+
+    struct Obstacle {
+        Type        type;
+        ofVec2f     a;              // circle center, capsule start
+        ofVec2f     b;              // capsule end
+        float       radius;         // circle and capsule
+        int         firstPoint;     // polygon points in _points
+        int         numPoints;
+        ofRectangle bounds;
+    };
+
+    int addObstacle( const Obstacle& obstacle );
+
+    // distance from a point to the obstacle's surface, negative inside.
+    // normal points out of the obstacle
+    float signedDistance( const Obstacle& obstacle,
+                          float x,
+                          float y,
+                          ofVec2f& normal ) const;
+
+    vector<Obstacle>        _obstacles;
+    vector<ofVec2f>         _points;
+
+    // uniform grid, obstacles of cell i are _cellObstacles[_cellStart[i].._cellStart[i+1])
+    ofRectangle             _bounds;
+    float                   _cellSize;
+    float                   _invCellSize;
+    int                     _cols;
+    int                     _rows;
+    vector<int>             _cellStart;
+    vector<int>             _cellObstacles;
+    bool                    _bBuilt;
+
+};
@@ -56,6 +56,48 @@ public:
 
 
 
+/**
+ * Plain copy of everything that defines a particle's simulation state.  This
+ * is what checkpoints store, so it has a fixed layout that can be copied in
+ * bulk.  The user data pointer is not part of it.
+ *
+ */
+struct ofxLabFlexParticleState {
+    unsigned long long  uniqueID;
+    float               position[3];
+    float               velocity[2];
+    float               acceleration[2];
+    float               rotation[3];
+    float               rotateVelocity[3];
+    float               radius;
+    float               damping;
+    float               mass;
+    float               startSecond;
+    int                 age;
+};
+
+
+/**
+ * Generational handle to a particle in an ofxLabFlexParticleSystem.  The
+ * index picks a slot and the generation must match the slot's, so a handle
+ * to a removed particle stays dead even after its slot is reused.
+ *
+ */
+struct ofxLabFlexHandle {
+    unsigned int    index;
+    unsigned int    generation;
+    
+    ofxLabFlexHandle() : index(0xffffffff), generation(0) {}
+    
+    bool operator==( const ofxLabFlexHandle& other ) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=( const ofxLabFlexHandle& other ) const {
+        return !(*this == other);
+    }
+};
+
+
 class ofxLabFlexParticle : public ofVec3f
 {
 public:
@@ -140,6 +182,15 @@ public:
      */
     virtual void draw();
     
+    /**
+     * Make a copy of this particle, of the same type.  ofxLabFlexPipeline
+     * draws copies while the originals are being simulated, override this
+     * in particles that draw themselves differently.
+     *
+     * @return      A new particle, the caller deletes it
+     */
+    virtual ofxLabFlexParticle* clone() const;
+    
     /**
      * Get's the uniqueID of the particle
      *
@@ -200,6 +251,23 @@ public:
      */
     float getStartSeconds();
     
+    /**
+     * Copy the simulation state of this particle, see ofxLabFlexParticleState
+     *
+     * @param state     Filled in with this particle's state
+     *
+     */
+    void getState( ofxLabFlexParticleState& state ) const;
+    
+    /**
+     * Restore the simulation state of this particle, including its uniqueID.
+     * The data pointer is left alone.
+     *
+     * @param state     The state to restore
+     *
+     */
+    void setState( const ofxLabFlexParticleState& state );
+    
 
     
     // left public for easy changing
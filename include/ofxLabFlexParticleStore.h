@@ -0,0 +1,267 @@
+//
+//  ofxLabFlexParticleStore.h
+//  ofxLabFlexParticleSystem
+//
+//  Compact storage for large swarms that don't need a full ofxLabFlexParticle
+//  each.  An ofxLabFlexParticleSchema says which attributes are used, and the
+//  store keeps one tightly packed array per attribute (structure of arrays),
+//  so a particle costs exactly the bytes of its attributes.  Position,
+//  velocity and radius are always there, everything else is opt in.  Hand
+//  a store to ofxLabFlexParticleSystem::setParticleStore() to move and draw
+//  it in the system's world.
+//
+
+#pragma once
+
+#include "ofxLabFlexParticle.h"
+
+class ofxLabFlexParticleSchema
+{
+public:
+
+    // optional attributes, position, velocity and radius are always stored
+    enum Attribute {
+        ACCELERATION    = (1u << 0),    // cleared by update()
+        ROTATION        = (1u << 1),    // rotation and rotate velocity about z
+        MASS            = (1u << 2),    // 1 when not stored
+        DAMPING         = (1u << 3),    // 1 when not stored
+        AGE             = (1u << 4),
+        USER_DATA       = (1u << 5),    // a void* per particle
+        UNIQUE_ID       = (1u << 6),
+        START_SECOND    = (1u << 7)
+    };
+
+    /**
+     * ofxLabFlexParticleSchema constructor
+     *
+     * @param attributes    Attribute flags or'd together
+     */
+    ofxLabFlexParticleSchema( unsigned int attributes = 0 );
+
+    /**
+     * Use an attribute
+     *
+     * @param attribute     The attribute
+     */
+    void add( Attribute attribute );
+
+    /**
+     * Add a custom float per particle
+     *
+     * @param name          Name to look the channel up by
+     * @param value         Value of new particles
+     * @return              Channel index, see ofxLabFlexParticleStore::getChannel()
+     */
+    int addChannel( const string& name,
+                    float value = 0 );
+
+    /**
+     * @return      true if the attribute is used
+     */
+    bool has( Attribute attribute ) const;
+
+    /**
+     * @return      The attribute flags
+     */
+    unsigned int getAttributes() const;
+
+    /**
+     * @return      Number of custom channels
+     */
+    int getNumChannels() const;
+
+    /**
+     * @param name  Channel name
+     * @return      Its index, -1 if there is none by that name
+     */
+    int getChannelIndex( const string& name ) const;
+
+    /**
+     * @return      Name of a channel
+     */
+    const string& getChannelName( int channel ) const;
+
+    /**
+     * @return      Value a channel starts at
+     */
+    float getChannelDefault( int channel ) const;
+
+    /**
+     * @return      Bytes one particle takes with this schema
+     */
+    size_t getBytesPerParticle() const;
+
+protected:
+
+    unsigned int            _attributes;
+    vector<string>          _channelNames;
+    vector<float>           _channelDefaults;
+
+};
+
+
+class ofxLabFlexParticleStore
+{
+public:
+
+    /**
+     * ofxLabFlexParticleStore constructor, position, velocity and radius
+     * only until setup()
+     */
+    ofxLabFlexParticleStore();
+
+    /**
+     * Set the schema.  Removes all particles.
+     *
+     * @param schema        What to store
+     */
+    void setup( const ofxLabFlexParticleSchema& schema );
+
+    /**
+     * @return      The schema in use
+     */
+    const ofxLabFlexParticleSchema& getSchema() const;
+
+    /**
+     * Add a particle at rest.  Other attributes start at the same defaults
+     * as ofxLabFlexParticle, channels at their default.
+     *
+     * @param x         Starting x position
+     * @param y         Starting y position
+     * @param radius    Starting radius
+     * @return          Index of the new particle
+     */
+    int add( float x,
+             float y,
+             float radius = 2 );
+
+    /**
+     * Add a copy of a particle, keeping the attributes in the schema
+     *
+     * @param particle  Particle to copy
+     * @return          Index of the new particle
+     */
+    int add( ofxLabFlexParticle& particle );
+
+    /**
+     * Copy a stored particle out.  Attributes not in the schema are left
+     * alone.
+     *
+     * @param index     Particle index
+     * @param particle  Receives the particle
+     */
+    void get( int index,
+              ofxLabFlexParticle& particle ) const;
+
+    /**
+     * Remove a particle.  The last particle moves into its index.
+     *
+     * @param index     Particle index
+     */
+    void remove( int index );
+
+    /**
+     * Move the particles to new indices, every attribute with them.  The
+     * arrays stay where they are, so earlier pointers from getX() etc. are
+     * still good.  Look particles up by UNIQUE_ID if they need to be found
+     * again afterwards.
+     *
+     * @param order     For each new index, the old index of the particle
+     *                  that goes there.  size() long, each index once
+     */
+    void reorder( const vector<int>& order );
+    
+    /**
+     * Remove all particles.  Unique IDs start over.
+     */
+    void clear();
+
+    /**
+     * Make room without reallocating until there are this many particles
+     *
+     * @param count     Number of particles
+     */
+    void reserve( int count );
+
+    /**
+     * @return      Number of particles
+     */
+    int size() const;
+
+    /**
+     * Move every particle the same way ofxLabFlexParticle::update() does
+     */
+    void update();
+
+    /**
+     * @return      Bytes one particle takes, see the schema
+     */
+    size_t getBytesPerParticle() const;
+
+    /**
+     * @return      Bytes allocated for all particles, including reserved room
+     */
+    size_t getMemoryUsed() const;
+
+    // attribute arrays, size() long.  NULL when not in the schema or when
+    // empty, and invalidated when particles are added past the reserved room
+    float*          getX();
+    float*          getY();
+    float*          getVelocityX();
+    float*          getVelocityY();
+    float*          getRadius();
+    float*          getAccelerationX();
+    float*          getAccelerationY();
+    float*          getRotation();
+    float*          getRotateVelocity();
+    float*          getMass();
+    float*          getDamping();
+    float*          getStartSecond();
+    int*            getAge();
+    void**          getData();
+    unsigned long*  getUniqueID();
+
+    /**
+     * @param channel   Index from ofxLabFlexParticleSchema::addChannel()
+     * @return          The channel's array, NULL if there is no such channel
+     */
+    float* getChannel( int channel );
+
+protected:
+
+    // float columns, custom channels follow NUM_COLUMNS
+    enum Column {
+        X = 0,
+        Y,
+        VELOCITY_X,
+        VELOCITY_Y,
+        RADIUS,
+        ACCELERATION_X,
+        ACCELERATION_Y,
+        ROTATION_Z,
+        ROTATE_VELOCITY,
+        MASS_VALUE,
+        DAMPING_VALUE,
+        START,
+        NUM_COLUMNS
+    };
+
+    // data of a column, NULL if it isn't in use
+    float* column( int c );
+
+    ofxLabFlexParticleSchema    _schema;
+    int                         _count;
+
+    vector< vector<float> >     _columns;
+    vector<bool>                _columnUsed;
+    vector<float>               _columnDefaults;
+
+    vector<int>                 _age;
+    vector<void*>               _data;
+    vector<unsigned long>       _ids;
+    unsigned long               _nextID;
+
+    // reorder() scratch
+    vector<float>               _reorderFloats;
+
+};
@@ -26,8 +26,19 @@
 #pragma once
 
 #include "ofxLabFlexParticle.h"
+#include "ofxLabFlexParticleStore.h"
 #include "ofxLabFlexVectorField.h"
+#include "ofxLabFlexVectorFieldSequence.h"
+#include "ofxLabFlexProceduralField.h"
 #include "ofxLabFlexQuad.h"
+#include "ofxLabFlexPolygon.h"
+#include "ofxLabFlexDistanceField.h"
+#include "ofxLabFlexObstacles.h"
+#include "ofxLabFlexCollisionSolver.h"
+#include "ofxLabFlexNeighbours.h"
+#include "ofxLabFlexMortonSort.h"
+#include "ofxLabFlexBarnesHut.h"
+#include "ofxLabFlexRecorder.h"
 
 #if defined _WIN64 || defined _WIN32
 #include <functional>
@@ -36,6 +47,53 @@
 #endif
 
 
+/**
+ * Header of a checkpoint written by ofxLabFlexParticleSystem::saveState().  It is
+ * followed by an ofxLabFlexSystemStateSettings (from version 2), numParticles
+ * ofxLabFlexParticleState and a serialized ofxLabFlexVectorField.
+ */
+struct ofxLabFlexSystemStateHeader {
+    char                magic[4];               // "LFSS"
+    unsigned int        version;
+    unsigned int        particleStateSize;      // sizeof(ofxLabFlexParticleState)
+    unsigned int        numParticles;
+    unsigned long long  nextID;
+    unsigned int        options;
+    int                 worldType;
+    float               worldBox[2];
+    float               worldQuad[8];           // tl, tr, bl, br
+    unsigned int        maxParticles;
+    unsigned char       wallCallbackOverride[4];
+};
+
+/**
+ * Simulation settings of a checkpoint, from version 2.  It is followed by
+ * numAttractors ofxLabFlexAttractor and numContacts
+ * ofxLabFlexSystemStateContact.
+ */
+struct ofxLabFlexSystemStateSettings {
+    int                 solverIterations;       // SOLVE_COLLISIONS
+    int                 sortInterval;           // SPATIAL_ORDER
+    int                 framesSinceSort;
+    float               pendingVelMult[3];      // multForce() and addForce() not yet applied
+    float               pendingAccel[3];
+    unsigned int        pendingForces;
+    float               theta;                  // LONG_RANGE_FORCES
+    float               softening;
+    float               strength;
+    unsigned int        particlesAttract;
+    unsigned int        numAttractors;
+    unsigned int        numContacts;            // SOLVE_COLLISIONS warm start
+};
+
+struct ofxLabFlexSystemStateContact {
+    unsigned long long  idA;
+    unsigned long long  idB;
+    float               lambda;
+    float               padding;
+};
+
+
 class ofxLabFlexParticleSystem
 {
 public:
@@ -62,15 +120,19 @@ public:
     static const float VEC_FIELD_FORCE_DIVIDER;
     
     
-    // three world types are allowed so far, open and square.
+    // five world types are allowed so far, open and square.
     // Open is as you guess boundless
     // Square has 4 walls and by default the particles bounce off the walls
     // Quad is a quadrilateral, ie a lopsided square
+    // Polygon is any ofxLabFlexPolygon, concave and with holes
+    // Distance field is any shape baked into an ofxLabFlexDistanceField
     // this can be
     enum WorldType {
         OPEN = 0, 
         SQUARE,
-        QUAD
+        QUAD,
+        POLYGON,
+        DISTANCE_FIELD
     };
     
     
@@ -84,23 +146,68 @@ public:
     
     // should always be equal to the number of enums above
     static const int SUPPORTED_WALL_CALLBACKS = 4;
+    
+    // what a forEach() function does to the particles
+    // READ_ONLY = only looks at them
+    // READ_WRITE = may change the particle it is given (and only that one),
+    //              cached neighbour lists and the spatial order are redone
+    enum AccessMode {
+        READ_ONLY,
+        READ_WRITE
+    };
+    
+    // called by forEach() with each particle
+    typedef std::tr1::function<void ( ofxLabFlexParticle& )>                      ParticleFunction;
+    
+    // called by forEachChunk() with a contiguous span of particles
+    typedef std::tr1::function<void ( ofxLabFlexParticle* const*, int )>           ChunkFunction;
+    
+    // checkpoint format version written by saveState(), newer ones are refused
+    static const unsigned int STATE_VERSION;
 
     
     /* sets internal options
         VERTICAL_WRAP = particles infinitely wrap around top and bottom of screen
                         (ie particle that goes off top instantly shows on bottom)
         HORIZONTAL_WRAP = particles infiinitely wrap around sides of screen
-        VECTOR_FIELD = use the ofxLabFlexVectorField for calculations
+        VECTOR_FIELD = use the ofxLabFlexVectorField for calculations, or the
+                       field given to setVectorFieldSource()
         VECTOR_FIELD_DRAW = draw the ofxLabFlexVectorField forces (visual reference tool)
+        DETECT_COLLISIONS = touching particles repel each other
+        SOLVE_COLLISIONS = push overlapping particles apart after they move, param
+                        is the number of solver iterations (default 4)
+        SPATIAL_ORDER = update particles in Z-order of their position instead of
+                        uniqueID order, so nearby particles are processed together.
+                        The particles of setParticleStore() are moved in memory
+                        into that order, which changes their indices.
+                        param is the number of frames between sorts (default 30)
+        LONG_RANGE_FORCES = particles and attractors pull on every particle, see
+                        setLongRangeForces().  param is the Barnes-Hut opening
+                        angle (default .5)
      */
     enum Options { 
         VERTICAL_WRAP       = (1u << 0),
         HORIZONTAL_WRAP     = (1u << 1),
         VECTOR_FIELD        = (1u << 2),
         VECTOR_FIELD_DRAW   = (1u << 3),
-        DETECT_COLLISIONS   = (1u << 4)
+        DETECT_COLLISIONS   = (1u << 4),
+        SOLVE_COLLISIONS    = (1u << 5),
+        SPATIAL_ORDER       = (1u << 6),
+        LONG_RANGE_FORCES   = (1u << 7)
     };
     
+    // solver iterations when SOLVE_COLLISIONS is set without a param
+    static const int DEFAULT_SOLVER_ITERATIONS = 4;
+    
+    // frames between sorts when SPATIAL_ORDER is set without a param
+    static const int DEFAULT_SORT_INTERVAL = 30;
+    
+    // margin of the cached neighbour lists, see setNeighbourSkin()
+    static const float DEFAULT_NEIGHBOUR_SKIN;
+    
+    // density grid cell size, see setDensityLOD()
+    static const float DEFAULT_LOD_CELL_PIXELS;
+    
     /**
      * Virtual deconstructor
      */
@@ -139,6 +246,29 @@ public:
                     ofVec2f& bottomLeft,
                     ofVec2f& topRight,
                     ofVec2f& bottomRight);
+    
+    /**
+     * Configure the particle system.  You should only call this once.
+     *
+     * Configure the particle system as a POLYGON type.  Particles bounce off
+     * the edge they cross, reflected about it.  The wrap options don't apply
+     * and the four wall callbacks aren't used, see setBoundaryCallback().
+     *
+     * @param polygon       The world outline, copied.  Built if it isn't yet
+     */
+    void setupPolygon( const ofxLabFlexPolygon& polygon );
+    
+    /**
+     * Configure the particle system.  You should only call this once.
+     *
+     * Configure the particle system as a DISTANCE_FIELD type.  A particle hits
+     * the boundary once it is closer to it than its radius, it is pushed back
+     * out and bounced along the field's gradient.  The wrap options don't
+     * apply, setBoundaryCallback() is called with an edge of -1.
+     *
+     * @param field         A baked or loaded field, copied
+     */
+    void setupDistanceField( const ofxLabFlexDistanceField& field );
 
     /**
      * Updates all particles in the system, applies vector fields if option is enabled
@@ -155,6 +285,56 @@ public:
     virtual void draw( const ofRectangle& windowStencil,
                        float rotate = 0.0f);
     
+    /**
+     * Draws copies of the particles taken with ofxLabFlexParticle::getState(),
+     * eg. an ofxLabFlexPipeline frame, with the same stencil, density LOD,
+     * wrapping and vector field as draw().  Copies have no draw() of their
+     * own, each one is drawn the way ofxLabFlexParticle::draw() does.  Only
+     * the positions and radii are used.
+     *
+     * @param particles         copies of the system's particles
+     * @param storeParticles    copies of the particle store's, if any
+     * @param windowStencil     visual square you want drawn
+     */
+    void drawStates( const vector<ofxLabFlexParticleState>& particles,
+                     const vector<ofxLabFlexParticleState>& storeParticles,
+                     const ofRectangle& windowStencil );
+    
+    /**
+     * Same as drawStates(), but with copies from ofxLabFlexParticle::clone()
+     * that are drawn with their own draw()
+     *
+     * @param particles         copies of the system's particles
+     * @param storeParticles    copies of the particle store's, if any
+     * @param windowStencil     visual square you want drawn
+     */
+    void drawCopies( const vector<ofxLabFlexParticle*>& particles,
+                     const vector<ofxLabFlexParticleState>& storeParticles,
+                     const ofRectangle& windowStencil );
+    
+    /**
+     * Zoomed out, draw() bins particles too small to see into a density grid
+     * instead of drawing them: each grid cell is one square, as opaque as
+     * the particles in it cover, so drawing costs at most one square per
+     * cell however many particles there are.  Bigger particles still draw
+     * themselves.
+     *
+     * @param minPixels     particles with a radius under this many pixels
+     *                      are binned, 0 turns it off
+     * @param cellPixels    side of a grid cell, in pixels
+     * @param color         color of a fully covered cell
+     */
+    void setDensityLOD( float minPixels,
+                        float cellPixels = DEFAULT_LOD_CELL_PIXELS,
+                        const ofColor& color = ofColor( 0, 0, 0 ) );
+    
+    /**
+     * How big draw() ends up on screen, for setDensityLOD()
+     *
+     * @param pixelsPerUnit     screen pixels per world unit, 1 by default
+     */
+    void setDrawScale( float pixelsPerUnit );
+    
     /**
      * Inserts an ofxLabFlexParticle into the system.
      * NOTE: no memory management is done by this system
@@ -177,6 +357,14 @@ public:
      */
     virtual bool removeParticle( unsigned long uniqueID );
     
+    /**
+     * Same as removeParticle() above, by handle
+     *
+     * @param handle        handle of the particle
+     * @return              true if the particle was removed, false otherwise
+     */
+    bool removeParticle( const ofxLabFlexHandle& handle );
+    
     /**
      * Clears all particles and resets uniqueID counter
      *
@@ -185,14 +373,18 @@ public:
     virtual void clear();
 	
     /**
-     * Multiply the velocity of all particled by this force
+     * Multiply the velocity of all particled by this force.  Nothing is
+     * touched until the next update(), which applies every multForce() and
+     * addForce() since the last one in the same pass as the integration.
+     * Calls multiply together.
      *
      * @param force     velocity multiplication force
      */
     virtual void multForce( const ofVec3f& force );
     
     /**
-     * Add to the acceleration of all particled by this force
+     * Add to the acceleration of all particled by this force.  Deferred to
+     * the next update() like multForce(), calls add up.
      *
      * @param force     acceleration addition force
      */
@@ -224,6 +416,109 @@ public:
                           WallCallbackType type,
                           bool override);
     
+    /**
+     * Same as setWallCallback() for POLYGON and DISTANCE_FIELD worlds.  The
+     * callback also gets the index of the edge that was hit, see
+     * ofxLabFlexPolygon::addContour(), or -1 in a DISTANCE_FIELD world.
+     *
+     * @param func      function pointer that will act as the callback
+     * @param override  if true the particle system will not bounce the particle
+     *                  and leaves it to the callback
+     */
+    void setBoundaryCallback( std::tr1::function<void ( ofxLabFlexParticle*, int )> func,
+                              bool override );
+    
+    /**
+     * Set the callback for particles hitting one of the obstacles, see
+     * getObstacles().  Same override semantics as setWallCallback().
+     *
+     * @param func      function pointer that will act as the callback, also
+     *                  given the index of the obstacle that was hit
+     * @param override  if true the particle system will not push the particle
+     *                  out and leaves it to the callback
+     */
+    void setObstacleCallback( std::tr1::function<void ( ofxLabFlexParticle*, int )> func,
+                              bool override );
+    
+    /**
+     * Add a function run over every pair of particles closer than cutoff,
+     * after the particles have moved in update().  It is called once from
+     * each side of the pair and the acceleration it returns is added to that
+     * side, so flocking rules and SPH style pressure can be written from one
+     * particle's point of view.  Pairs are split across the thread pool, see
+     * setThreadPool(), so the function must only read the particles.
+     *
+     * @param kernel        pair function, see ofxLabFlexNeighbours::Kernel
+     * @param cutoff        pairs further apart are skipped
+     * @return              kernel index, for getNeighbourValue()
+     */
+    int addNeighbourKernel( const ofxLabFlexNeighbours::Kernel& kernel,
+                            float cutoff );
+    
+    /**
+     * Stop running a neighbour kernel
+     *
+     * @param kernel        index from addNeighbourKernel()
+     */
+    void removeNeighbourKernel( int kernel );
+    
+    /**
+     * Value a neighbour kernel summed for a particle in the last update(),
+     * eg. a density.  Kernels run in the order they were added, so a kernel
+     * can read the values of the ones before it.
+     *
+     * @param kernel        index from addNeighbourKernel()
+     * @param index         ofxLabFlexNeighbour::selfIndex or otherIndex
+     * @return              the value, 0 if there is none
+     */
+    float getNeighbourValue( int kernel,
+                             int index ) const;
+    
+    /**
+     * Set the skin of the neighbour lists used by DETECT_COLLISIONS,
+     * SOLVE_COLLISIONS and the neighbour kernels.  Pairs are found this much
+     * further out and the lists are reused until some particle has moved
+     * half the skin, see ofxLabFlexNeighbourList.  Slow scenes can use a
+     * bigger skin, 0 finds pairs again on every update().
+     *
+     * @param skin          extra distance, in world units
+     */
+    void setNeighbourSkin( float skin );
+    
+    /**
+     * Configure LONG_RANGE_FORCES.  Each particle is pulled towards every
+     * other particle and attractor by strength * mass / distance^2.
+     *
+     * @param strength          gravitational constant, negative repels
+     * @param softening         distance that keeps close pulls finite
+     * @param particlesAttract  false if only the attractors pull
+     */
+    void setLongRangeForces( float strength,
+                             float softening = ofxLabFlexBarnesHut::DEFAULT_SOFTENING,
+                             bool particlesAttract = true );
+    
+    /**
+     * Add a fixed body for LONG_RANGE_FORCES
+     *
+     * @param attractor     position and mass, mass >= 0
+     * @return              index, for setAttractor()
+     */
+    int addAttractor( const ofxLabFlexAttractor& attractor );
+    
+    /**
+     * Move or reweigh an attractor
+     *
+     * @param index         index from addAttractor()
+     * @param attractor     position and mass, mass >= 0
+     */
+    void setAttractor( int index,
+                       const ofxLabFlexAttractor& attractor );
+    
+    /**
+     * Remove all attractors
+     */
+    void clearAttractors();
+    
     /**
      * Enable or diable a given option.  See Options enum
      *
@@ -237,10 +532,33 @@ public:
                     float param = 0.0f );
     
     
+    /**
+     * Call func on every particle, split across the thread pool (see
+     * setThreadPool()).  Holds the update lock, so it never overlaps
+     * update(), and func must not add or remove particles.
+     *
+     * @param func          called with each particle, from any thread
+     * @param mode          what func does to the particles
+     */
+    void forEach( const ParticleFunction& func,
+                  AccessMode mode = READ_WRITE );
+    
+    /**
+     * Same as forEach(), but func gets a span of particle pointers at a
+     * time so it can keep its own state across the span
+     *
+     * @param func          called with the start of each span and its length
+     * @param mode          what func does to the particles
+     * @param chunkSize     most particles in a span, 0 for the default
+     */
+    void forEachChunk( const ChunkFunction& func,
+                       AccessMode mode = READ_WRITE,
+                       int chunkSize = 0 );
+    
     /**
      * Get the internal container that holds our particles.  Be careful
      * as there is no lock associated with this container so you could easily
-     * break things.
+     * break things.  forEach() and forEachChunk() are the safe way.
      *
      *
      * @return              The immutable particle container
@@ -255,6 +573,36 @@ public:
      */
 	ofxLabFlexParticle * getParticle( unsigned long uniqueID );
     
+    /**
+     * Get a particle by handle, see getHandle().  This is a constant time
+     * lookup that takes no lock, so it can be done thousands of times a
+     * frame, even from other threads while update() runs.  A handle of a
+     * removed particle never finds anything, even once its slot has been
+     * reused.
+     *
+     * @param handle        handle of the particle
+     * @return              The particle pointer or NULL
+     */
+    ofxLabFlexParticle * getParticle( const ofxLabFlexHandle& handle ) const;
+    
+    /**
+     * Turn a uniqueID into a handle, keep the handle for later lookups.
+     * Handles belong to the system, a particle in two systems has a
+     * different handle in each.  Like getParticle() by uniqueID this waits
+     * for update(), the lookups by handle don't.
+     *
+     * @param uniqueID      internal ID of the particle
+     * @return              The handle, a dead handle if there is no such particle
+     */
+    ofxLabFlexHandle getHandle( unsigned long uniqueID );
+    
+    /**
+     * @param handle        handle of a particle
+     * @return              true if the particle is still in the system,
+     *                      without a lock like getParticle()
+     */
+    bool isAlive( const ofxLabFlexHandle& handle ) const;
+    
     /**
      * Print a list of the UniqueIDs inside of the particle system.
      * mainly used for debugging.
@@ -262,6 +610,128 @@ public:
      */
     void printIDs();
     
+    /**
+     * Write the full state of the system to a checkpoint: particles, next
+     * uniqueID, options, world shape, which wall callbacks override, and the
+     * vector field with its sin map, shift and offset.  The callbacks
+     * themselves and particle data pointers can't be stored, and neither can
+     * a POLYGON or DISTANCE_FIELD world's shape, call setupPolygon() or
+     * setupDistanceField() again after loading.
+     *
+     * @param path          File to write, passed through ofToDataPath()
+     * @return              true if the checkpoint was written
+     */
+    bool saveState( const string& path );
+    
+    /**
+     * Same as saveState(), into memory
+     *
+     * @param blob          Buffer the state is written to, replacing its contents
+     */
+    void serializeState( vector<unsigned char>& blob );
+    
+    /**
+     * Restore a checkpoint written by saveState().  Current particles are
+     * removed, and the stored particles are created in storage (resized to fit)
+     * and added with their original uniqueIDs.  Use a vector of your own
+     * particle class to get those back.
+     * NOTE: no memory management is done by this system, storage has to
+     * outlive the particles
+     *
+     * @param path          File to read, passed through ofToDataPath()
+     * @param storage       Where the restored particles live
+     * @return              true if the checkpoint was restored
+     */
+    template<class T>
+    bool loadState( const string& path,
+                    vector<T>& storage )
+    {
+        ofxLabFlexMappedFile file;
+        if( !file.open( path ) ) {
+            return false;
+        }
+        return deserializeState( file.getData(), file.getSize(), storage );
+    }
+    
+    /**
+     * Same as loadState(), from memory
+     *
+     * @param data          Start of a state written by serializeState()
+     * @param size          Bytes available at data
+     * @param storage       Where the restored particles live
+     * @return              true if the state was restored
+     */
+    template<class T>
+    bool deserializeState( const unsigned char* data,
+                           size_t size,
+                           vector<T>& storage )
+    {
+        Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+        
+        unsigned int numParticles;
+        const unsigned char* states = restoreState( data, size, numParticles );
+        if( !states ) {
+            return false;
+        }
+        
+        storage.clear();
+        storage.resize( numParticles );
+        
+        // states are stored in uniqueID order, so every insert lands at the end
+        for( unsigned int i=0; i<numParticles; ++i ) {
+            ofxLabFlexParticleState state;
+            memcpy( &state, states + i * sizeof(state), sizeof(state) );
+            storage[i].setState( state );
+            _particles.insert( _particles.end(), Container::value_type( storage[i].getUniqueID(), &storage[i] ) );
+            acquireSlot( storage[i].getUniqueID(), &storage[i] );
+        }
+        ++_orderVersion;
+        
+        return true;
+    }
+    
+    /**
+     * Record every frame of this system to an ofxLabFlexRecorder.  After each
+     * update() the particles and the walls they hit that frame are handed to
+     * the recorder, which writes them on its own thread.
+     * NOTE: no memory management is done by this system
+     *
+     * @param recorder      an open recorder, or NULL to stop recording
+     */
+    void setRecorder( ofxLabFlexRecorder* recorder );
+    
+    /**
+     * Run a compact swarm from an ofxLabFlexParticleStore alongside the
+     * particles.  Every update() moves the stored particles and applies
+     * multForce(), addForce(), the vector field (or setVectorFieldSource()),
+     * the obstacles and the world's walls to them, bouncing or wrapping like
+     * the particles.  draw() culls them to the stencil, puts them in the
+     * density LOD and draws their wrapped copies, as the same circles as
+     * ofxLabFlexParticle::draw().  Forces are added to the acceleration if
+     * the schema has ACCELERATION, otherwise straight to the velocity.
+     * Stored particles don't collide, get no neighbour kernels or long range
+     * forces, aren't recorded or checkpointed, and no callbacks are called
+     * for them.  Don't add or remove stored particles while update() runs.
+     * NOTE: no memory management is done by this system
+     *
+     * @param store         the swarm, or NULL for none
+     */
+    void setParticleStore( ofxLabFlexParticleStore* store );
+    
+    /**
+     * @return              the store from setParticleStore(), or NULL
+     */
+    ofxLabFlexParticleStore * getParticleStore();
+    
+    /**
+     * Spread the work of update() across a pool of threads.  Used by the
+     * SOLVE_COLLISIONS solver and the neighbour kernels.
+     * NOTE: no memory management is done by this system
+     *
+     * @param pool          a thread pool, or NULL to run on the calling thread
+     */
+    void setThreadPool( ofxLabFlexThreadPool* pool );
+    
     /**
      * Return a pointer to the internal vector field that the particle
      * system is using.  This allows the user to configure the vector field
@@ -271,6 +741,15 @@ public:
      */
     ofxLabFlexVectorField * getVectorField();
     
+    /**
+     * Return a pointer to the static obstacles that block the particles.  Add
+     * circles, capsules and polygons to it, they are tested in every update().
+     * Works in every WorldType.
+     *
+     * @return              ofxLabFlexObstacles pointer
+     */
+    ofxLabFlexObstacles * getObstacles();
+    
     /**
      * Apply a given ofxLabFlexVectorField to the particles.  This is useful for advanced
      * functionality where multiple vector fields are needed.  Note that the particle
@@ -281,6 +760,34 @@ public:
      */
     void applyVectorField( const ofxLabFlexVectorField& vectorField );
     
+    /**
+     * Apply an animated ofxLabFlexVectorFieldSequence to the particles at its
+     * current time (see ofxLabFlexVectorFieldSequence::setTime).  Same rules as
+     * applyVectorField() above.
+     *
+     * @param sequence          ofxLabFlexVectorFieldSequence that will be applied
+     */
+    void applyVectorField( const ofxLabFlexVectorFieldSequence& sequence );
+    
+    /**
+     * Apply a procedural field (see ofxLabFlexProceduralField) to the particles,
+     * worked out at their positions in batches.  Same rules as
+     * applyVectorField() above.
+     *
+     * @param source            ofxLabFlexForceSource that will be applied
+     */
+    void applyVectorField( const ofxLabFlexForceSource& source );
+    
+    /**
+     * Use a procedural field (see ofxLabFlexProceduralField) for the
+     * VECTOR_FIELD option instead of the internal grid.  The grid is left
+     * as it is and comes back with NULL.
+     * NOTE: no memory management is done by this system
+     *
+     * @param source            ofxLabFlexForceSource, or NULL for the grid
+     */
+    void setVectorFieldSource( const ofxLabFlexForceSource* source );
+    
     /**
      * Sets the maxinum number of particles that the system will hold.  Once we reach the limit
      * the addition of a new particle will result in the deletion of oldest particle (lowest uniqueID)
@@ -291,30 +798,135 @@ public:
 		_maxParticles = maxParticles;
 	}
     
-    /**
-     * Checks to see if the particle falls within our cropping range
-     *
-     *
-     * @param particle      particle to test
-     * @param ws            the cropping rectangle
-     * @param rotation      rotation of the cropping rectangle
-     * @return              true if the particle should be drawn, false otherwise
-     */
-    bool shouldDraw( ofxLabFlexParticle* particle,
-                     const ofRectangle& ws,
-                     float rotation );
-    
     ofxLabFlexQuad getWorldQuad() {
         return _worldQuad;
     }
     
+    const ofxLabFlexPolygon& getWorldPolygon() {
+        return _worldPolygon;
+    }
+    
 protected:
     
+    // restores everything but the particles from a checkpoint and clears the
+    // current particles.  Returns the stored particle states, which may not
+    // be aligned, NULL on failure.  Expects _updateLock to be held
+    const unsigned char* restoreState( const unsigned char* data,
+                                       size_t size,
+                                       unsigned int& numParticles );
+    
+    // draw a particle if it is in the stencil, or bin it while the density
+    // grid is open
+    void drawParticle( ofxLabFlexParticle* p,
+                       const ofRectangle& ws,
+                       float offsetX = 0,
+                       float offsetY = 0 );
+    
+    // drawParticle(), and again for each wrapped copy
+    void drawParticleWrapped( ofxLabFlexParticle* p,
+                              const ofRectangle& ws );
+    
+    // the same for a particle without a draw() of its own, a store
+    // particle or a copy, at its wrapped position
+    void drawPlainParticle( float x,
+                            float y,
+                            float radius,
+                            const ofRectangle& ws );
+    
+    // drawPlainParticle(), and again for each wrapped copy
+    void drawPlainParticleWrapped( float x,
+                                   float y,
+                                   float radius,
+                                   const ofRectangle& ws );
+    
+    // add a particle's area to its density grid cell
+    void binParticle( float x,
+                      float y,
+                      float radius );
+    
+    // true if a circle is close enough to the stencil to be drawn
+    bool isInStencil( float x,
+                      float y,
+                      float radius,
+                      const ofRectangle& ws ) const;
+    
+    // list the wrapped copies of particles straddling the edges of a
+    // wrapping SQUARE world
+    void buildGhosts();
+    
+    // drop a removed particle's wrapped copies, the others stay until the
+    // next update() rebuilds them
+    void removeGhosts( const ofxLabFlexParticle* particle );
+    
+    // where the wrapped copy of a circle straddling the edges goes, 0 if
+    // it doesn't straddle that edge
+    void getWrapOffsets( float x,
+                         float y,
+                         float radius,
+                         float& offsetX,
+                         float& offsetY ) const;
+    
+    // move the particles of _store and apply everything update() applies
+    // to them
+    void updateStore( bool hasForces,
+                      const ofVec3f& velMult,
+                      const ofVec3f& accel,
+                      bool hasObstacles,
+                      bool sort );
+    
+    // fit the density grid to the stencil, and draw what was binned
+    void beginDensityLOD( const ofRectangle& ws );
+    void endDensityLOD();
+    
+    // give a particle a slot and so a handle, or free its slot.  Expect
+    // _updateLock to be held
+    void acquireSlot( unsigned long uniqueID,
+                      ofxLabFlexParticle* particle );
+    void releaseSlot( unsigned long uniqueID );
+    
+    // free every slot, all handles die
+    void releaseAllSlots();
+    
+    // read a handle's slot without a lock.  false if the handle is dead
+    bool readSlot( const ofxLabFlexHandle& handle,
+                   ofxLabFlexParticle*& particle,
+                   unsigned long& uniqueID ) const;
+    
+    // refill _order from _particles if they changed since the last time
+    void buildOrder();
+    
+    // put _order in Z-order of the particle positions
+    void sortOrder();
+    
+    // move the particles of _store into Z-order of their positions
+    void sortStore();
+    
+    // forEachChunk() over [begin, end) of _order, forEach() over one chunk
+    void forEachInChunk( ofxLabFlexParticle* const* particles,
+                         int count,
+                         const ParticleFunction* func );
+    void forEachChunkRange( int begin,
+                            int end,
+                            const ChunkFunction* func );
+    
+    // add the force of a source to the particles in _order, applySource()
+    // splits them across the pool and applySourceRange() does [begin, end)
+    // a batch at a time
+    void applySource( const ofxLabFlexForceSource* source );
+    void applySourceRange( int begin,
+                           int end,
+                           const ofxLabFlexForceSource* source );
+    
+    // bring _contactList up to date with where the particles in _order are
+    void updateContactList();
+    
     
     Container               _particles;    // holds the actual particles
     WorldType               _worldType;    // is it a bordered world, infinite world ?
     ofVec2f                 _worldBox;     // if square world, this is the boundaries
     ofxLabFlexQuad          _worldQuad;    // if quad world, this is the bounds
+    ofxLabFlexPolygon       _worldPolygon; // if polygon world, this is the bounds
+    ofxLabFlexDistanceField _worldField;   // if distance field world, this is the bounds
     
     
     // call back is for special interactions when particles hit wall boundaries
@@ -324,16 +936,112 @@ protected:
     
     // internal array of the different callbacks
     bool                    _wallCallbackOverride[SUPPORTED_WALL_CALLBACKS];
+    
+    // same as above for polygon worlds, also given the edge that was hit
+    std::tr1::function<void ( ofxLabFlexParticle*, int )>   _boundaryCallback;
+    bool                    _boundaryCallbackOverride;
+    
+    // same again for obstacles, given the obstacle that was hit
+    std::tr1::function<void ( ofxLabFlexParticle*, int )>   _obstacleCallback;
+    bool                    _obstacleCallbackOverride;
 
     ofMutex                 _updateLock;    // update lock, so we can protect memory
     
     unsigned int            _options;       // stores options mask
     
     ofxLabFlexVectorField   _vectorField;   // our vector field
+    const ofxLabFlexForceSource* _fieldSource;  // optional procedural field instead
+    
+    ofxLabFlexObstacles     _obstacles;     // static obstacles
     
     unsigned long           _nextID;        // for uniqueIDs
 
 	unsigned int			_maxParticles;	// optional max particles
     
+    ofxLabFlexRecorder*     _recorder;      // optional frame recorder
+    
+    ofxLabFlexParticleStore* _store;        // optional compact swarm
+    
+    ofxLabFlexThreadPool*   _pool;          // optional worker threads
+    
+    // the particles as one contiguous list, rebuilt when needed by update().
+    // uniqueID order, or Z-order with SPATIAL_ORDER.  The version is bumped
+    // whenever particles are added, removed or sorted
+    vector<ofxLabFlexParticle*> _order;
+    unsigned int            _orderVersion;
+    unsigned int            _orderBuiltVersion; // what _order was built from
+    
+    ofxLabFlexMortonSort    _mortonSort;        // SPATIAL_ORDER
+    int                     _sortInterval;
+    int                     _framesSinceSort;
+    vector<float>           _sortX;
+    vector<float>           _sortY;
+    vector<int>             _sortPermutation;
+    vector<ofxLabFlexParticle*> _sorted;
+    
+    // pairs that may touch, for DETECT_COLLISIONS and SOLVE_COLLISIONS
+    ofxLabFlexNeighbourList _contactList;
+    vector<float>           _contactX;
+    vector<float>           _contactY;
+    vector<float>           _contactRadius;
+    
+    ofxLabFlexCollisionSolver   _collisionSolver;   // SOLVE_COLLISIONS
+    int                     _solverIterations;
+    
+    ofxLabFlexNeighbours    _neighbours;    // neighbour kernels
+    
+    ofxLabFlexBarnesHut     _barnesHut;     // LONG_RANGE_FORCES
+    
+    // copies of particles straddling a wrapping edge, drawn at an offset.
+    // Rebuilt by update() and emptied when particles are removed
+    struct Ghost {
+        ofxLabFlexParticle*     particle;
+        float                   offsetX;
+        float                   offsetY;
+    };
+    vector<Ghost>           _ghosts;
+    
+    // density grid for setDensityLOD(), a square around the stencil at any
+    // rotation.  Only the cells touched this draw() are listed and reset
+    float                   _lodMinPixels;
+    float                   _lodCellPixels;
+    ofColor                 _lodColor;
+    float                   _drawScale;
+    bool                    _bLodActive;
+    float                   _lodOriginX;
+    float                   _lodOriginY;
+    float                   _lodCellSize;
+    int                     _lodCols;
+    int                     _lodRows;
+    vector<float>           _lodCoverage;   // particle area per cell
+    vector<int>             _lodCells;
+    ofMesh                  _lodMesh;
+    
+    // multForce() and addForce() since the last update(), own lock so they
+    // don't wait for an update in progress
+    ofMutex                 _forceLock;
+    ofVec3f                 _pendingVelMult;
+    ofVec3f                 _pendingAccel;
+    bool                    _bPendingForces;
+    
+    // slot map behind the handles.  Only changed with _updateLock held,
+    // read without any lock by readSlot(): the generation moves on before
+    // a slot is cleared, and a reader that sees the same generation before
+    // and after reading the slot read a consistent one.  Slots live in
+    // fixed size chunks and _slots never grows past its reserved size, so
+    // a slot never moves
+    struct Slot {
+        ofxLabFlexParticle*     particle;
+        unsigned long           uniqueID;
+        unsigned int            generation;
+    };
+    vector< vector<Slot> >  _slots;
+    unsigned int            _numSlots;
+    vector<unsigned int>    _freeSlots;
+    
+    // each particle's slot, by uniqueID, guarded by _updateLock.  Kept here
+    // and not on the particle so it can be in more than one system
+    map<unsigned long, unsigned int> _slotIndices;
+    
 };
 
@@ -0,0 +1,173 @@
+//
+//  ofxLabFlexPipeline.h
+//  ofxLabFlexParticleSystem
+//
+//  Runs an ofxLabFlexParticleSystem's update() on its own thread so the
+//  simulation overlaps drawing.  Each frame the main thread calls update()
+//  and then draw() (or getFrame()), which only ever see a published copy
+//  of the particles, never the ones being simulated.
+//
+//  With a latency of 1, update() publishes the frame the thread just
+//  finished and starts the next one, which then runs while the main thread
+//  draws: frame time is the longer of simulation and drawing instead of
+//  their sum, and what is drawn is one frame behind.
+//
+//  With a latency of 0, update() starts the frame and draw() waits for it,
+//  so the simulation only overlaps whatever the app does in between, and
+//  what is drawn is current.
+//
+//  Either way there is at most one frame in flight: update() waits for the
+//  previous frame before starting another, so the simulation can never run
+//  ahead of the app.  Changes to the system (addParticle() and so on) wait
+//  for the frame being simulated.
+//
+//  While a frame is in flight the particles can't draw themselves, so each
+//  publish also takes a copy of every particle with ofxLabFlexParticle::
+//  clone() and draw() draws the copies, each with its own draw().  For big
+//  swarms of plain particles setDrawPlain() skips the copies and draws the
+//  published states as plain circles instead.
+//
+
+#pragma once
+
+#include "ofxLabFlexParticleSystem.h"
+
+class ofxLabFlexPipeline : public ofThread
+{
+public:
+
+    /**
+     * ofxLabFlexPipeline constructor, does nothing until setup()
+     */
+    ofxLabFlexPipeline();
+
+    /**
+     * Waits for the frame in flight and stops the thread
+     */
+    virtual ~ofxLabFlexPipeline();
+
+    /**
+     * Pick the system to simulate.  The thread starts on the first update().
+     * NOTE: no memory management is done by the pipeline
+     *
+     * @param system    The system, updated from the pipeline's thread only
+     * @param latency   Frames the drawn state lags the simulation, 0 or 1
+     */
+    void setup( ofxLabFlexParticleSystem* system,
+                int latency = 1 );
+
+    /**
+     * Change the latency, waits for the frame in flight
+     *
+     * @param latency   0 or 1
+     */
+    void setLatency( int latency );
+
+    /**
+     * @return      The latency, 0 or 1
+     */
+    int getLatency() const;
+
+    /**
+     * Draw frames in flight as plain circles from the published states,
+     * like ofxLabFlexParticle::draw(), instead of copies of the particles
+     * drawn with their own draw().  Saves a clone() per particle per frame,
+     * particles that look different don't look like themselves.  Off by
+     * default.
+     *
+     * @param plain     true for plain circles
+     */
+    void setDrawPlain( bool plain );
+
+    /**
+     * @return      true if frames in flight are drawn as plain circles
+     */
+    bool getDrawPlain() const;
+
+    /**
+     * Call once per frame from the main thread instead of the system's
+     * update().  Waits if the previous frame is still being simulated.
+     */
+    void update();
+
+    /**
+     * Wait for the frame in flight and publish it.  Only does anything with
+     * a latency of 0, draw() and getFrame() call it.
+     */
+    void sync();
+
+    /**
+     * Draw the published frame.  With nothing in flight (a latency of 0)
+     * this is the system's own draw().  Otherwise the particles are being
+     * simulated and drawFrame() draws the published copies instead.
+     *
+     * @param windowStencil     visual square you want drawn
+     * @param rotate            what degree the windowStencil should be rotated
+     */
+    void draw( const ofRectangle& windowStencil,
+               float rotate = 0.0f );
+
+    /**
+     * @return      The published particles, in uniqueID order
+     */
+    const vector<ofxLabFlexParticleState>& getFrame();
+
+    /**
+     * @return      Number of simulated frames published so far
+     */
+    unsigned int getFrameNumber() const;
+
+    /**
+     * Wait for the frame in flight and stop the thread.  update() starts it
+     * again.
+     */
+    void stop();
+
+protected:
+
+    /**
+     * Draws the published copies while the next frame is simulated.  The
+     * default goes through ofxLabFlexParticleSystem::drawCopies(), or
+     * drawStates() with setDrawPlain(), so the stencil, density LOD,
+     * wrapping and vector field all apply.  The copies themselves are in
+     * _drawParticles.
+     *
+     * @param particles         the published particles, in uniqueID order
+     * @param storeParticles    the particle store's, only position and radius are set
+     * @param windowStencil     visual square you want drawn
+     */
+    virtual void drawFrame( const vector<ofxLabFlexParticleState>& particles,
+                            const vector<ofxLabFlexParticleState>& storeParticles,
+                            const ofRectangle& windowStencil );
+
+    void threadedFunction();
+
+    // wait for the frame in flight, if any
+    void wait();
+
+    // copy the system's particles into _frame, and clone them into
+    // _drawParticles unless drawing plain.  Nothing may be in flight
+    void publish();
+
+    // delete the clones in _drawParticles
+    void clearDrawParticles();
+
+    ofxLabFlexParticleSystem*   _system;
+    int                         _latency;
+
+    // one frame at a time: _start lets the thread run a frame, _finished
+    // says it is done
+    Poco::Semaphore             _start;
+    Poco::Semaphore             _finished;
+    bool                        _bInFlight;
+    bool                        _bStopping;
+
+    vector<ofxLabFlexParticleState> _frame;
+    vector<ofxLabFlexParticleState> _storeFrame;
+    unsigned int                _frameNumber;
+
+    // clones of the particles of _frame, owned by the pipeline
+    vector<ofxLabFlexParticle*> _drawParticles;
+    bool                        _bDrawPlain;
+
+};
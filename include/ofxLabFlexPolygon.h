@@ -0,0 +1,140 @@
+//
+//  ofxLabFlexPolygon.h
+//  ofxLabFlexParticleSystem
+//
+//  Boundary of a POLYGON world.  Any number of closed contours, concave, with
+//  holes (even-odd rule: a point is inside if it is inside an odd number of
+//  contours).  Edges are binned into a uniform grid so containment and
+//  nearest edge queries only look at the edges near the point, which keeps
+//  the cost per particle flat as the vertex count grows.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+class ofxLabFlexPolygon
+{
+public:
+
+    /**
+     * One edge of a contour, with the normal pointing out of the polygon
+     */
+    struct Edge {
+        ofVec2f     a;
+        ofVec2f     b;
+        ofVec2f     normal;
+        float       invLengthSq;    // 1 / |b - a|^2, 0 for degenerate edges
+    };
+
+    /**
+     * ofxLabFlexPolygon constructor, the polygon is empty until contours are
+     * added and build() is called
+     */
+    ofxLabFlexPolygon();
+
+    /**
+     * Add a closed contour, the last point connects back to the first.  An
+     * outline or a hole, winding doesn't matter.  Edges are numbered in the
+     * order they are added, starting with the first point of the first contour.
+     *
+     * @param points    At least 3 points
+     */
+    void addContour( const vector<ofVec2f>& points );
+
+    /**
+     * Remove every contour
+     */
+    void clear();
+
+    /**
+     * Bin the edges into the acceleration grid and work out which way each
+     * edge faces.  Call after the contours are added, before any query.
+     *
+     * @param cellSize      Size of a grid cell in world units, 0 picks one
+     *                      from the bounds and the number of edges
+     */
+    void build( float cellSize = 0 );
+
+    /**
+     * @return      true once build() has been called on the current contours
+     */
+    bool isBuilt() const;
+
+    /**
+     * @return      true if the point is inside the polygon
+     */
+    bool inside( float x,
+                 float y ) const;
+
+    /**
+     * Find the edge closest to a point.  Grid cells are searched in rings
+     * around the point and the search stops as soon as no farther cell can
+     * hold a closer edge.
+     *
+     * @param x         The x coordinate
+     * @param y         The y coordinate
+     * @param closest   Receives the closest point on that edge
+     *
+     * @return          Index of the closest edge, -1 if there are no edges
+     */
+    int findNearestEdge( float x,
+                         float y,
+                         ofVec2f& closest ) const;
+
+    /**
+     * @return      Number of edges across all contours
+     */
+    int getNumEdges() const;
+
+    /**
+     * @param index     Edge index, see addContour()
+     */
+    const Edge& getEdge( int index ) const;
+
+    /**
+     * @return      Bounding box of all contours
+     */
+    const ofRectangle& getBounds() const;
+
+    /**
+     * Draw the contours as lines
+     */
+    void draw();
+
+protected:
+
+    // cell of a point, clamped to the grid
+    void getCell( float x,
+                  float y,
+                  int& col,
+                  int& row ) const;
+
+    // true if the segment touches the cell's rectangle
+    bool edgeTouchesCell( const Edge& edge,
+                          int col,
+                          int row ) const;
+
+    // squared distance from a point to an edge, closest point in closest
+    float distanceSq( const Edge& edge,
+                      float x,
+                      float y,
+                      ofVec2f& closest ) const;
+
+    vector<Edge>            _edges;
+
+    ofRectangle             _bounds;
+    bool                    _bBuilt;
+
+    // uniform grid, edges of cell i are _cellEdges[_cellStart[i].._cellStart[i+1])
+    float                   _cellSize;
+    float                   _invCellSize;
+    int                     _cols;
+    int                     _rows;
+    vector<int>             _cellStart;
+    vector<int>             _cellEdges;
+
+    // whether each cell's center is inside, the reference point for inside()
+    vector<unsigned char>   _cellInside;
+
+};
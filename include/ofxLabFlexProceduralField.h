@@ -0,0 +1,350 @@
+//
+//  ofxLabFlexProceduralField.h
+//  ofxLabFlexParticleSystem
+//
+//  Force fields that are worked out at each particle's position instead of
+//  looked up in a grid, so they keep their detail at any size and take no
+//  memory.  Each building block is a small struct with an inline
+//  evaluate( x, y, forceX, forceY ), and the combinators below are templates,
+//  so a composed field like
+//
+//      typedef ofxLabFlexFieldSum< ofxLabFlexVortexField,
+//                                  ofxLabFlexCurlNoiseField > Swirl;
+//
+//      ofxLabFlexProceduralField<Swirl> field( Swirl( ofxLabFlexVortexField( 512, 384, 5, 300 ),
+//                                                     ofxLabFlexCurlNoiseField( .005, 2 ) ) );
+//
+//  compiles down to one loop over a batch of positions.  Positions are in
+//  world coordinates and the forces are in the same units as
+//  ofxLabFlexVectorField::getForceFromPos(), so a field can be handed to
+//  ofxLabFlexParticleSystem::applyVectorField() or
+//  ofxLabFlexParticleSystem::setVectorFieldSource() in place of a grid.
+//  Change a field as it runs through getField(), eg. getField().b.time += dt
+//
+//  The parameters are plain members, like ofxLabFlexAttractor.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+//------------------------------------------------------------------------------------
+// anything that gives a force at a batch of positions
+class ofxLabFlexForceSource
+{
+public:
+
+    virtual ~ofxLabFlexForceSource() {}
+
+    /**
+     * Work out the force at count positions
+     *
+     * @param x         count x positions, in world coordinates
+     * @param y         count y positions
+     * @param count     number of positions
+     * @param forceX    count x forces are written here
+     * @param forceY    count y forces are written here
+     */
+    virtual void getForces( const float* x,
+                            const float* y,
+                            int count,
+                            float* forceX,
+                            float* forceY ) const = 0;
+
+    /**
+     * @param posX      x position, in world coordinates
+     * @param posY      y position
+     * @return          The force at that position
+     */
+    ofVec2f getForceFromPos( float posX,
+                             float posY ) const;
+
+};
+
+
+//------------------------------------------------------------------------------------
+// the same force everywhere
+struct ofxLabFlexUniformField {
+    float   forceX;
+    float   forceY;
+
+    ofxLabFlexUniformField( float forceX = 0,
+                            float forceY = 0 ) :
+    forceX(forceX),
+    forceY(forceY)
+    {}
+
+    inline void evaluate( float /*x*/,
+                          float /*y*/,
+                          float& outX,
+                          float& outY ) const {
+        outX = forceX;
+        outY = forceY;
+    }
+};
+
+
+//------------------------------------------------------------------------------------
+// pushes away from a point, fading out to nothing at radius like
+// ofxLabFlexVectorField::addOutCircle().  A negative strength pulls in
+struct ofxLabFlexRadialField {
+    float   centerX;
+    float   centerY;
+    float   strength;
+    float   radius;     // 0 reaches everywhere at full strength
+
+    ofxLabFlexRadialField( float centerX = 0,
+                           float centerY = 0,
+                           float strength = 1,
+                           float radius = 0 ) :
+    centerX(centerX),
+    centerY(centerY),
+    strength(strength),
+    radius(radius)
+    {}
+
+    inline void evaluate( float x,
+                          float y,
+                          float& outX,
+                          float& outY ) const {
+        float dx = x - centerX;
+        float dy = y - centerY;
+        float distance = sqrtf( dx * dx + dy * dy );
+        float falloff = radius > 0 ? MAX( 0, 1 - distance / radius ) : 1;
+        float f = strength * falloff / (distance + 0.0001f);
+        outX = dx * f;
+        outY = dy * f;
+    }
+};
+
+
+//------------------------------------------------------------------------------------
+// turns around a point, clockwise on screen like
+// ofxLabFlexVectorField::addClockwiseCircle().  A negative strength turns
+// counter clockwise
+struct ofxLabFlexVortexField {
+    float   centerX;
+    float   centerY;
+    float   strength;
+    float   radius;     // 0 reaches everywhere at full strength
+
+    ofxLabFlexVortexField( float centerX = 0,
+                           float centerY = 0,
+                           float strength = 1,
+                           float radius = 0 ) :
+    centerX(centerX),
+    centerY(centerY),
+    strength(strength),
+    radius(radius)
+    {}
+
+    inline void evaluate( float x,
+                          float y,
+                          float& outX,
+                          float& outY ) const {
+        float dx = x - centerX;
+        float dy = y - centerY;
+        float distance = sqrtf( dx * dx + dy * dy );
+        float falloff = radius > 0 ? MAX( 0, 1 - distance / radius ) : 1;
+        float f = strength * falloff / (distance + 0.0001f);
+        outX = -dy * f;
+        outY = dx * f;
+    }
+};
+
+
+//------------------------------------------------------------------------------------
+// flows in the direction of Perlin noise, every force has the same length
+struct ofxLabFlexNoiseField {
+    float   scale;      // noise cycles per world unit, smaller is smoother
+    float   strength;
+    float   time;       // move along the noise to animate it
+
+    ofxLabFlexNoiseField( float scale = .01,
+                          float strength = 1,
+                          float time = 0 ) :
+    scale(scale),
+    strength(strength),
+    time(time)
+    {}
+
+    void evaluate( float x,
+                   float y,
+                   float& outX,
+                   float& outY ) const;
+};
+
+
+//------------------------------------------------------------------------------------
+// the curl of Perlin noise, swirls that neither bunch particles up nor
+// spread them out
+struct ofxLabFlexCurlNoiseField {
+    float   scale;      // noise cycles per world unit, smaller is smoother
+    float   strength;
+    float   time;       // move along the noise to animate it
+
+    ofxLabFlexCurlNoiseField( float scale = .01,
+                              float strength = 1,
+                              float time = 0 ) :
+    scale(scale),
+    strength(strength),
+    time(time)
+    {}
+
+    void evaluate( float x,
+                   float y,
+                   float& outX,
+                   float& outY ) const;
+};
+
+
+//------------------------------------------------------------------------------------
+// two fields added together
+template <class A, class B>
+struct ofxLabFlexFieldSum {
+    A       a;
+    B       b;
+
+    ofxLabFlexFieldSum() {}
+
+    ofxLabFlexFieldSum( const A& a,
+                        const B& b ) :
+    a(a),
+    b(b)
+    {}
+
+    inline void evaluate( float x,
+                          float y,
+                          float& outX,
+                          float& outY ) const {
+        float ax, ay, bx, by;
+        a.evaluate( x, y, ax, ay );
+        b.evaluate( x, y, bx, by );
+        outX = ax + bx;
+        outY = ay + by;
+    }
+};
+
+
+//------------------------------------------------------------------------------------
+// a field made stronger or weaker
+template <class A>
+struct ofxLabFlexFieldScale {
+    A       field;
+    float   scale;
+
+    ofxLabFlexFieldScale( const A& field = A(),
+                          float scale = 1 ) :
+    field(field),
+    scale(scale)
+    {}
+
+    inline void evaluate( float x,
+                          float y,
+                          float& outX,
+                          float& outY ) const {
+        float fx, fy;
+        field.evaluate( x, y, fx, fy );
+        outX = fx * scale;
+        outY = fy * scale;
+    }
+};
+
+
+//------------------------------------------------------------------------------------
+// a field's x force scaled by a sin wave across the world and its y force by
+// one down it, the same as ofxLabFlexVectorField::applySinMap()
+template <class A>
+struct ofxLabFlexSinMap {
+    A       field;
+    float   width;          // world size the waves repeat over
+    float   height;
+    float   xRepeat;        // waves across the width
+    float   yRepeat;        // waves down the height
+    float   xPhase;
+    float   yPhase;
+    float   power;          // pow(sin, power), ignored below 1 for negative sins
+    bool    bPositiveClamp; // only the positive half of the waves
+
+    ofxLabFlexSinMap( const A& field = A(),
+                      float width = 1,
+                      float height = 1,
+                      float xRepeat = 1,
+                      float yRepeat = 1,
+                      float xPhase = 0,
+                      float yPhase = 0,
+                      float power = 1,
+                      bool positiveClamp = false ) :
+    field(field),
+    width(width),
+    height(height),
+    xRepeat(xRepeat),
+    yRepeat(yRepeat),
+    xPhase(xPhase),
+    yPhase(yPhase),
+    power(power),
+    bPositiveClamp(positiveClamp)
+    {}
+
+    inline float wave( float s ) const {
+        if( power != 1 && (s >= 0 || power >= 1) ) {
+            s = powf( s, power );
+        }
+        return bPositiveClamp ? MAX( 0, s ) : s;
+    }
+
+    inline void evaluate( float x,
+                          float y,
+                          float& outX,
+                          float& outY ) const {
+        float fx, fy;
+        field.evaluate( x, y, fx, fy );
+        outX = fx * wave( sinf( x * TWO_PI * xRepeat / width + xPhase ) );
+        outY = fy * wave( sinf( y * TWO_PI * yRepeat / height + yPhase ) );
+    }
+};
+
+
+//------------------------------------------------------------------------------------
+// any of the fields above, or a composition of them, as a force source
+template <class Field>
+class ofxLabFlexProceduralField : public ofxLabFlexForceSource
+{
+public:
+
+    ofxLabFlexProceduralField( const Field& field = Field() ) :
+    _field(field)
+    {}
+
+    /**
+     * @return      The field, to change its parameters
+     */
+    Field& getField() {
+        return _field;
+    }
+
+    /**
+     * @return      The field
+     */
+    const Field& getField() const {
+        return _field;
+    }
+
+    void getForces( const float* x,
+                    const float* y,
+                    int count,
+                    float* forceX,
+                    float* forceY ) const {
+        for( int i=0; i<count; ++i ) {
+            float fx, fy;
+            _field.evaluate( x[i], y[i], fx, fy );
+            forceX[i] = fx;
+            forceY[i] = fy;
+        }
+    }
+
+protected:
+
+    Field   _field;
+
+};
@@ -16,38 +16,103 @@
 class ofxLabFlexQuad
 {
 public:
-    ofVec2f tl,tr,bl,br;
-
-
-    ofxLabFlexQuad() {
-        bBuilt = false;
-    }
+    
+    // bits set by classify() for each edge a point is outside of
+    enum Edge {
+        TOP     = 1,
+        RIGHT   = 2,
+        BOTTOM  = 4,
+        LEFT    = 8
+    };
+    
+    ofxLabFlexQuad();
+    
+    /**
+     * Set the corners and rebuild the cached edge equations
+     */
+    void setCorners( const ofVec2f& topLeft,
+                     const ofVec2f& topRight,
+                     const ofVec2f& bottomLeft,
+                     const ofVec2f& bottomRight );
+    
+    const ofVec2f& getTopLeft() const       { return _tl; }
+    const ofVec2f& getTopRight() const      { return _tr; }
+    const ofVec2f& getBottomLeft() const    { return _bl; }
+    const ofVec2f& getBottomRight() const   { return _br; }
     
     // bounds checks return true IF triggered; e.g. if point is left of quad checkLeft returns true
     
-    bool checkLeftBounds(ofVec2f test){
-        return ((bl.x - tl.x)*(test.y - tl.y) - (bl.y - tl.y)*(test.x - tl.x)) > 0;
+    bool checkLeftBounds( float x, float y ) const {
+        return _edges[EDGE_LEFT].nx * x + _edges[EDGE_LEFT].ny * y + _edges[EDGE_LEFT].offset > 0;
     }
     
-    bool checkRightBounds(ofVec2f test){
-        return ((br.x - tr.x)*(test.y - tr.y) - (br.y - tr.y)*(test.x - tr.x)) < 0;
+    bool checkRightBounds( float x, float y ) const {
+        return _edges[EDGE_RIGHT].nx * x + _edges[EDGE_RIGHT].ny * y + _edges[EDGE_RIGHT].offset > 0;
     }
     
-    bool checkTopBounds(ofVec2f test){
-        return ((tr.x - tl.x)*(test.y - tl.y) - (tr.y - tl.y)*(test.x - tl.x)) < 0;
+    bool checkTopBounds( float x, float y ) const {
+        return _edges[EDGE_TOP].nx * x + _edges[EDGE_TOP].ny * y + _edges[EDGE_TOP].offset > 0;
     }
     
-    bool checkBottomBounds(ofVec2f test){
-        return ((br.x - bl.x)*(test.y - bl.y) - (br.y - bl.y)*(test.x - bl.x)) > 0;
+    bool checkBottomBounds( float x, float y ) const {
+        return _edges[EDGE_BOTTOM].nx * x + _edges[EDGE_BOTTOM].ny * y + _edges[EDGE_BOTTOM].offset > 0;
     }
     
+    bool checkLeftBounds( const ofVec2f& test ) const {
+        return checkLeftBounds( test.x, test.y );
+    }
+    
+    bool checkRightBounds( const ofVec2f& test ) const {
+        return checkRightBounds( test.x, test.y );
+    }
+    
+    bool checkTopBounds( const ofVec2f& test ) const {
+        return checkTopBounds( test.x, test.y );
+    }
+    
+    bool checkBottomBounds( const ofVec2f& test ) const {
+        return checkBottomBounds( test.x, test.y );
+    }
+    
+    /**
+     * @return      x of the left edge at height y, used to wrap particles
+     */
+    float getLeftX( float y ) const {
+        return _tl.x + (y - _tl.y) * _leftSlope;
+    }
+    
+    /**
+     * @return      x of the right edge at height y, used to wrap particles
+     */
+    float getRightX( float y ) const {
+        return _tr.x + (y - _tr.y) * _rightSlope;
+    }
+    
+    /**
+     * Test many points against all 4 edges at once.  Written as a flat loop
+     * over arrays so the compiler can vectorize it.
+     *
+     * @param x         x coordinates
+     * @param y         y coordinates
+     * @param radius    Optional radii, when given the right and left edges only
+     *                  trigger once the whole circle is past them, the same as
+     *                  ofxLabFlexParticleSystem::update().  May be NULL
+     * @param count     Number of points
+     * @param masks     Receives an Edge bitmask per point, 0 if inside
+     */
+    void classify( const float* x,
+                   const float* y,
+                   const float* radius,
+                   int count,
+                   unsigned char* masks ) const;
+    
     //sign( (Bx-Ax)*(Y-Ay) - (By-Ay)*(X-Ax) )
     void draw(){
         if ( !bBuilt ){
-            mesh.addVertex(tl);
-            mesh.addVertex(tr);
-            mesh.addVertex(bl);
-            mesh.addVertex(br);
+            mesh.addVertex(_tl);
+            mesh.addVertex(_tr);
+            mesh.addVertex(_bl);
+            mesh.addVertex(_br);
             mesh.addIndex(0);
             mesh.addIndex(1);
             mesh.addIndex(2);
@@ -61,6 +126,32 @@ public:
     }
     
 private:
+    
+    enum EdgeIndex {
+        EDGE_TOP = 0,
+        EDGE_RIGHT,
+        EDGE_BOTTOM,
+        EDGE_LEFT,
+        NUM_EDGES
+    };
+    
+    // nx * x + ny * y + offset > 0 when a point is outside the edge
+    struct EdgeEquation {
+        float nx, ny, offset;
+    };
+    
+    // rebuild the cached edge equations from the corners
+    void update();
+    
+    // only set through setCorners(), so the edges never go stale
+    ofVec2f         _tl, _tr, _bl, _br;
+    
+    EdgeEquation    _edges[NUM_EDGES];
+    
+    // dx/dy of the left and right edges, for wrapping
+    float           _leftSlope;
+    float           _rightSlope;
+    
     ofMesh mesh;
     bool bBuilt;
 };
@@ -0,0 +1,291 @@
+//
+//  ofxLabFlexRecorder.h
+//  ofxLabFlexParticleSystem
+//
+//  Records what a particle system did, frame by frame, to a compact append
+//  only file, and plays it back through the normal draw path.  Meant for
+//  debugging installations after the fact.
+//
+//  File layout (little endian):
+//      header      ofxLabFlexRecordingHeader
+//      frames      uint32 frame size, then the frame body
+//
+//  Frame body:
+//      uint8       flags, KEYFRAME if it doesn't depend on the previous frame
+//      float       seconds since the recording started
+//      varint      particle count, wall event count
+//      particles   varint id delta from the previous particle in the frame,
+//                  then every float XORed with the same particle's value in
+//                  the previous frame (0 on keyframes) as a varint
+//      events      varint particle id, varint wall (as a 32 bit unsigned)
+//
+
+#pragma once
+
+#include "ofxLabFlexParticle.h"
+#include "ofxLabFlexMappedFile.h"
+
+class ofxLabFlexParticleSystem;
+
+
+/**
+ * The state of one particle in a recorded frame
+ */
+struct ofxLabFlexRecordedParticle {
+
+    // index into data
+    enum Field {
+        POS_X = 0,
+        POS_Y,
+        VELOCITY_X,
+        VELOCITY_Y,
+        RADIUS,
+        ROTATION_X,
+        ROTATION_Y,
+        ROTATION_Z,
+        NUM_FIELDS
+    };
+
+    unsigned long   uniqueID;
+    float           data[NUM_FIELDS];
+};
+
+/**
+ * A particle hitting a wall during a recorded frame
+ */
+struct ofxLabFlexRecordedWallEvent {
+    unsigned long   uniqueID;
+    int             wall;       // ofxLabFlexParticleSystem::WallCallbackType, the
+                                // edge index in POLYGON worlds, -1 in
+                                // DISTANCE_FIELD worlds
+};
+
+/**
+ * On disk header of a recording
+ */
+struct ofxLabFlexRecordingHeader {
+    char            magic[4];           // "LFRC"
+    unsigned int    version;
+    unsigned int    keyframeInterval;
+    unsigned int    reserved;
+};
+
+
+class ofxLabFlexRecorder : public ofThread
+{
+public:
+
+    // recording file format version, newer files are refused by the player
+    static const unsigned int FILE_VERSION;
+
+    /**
+     * ofxLabFlexRecorder constructor, nothing is recorded until open()
+     */
+    ofxLabFlexRecorder();
+
+    /**
+     * Closes the file, writing out anything still queued
+     */
+    virtual ~ofxLabFlexRecorder();
+
+    /**
+     * Start a new recording.  Frames are encoded and written on a background
+     * thread.  If the writer falls behind by more than maxQueuedFrames the
+     * newest frames are dropped (see getDroppedFrames) rather than stalling
+     * the simulation or growing memory.
+     *
+     * @param path              File to write, passed through ofToDataPath()
+     * @param maxQueuedFrames   Most frames held in memory waiting to be written
+     * @param keyframeInterval  A self contained frame is written this often so
+     *                          the player can seek
+     *
+     * @return                  true if the file was created
+     */
+    bool open( const string& path,
+               int maxQueuedFrames = 120,
+               int keyframeInterval = 60 );
+
+    /**
+     * Finish writing queued frames and close the file
+     */
+    void close();
+
+    /**
+     * @return      true while a recording is open
+     */
+    bool isRecording() const;
+
+    /**
+     * Add a particle to the frame being built.  Called by
+     * ofxLabFlexParticleSystem::update(), see setRecorder()
+     */
+    void addParticle( ofxLabFlexParticle& particle );
+
+    /**
+     * Add a wall hit to the frame being built.  Called by
+     * ofxLabFlexParticleSystem::update(), see setRecorder()
+     */
+    void addWallEvent( unsigned long uniqueID,
+                       int wall );
+
+    /**
+     * Hand the frame being built to the writer thread
+     */
+    void endFrame();
+
+    /**
+     * @return      Frames dropped because the writer couldn't keep up
+     */
+    int getDroppedFrames();
+
+    /**
+     * @return      Frames written to disk so far
+     */
+    int getWrittenFrames();
+
+protected:
+
+    struct Frame {
+        float                                   seconds;
+        vector<ofxLabFlexRecordedParticle>      particles;
+        vector<ofxLabFlexRecordedWallEvent>     events;
+    };
+
+    void threadedFunction();
+
+    // encode and write everything in the queue
+    void writeQueued();
+    void writeFrame( Frame* frame );
+
+    FILE *                      _file;
+    bool                        _bRecording;
+    float                       _startSeconds;
+
+    int                         _maxQueuedFrames;
+    int                         _keyframeInterval;
+
+    // frame being built on the simulation thread
+    Frame *                     _current;
+
+    // frames waiting for the writer, and spent frames to reuse.  Guarded by
+    // the ofThread mutex
+    deque<Frame*>               _queue;
+    vector<Frame*>              _free;
+    int                         _dropped;
+    int                         _written;
+
+    Poco::Event                 _frameReady;
+
+    // writer thread only: frames encoded, previous frame for deltas, and
+    // the encode buffer
+    int                                     _encodedFrames;
+    vector<ofxLabFlexRecordedParticle>      _previous;
+    vector<unsigned char>                   _buffer;
+
+};
+
+
+class ofxLabFlexPlayer
+{
+public:
+
+    /**
+     * ofxLabFlexPlayer constructor, nothing plays until load()
+     */
+    ofxLabFlexPlayer();
+
+    /**
+     * Removes replayed particles from the system they were fed to.  The
+     * system must outlive the player.
+     */
+    virtual ~ofxLabFlexPlayer();
+
+    /**
+     * Map a recording and index its frames.  Frames are only decoded when
+     * they are played, the file is paged in by the OS as needed.
+     *
+     * @param path      File to read, passed through ofToDataPath()
+     *
+     * @return          true if the recording was loaded
+     */
+    bool load( const string& path );
+
+    /**
+     * @return      Number of frames in the recording
+     */
+    int getNumFrames() const;
+
+    /**
+     * @return      Recording time of a frame in seconds
+     */
+    float getFrameSeconds( int frame ) const;
+
+    /**
+     * @return      The frame currently decoded, -1 if none
+     */
+    int getCurrentFrame() const;
+
+    /**
+     * Decode a frame.  Playing forward only decodes the new frames, jumping
+     * back decodes from the nearest keyframe.  There is no dependency on wall
+     * clock time, so recordings can be stepped as fast as they decode.
+     *
+     * @param frame     Frame to decode
+     */
+    void seekFrame( int frame );
+
+    /**
+     * Decode the frame recorded at a given time.
+     *
+     * @param seconds   Seconds since the recording started
+     */
+    void seekSeconds( float seconds );
+
+    /**
+     * @return      Particles in the current frame
+     */
+    const vector<ofxLabFlexRecordedParticle>& getParticles() const;
+
+    /**
+     * @return      Wall hits in the current frame
+     */
+    const vector<ofxLabFlexRecordedWallEvent>& getWallEvents() const;
+
+    /**
+     * Feed the current frame to a particle system so it can be drawn with its
+     * normal draw().  Particles are created and removed to match the frame;
+     * they get new uniqueIDs from the system, don't call update() on it.
+     *
+     * @param system    The system to show the frame in
+     */
+    void apply( ofxLabFlexParticleSystem& system );
+
+protected:
+
+    void decodeFrame( int frame );
+    
+    // take replayed particles back out of the system and free them
+    void releaseParticles();
+    void releaseParticles( map<unsigned long, ofxLabFlexParticle*>& particles );
+
+    ofxLabFlexMappedFile                _mapping;
+
+    vector<size_t>                      _frameOffsets;
+    vector<float>                       _frameSeconds;
+    vector<bool>                        _keyframes;
+
+    int                                 _currentFrame;
+    vector<ofxLabFlexRecordedParticle>  _particles;
+    vector<ofxLabFlexRecordedParticle>  _previous;
+    vector<ofxLabFlexRecordedWallEvent> _events;
+
+    // particles fed to a system, by recorded uniqueID
+    ofxLabFlexParticleSystem *                      _system;
+    map<unsigned long, ofxLabFlexParticle*>         _replayed;
+
+private:
+
+    ofxLabFlexPlayer( const ofxLabFlexPlayer& );
+    ofxLabFlexPlayer& operator=( const ofxLabFlexPlayer& );
+
+};
@@ -0,0 +1,142 @@
+//
+//  ofxLabFlexScheduler.h
+//  ofxLabFlexParticleSystem
+//
+//  Updates several ofxLabFlexParticleSystems (and any other per frame work)
+//  at the same time on one thread pool.  Every thread keeps its own queue of
+//  ready tasks and takes from the back of it; a thread with nothing left
+//  steals from the front of someone else's, so one heavy system doesn't
+//  leave the other cores idle.  Tasks can depend on each other, a task only
+//  starts once everything it depends on has finished.
+//
+//  While the scheduler runs, loops the systems start on the same pool (see
+//  ofxLabFlexParticleSystem::setThreadPool) run on the thread that started
+//  them, and threads with no task to take help with them (see
+//  ofxLabFlexThreadPool::help), so one heavy system at the end of a frame
+//  still gets every core.  Threads with nothing at all to do sleep until a
+//  task or a loop turns up.
+//
+
+#pragma once
+
+#include "ofxLabFlexParticleSystem.h"
+
+#include <deque>
+
+class ofxLabFlexScheduler
+{
+public:
+
+    typedef std::tr1::function<void ()> Task;
+
+    /**
+     * ofxLabFlexScheduler constructor
+     *
+     * @param pool      Threads to use, NULL runs everything on the caller
+     */
+    ofxLabFlexScheduler( ofxLabFlexThreadPool* pool = NULL );
+
+    /**
+     * Deletes the task queues
+     */
+    virtual ~ofxLabFlexScheduler();
+
+    /**
+     * NOTE: no memory management is done by the scheduler
+     *
+     * @param pool      Threads to use, NULL runs everything on the caller
+     */
+    void setThreadPool( ofxLabFlexThreadPool* pool );
+
+    /**
+     * Add work to do on every run()
+     *
+     * @param task      Function to call, from any thread
+     * @return          Task index, for addDependency()
+     */
+    int addTask( const Task& task );
+
+    /**
+     * Add a system to update() on every run()
+     * NOTE: no memory management is done by the scheduler
+     *
+     * @param system    The system
+     * @return          Task index, for addDependency()
+     */
+    int addSystem( ofxLabFlexParticleSystem* system );
+
+    /**
+     * Make a task wait for another one, eg. a system reading a vector field
+     * waits for the task editing it
+     *
+     * @param task      Index of the task that waits
+     * @param before    Index of the task that has to finish first
+     */
+    void addDependency( int task,
+                        int before );
+
+    /**
+     * Remove all tasks
+     */
+    void clear();
+
+    /**
+     * @return      Number of tasks
+     */
+    int getNumTasks() const;
+
+    /**
+     * Run every task once and wait for all of them
+     *
+     * @return      false if the dependencies loop, nothing is run then
+     */
+    bool run();
+
+protected:
+
+    struct TaskInfo {
+        Task            func;
+        vector<int>     dependents;     // tasks waiting on this one
+        int             numDependencies;
+    };
+
+    struct Queue {
+        ofMutex         lock;
+        std::deque<int> tasks;
+    };
+
+    // true if every task can be reached in dependency order
+    bool checkOrder() const;
+
+    // run tasks until all are done, for one thread
+    void runWorker( int begin,
+                    int end,
+                    int thread );
+
+    // take a ready task from this thread's queue or steal one
+    bool popTask( int thread,
+                  int& task );
+
+    // true if a task is queued or all are done, for ofxLabFlexThreadPool::waitForWork
+    bool hasWork();
+
+    // mark a task done and queue what it unblocked
+    void finishTask( int task,
+                     int thread );
+
+    ofxLabFlexThreadPool*   _pool;
+
+    vector<TaskInfo>        _tasks;
+    vector<Queue*>          _queues;
+
+    // per run progress, guarded by _stateLock
+    ofMutex                 _stateLock;
+    vector<int>             _waitingOn;
+    int                     _numDone;
+
+private:
+
+    ofxLabFlexScheduler( const ofxLabFlexScheduler& );
+    ofxLabFlexScheduler& operator=( const ofxLabFlexScheduler& );
+
+};
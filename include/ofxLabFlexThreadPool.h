@@ -0,0 +1,187 @@
+//
+//  ofxLabFlexThreadPool.h
+//  ofxLabFlexParticleSystem
+//
+//  A small fixed pool of worker threads for splitting a loop across cores.
+//  The calling thread works too, so a pool of N threads runs N + 1 ranges at
+//  a time, and parallelFor() returns once the whole loop is done.
+//
+//  A loop started while another one runs (nested inside it, or from another
+//  thread) is run by the thread that started it, and any thread that has
+//  run out of ranges of the outer loop helps with it, so one long range
+//  doesn't leave the other threads idle.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "Poco/Condition.h"
+
+#if defined _WIN64 || defined _WIN32
+#include <functional>
+#else
+#include <tr1/functional>
+#endif
+
+class ofxLabFlexThreadPool
+{
+public:
+
+    // called with [begin, end) of the range to process
+    typedef std::tr1::function<void ( int, int )> RangeFunction;
+
+    // same, plus the index of the thread running it, 0 to getNumThreads()
+    typedef std::tr1::function<void ( int, int, int )> ThreadRangeFunction;
+
+    /**
+     * Start the worker threads
+     *
+     * @param numThreads    Workers besides the calling thread, -1 uses one
+     *                      less than the number of cores
+     */
+    ofxLabFlexThreadPool( int numThreads = -1 );
+
+    /**
+     * Stops and joins the worker threads
+     */
+    virtual ~ofxLabFlexThreadPool();
+
+    /**
+     * @return      Number of worker threads, not counting the caller
+     */
+    int getNumThreads() const;
+
+    /**
+     * Run func over [0, count) split into ranges of at most grain items.
+     * Ranges are handed out as threads become free, so uneven work balances
+     * itself.  A loop started while another is running (from another
+     * thread, or nested inside func) runs on its calling thread, helped by
+     * threads with nothing left to do (see help()).
+     *
+     * @param count     Number of items
+     * @param func      Called with each range, from any thread
+     * @param grain     Items per range, 0 splits evenly across the threads
+     */
+    void parallelFor( int count,
+                      const RangeFunction& func,
+                      int grain = 0 );
+
+    /**
+     * Same as parallelFor(), but func is also told which thread runs it so it
+     * can write to per thread buffers without locking.  Thread indices go
+     * from 0 to getNumThreads(), the calling thread included, and no two
+     * ranges running at the same time get the same index.
+     *
+     * @param count     Number of items
+     * @param func      Called with each range and the thread index
+     * @param grain     Items per range, 0 splits evenly across the threads
+     */
+    void parallelForThreads( int count,
+                             const ThreadRangeFunction& func,
+                             int grain = 0 );
+
+    /**
+     * Run one range of a loop started inside the current one, from a thread
+     * that has nothing else to do (eg. an ofxLabFlexScheduler worker waiting
+     * on other tasks)
+     *
+     * @return      false if no loop needs help
+     */
+    bool help();
+
+    /**
+     * Block until a loop may need help() or wake() is called.  Returns at
+     * once if hasWork() is true; it is checked so that a wake() after the
+     * work turns up is never missed.
+     *
+     * @param hasWork   The caller's own reason to stop waiting
+     */
+    void waitForWork( const std::tr1::function<bool ()>& hasWork );
+
+    /**
+     * Release every thread in waitForWork(), call after giving them work
+     */
+    void wake();
+
+    /**
+     * @return      Number of cores reported by the OS, at least 1
+     */
+    static int getNumCores();
+
+protected:
+
+    // a loop started while another one runs, helped by idle threads
+    struct NestedLoop {
+        const RangeFunction*        func;
+        const ThreadRangeFunction*  threadFunc;
+        int                         count;
+        int                         grain;
+        int                         next;
+        int                         running;    // ranges being run by helpers
+        bool                        bWaiting;   // the caller waits on done
+        vector<bool>                slots;      // thread indices in use
+        Poco::Semaphore*            done;
+    };
+
+    class Worker : public ofThread
+    {
+    public:
+        Worker( ofxLabFlexThreadPool* pool, int index ) : _pool(pool), _index(index) {}
+        void threadedFunction();
+    protected:
+        ofxLabFlexThreadPool*   _pool;
+        int                     _index;
+    };
+
+    // hand a loop to the workers and help until it is done
+    void run( int count,
+              const RangeFunction* func,
+              const ThreadRangeFunction* threadFunc,
+              int grain );
+
+    // run a loop started inside the current one, with help
+    void runNested( int count,
+                    const RangeFunction* func,
+                    const ThreadRangeFunction* threadFunc,
+                    int grain );
+
+    // take ranges of the current loop until there are none left, then help
+    // the loops started inside it until it is finished
+    void runRanges( int thread );
+
+    // true once every range of the current loop has been run
+    bool isLoopFinished();
+
+    // a nested loop with ranges left and a free thread index for them,
+    // expects _rangeLock to be held
+    NestedLoop* findNestedLoop( int& slot ) const;
+
+    vector<Worker*>         _workers;
+    bool                    _bStopping;
+
+    // current loop, guarded by _rangeLock.  _bInLoop is set while the
+    // workers run it, any loop started then is nested
+    ofMutex                 _rangeLock;
+    bool                    _bInLoop;
+    const RangeFunction*    _func;
+    const ThreadRangeFunction*  _threadFunc;
+    int                     _count;
+    int                     _grain;
+    int                     _next;
+    int                     _running;       // ranges being run
+    vector<NestedLoop*>     _nested;
+
+    Poco::Semaphore         _start;
+    Poco::Semaphore         _finished;
+
+    // waitForWork() sleeps until wake() bumps _numWakes, guarded by _idleLock
+    ofMutex                 _idleLock;
+    Poco::Condition         _idle;
+    unsigned int            _numWakes;
+
+private:
+
+    ofxLabFlexThreadPool( const ofxLabFlexThreadPool& );
+    ofxLabFlexThreadPool& operator=( const ofxLabFlexThreadPool& );
+
+};
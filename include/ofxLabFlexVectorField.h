@@ -3,6 +3,47 @@
 
 
 #include "ofMain.h"
+#include "ofxLabFlexMappedFile.h"
+
+/**
+ * On disk header of the binary vector field format, see saveField().  The
+ * cell data of each frame follows at headerSize + frame * frameStride, in the
+ * field's StorageType layout.  Everything is little endian.
+ */
+struct ofxLabFlexVectorFieldHeader {
+    char            magic[4];       // "LFVF"
+    unsigned int    version;
+    unsigned int    headerSize;     // offset of the first frame, page aligned
+    unsigned int    storage;        // ofxLabFlexVectorField::StorageType
+    int             fieldWidth;
+    int             fieldHeight;
+    int             externalWidth;
+    int             externalHeight;
+    float           fixedRange;
+    unsigned int    frameCount;     // 1 for a single field, more for a sequence
+    unsigned int    frameBytes;     // bytes of cell data in one frame
+    unsigned int    frameStride;    // distance between frames, page aligned
+    float           frameDuration;  // seconds per frame, sequences only
+    unsigned int    reserved[3];
+};
+
+/**
+ * The runtime settings of a field that aren't part of its cells, as stored by
+ * ofxLabFlexVectorField::serialize()
+ */
+struct ofxLabFlexVectorFieldState {
+    float           scale;
+    float           horShiftPct;
+    float           externalOffset[2];
+    float           sinXRepeat;
+    float           sinYRepeat;
+    float           sinXPhase;
+    float           sinYPhase;
+    float           sinPowerValue;
+    int             useSinMap;
+    int             clampSinPositive;
+    int             hasField;       // followed by a header and cells if set
+};
 
 class ofxLabFlexVectorField {
 	
@@ -15,6 +56,38 @@ public:
     // default internal to external scale.  Ie if the external world
     // is 500x500, and our scale is .1, then our vector field has 50x50 points
     static const float DEFAULT_SCALE;
+    
+    // default magnitude covered by the fixed point storage types.  Field
+    // components outside of -range..range are clamped when stored
+    static const float DEFAULT_FIXED_RANGE;
+    
+    // binary file format version written by saveField(), newer files are refused
+    static const unsigned int FILE_VERSION;
+    
+    // frames in binary files start on this boundary so each one can be
+    // mapped and paged in on its own
+    static const unsigned int FILE_ALIGNMENT;
+    
+    /* how each cell of the field is stored internally
+        FLOAT_32 = full ofVec2f per cell, 8 bytes.  Exact, and the only type
+                   that getField() exposes
+        FLOAT_16 = IEEE half precision per component, 4 bytes.  Relative error
+                   is at most 2^-11 (~0.05%) of the value
+        FIXED_16 = signed 16 bit fixed point over -fixedRange..fixedRange,
+                   4 bytes.  Absolute error is at most fixedRange / 65534
+        FIXED_8  = signed 8 bit fixed point over -fixedRange..fixedRange,
+                   2 bytes.  Absolute error is at most fixedRange / 254
+     
+        The compact types trade precision for bandwidth: a 500x500 field is
+        2MB as FLOAT_32, 1MB as FLOAT_16 / FIXED_16 and 500KB as FIXED_8, which
+        keeps high resolution fields inside L2 while getForceFromPos() samples it
+     */
+    enum StorageType {
+        FLOAT_32 = 0,
+        FLOAT_16,
+        FIXED_16,
+        FIXED_8
+    };
 	
     /**
      * default constructor
@@ -39,17 +112,23 @@ public:
      * @param fieldHeight       The height of the internal representation. Ie how many
      *                          force points internally?  Leave blank to default to a field based
      *                          on the DEFAULT_SCALE
+     * @param storage           How each cell is stored internally, see StorageType
+     * @param fixedRange        The largest force component the FIXED_16 and FIXED_8
+     *                          storage types can hold.  Ignored for the float types
      *
      */
 	void setupField( int externalWidth, 
                      int externalHeight, 
                      int fieldWidth = 0, 
-                     int fieldHeight = 0);
+                     int fieldHeight = 0,
+                     StorageType storage = FLOAT_32,
+                     float fixedRange = DEFAULT_FIXED_RANGE );
 	
     
     /**
      * This will set the force for all vector points to 0.  
      * This will not change the field size, only set all values to 0 so they have no affect
+     * Only the area written since the last zeroField() is cleared.
      */
 	void zeroField();
 	
@@ -57,6 +136,11 @@ public:
      * This will let you lower the field values over time.  All field forces will
      * be set to oldForce * fadeAmount.  ie pass in .99 or so
      *
+     * The cells aren't touched, a decay shared by the whole field is scaled
+     * instead and folded into the cells only once it gets small.  draw()
+     * keeps each line as stored and scales it by the decay, so fading
+     * rebuilds no rows.
+     *
      * @param fadeAmount    The percentage of the force to be LEFT.  NewForce = oldForce * fadeAmount
      */
 	void fadeField(float fadeAmount);
@@ -71,6 +155,10 @@ public:
      * Visually displays a section of the field.  This is very valuable for debugging.
      * Only the specified subsection of the field will be shown if a cropSection is passed
      * otherwise the entire field will be drawn.
+     *
+     * The lines are kept in one mesh and drawn in a single call.  Only rows
+     * changed since the last draw are rebuilt, a changed shift, scale, offset
+     * or sin map rebuilds all of them.
      * 
      * Field is drawn starting at 0,0
      *
@@ -247,10 +335,104 @@ public:
      * Use this to do advanced adjustments to the field.  
      * DO NOT CHANGE THE SIZE OF THE VECTOR
      *
-     * @return  Pointer to the internal vector that holds the field representation
+     * @return  Pointer to the internal vector that holds the field representation,
+     *          NULL if the field is not using FLOAT_32 storage (see getCell / setCell)
      */
     vector<ofVec2f>* getField();
     
+    /**
+     * Reads one cell of the internal field, whatever the storage type.
+     * No fieldShift, sin map or scale is applied.
+     *
+     * @param index     yy * internalSize.x + xx
+     *
+     * @return          The raw force stored in that cell
+     */
+    ofVec2f getCell( int index ) const;
+    
+    /**
+     * Writes one cell of the internal field, whatever the storage type.  The
+     * value is quantized (and clamped for the fixed point types) as needed.
+     *
+     * @param index     yy * internalSize.x + xx
+     * @param force     The raw force to store
+     */
+    void setCell( int index,
+                  const ofVec2f& force );
+    
+    /**
+     * Write the field to a versioned binary file.  The cells are written in
+     * their current StorageType so the file can be mapped straight back in.
+     * Shift, scale, offset and sin map are runtime settings and not saved.
+     *
+     * @param path      File to write, passed through ofToDataPath()
+     *
+     * @return          true if the file was written
+     */
+    bool saveField( const string& path );
+    
+    /**
+     * Load a field written by saveField().  This replaces setupField(); the
+     * dimensions and storage type come from the file.  If the file is a
+     * sequence (see ofxLabFlexVectorFieldSequence) the first frame is used.
+     *
+     * When memory mapped the cells are used in place with no copy, the OS pages
+     * them in as they are sampled.  Edits stay in memory (copy on write) and
+     * never touch the file, but getField() returns NULL for a mapped field.
+     *
+     * @param path      File to read, passed through ofToDataPath()
+     * @param memoryMap Map the file instead of copying it into memory
+     *
+     * @return          true if the field was loaded
+     */
+    bool loadField( const string& path,
+                    bool memoryMap = true );
+    
+    /**
+     * Append the complete field - cells, shift, scale, offset and sin map - to
+     * a buffer.  Used for checkpoints, see ofxLabFlexParticleSystem::saveState()
+     *
+     * @param buffer    Buffer the field is appended to
+     */
+    void serialize( vector<unsigned char>& buffer ) const;
+    
+    /**
+     * Restore a field written by serialize().  The field is set up from the
+     * stored dimensions, so no setupField() is needed first.
+     *
+     * @param data      Start of the serialized field
+     * @param size      Bytes available at data
+     *
+     * @return          Bytes used by the field, 0 if it couldn't be restored
+     */
+    size_t deserialize( const unsigned char* data,
+                        size_t size );
+    
+    /**
+     * @return  true if the field cells are read from a memory mapped file
+     */
+    bool isMemoryMapped() const;
+    
+    /**
+     * @return  The storage type passed to setupField()
+     */
+    StorageType getStorageType() const;
+    
+    /**
+     * @return  Number of bytes each cell of the field takes up
+     */
+    int getBytesPerCell() const;
+    
+    /**
+     * For FIXED_16 and FIXED_8 this is fixed by fixedRange.  A FLOAT_16
+     * error is relative to the force, so it is worked out from the largest
+     * component in the field right now, which means reading every cell.
+     *
+     * @return  The worst case absolute error per component introduced by the
+     *          storage type
+     */
+    float getQuantizationError() const;
+    
     
     
 protected:
@@ -282,6 +464,88 @@ protected:
     
 	
 	vector <ofVec2f> _field;
+    
+    StorageType _storage;
+    float _fixedRange;
+    float _fixedStep;       // force represented by one fixed point step
+    float _fixedInvStep;
+    
+    // backing memory for the compact storage types
+    vector <unsigned char> _packed;
+    
+    // when loaded from a binary file the cells can live in the mapping instead
+    ofPtr<ofxLabFlexMappedFile> _mapping;
+    unsigned char*  _mappedCells;
+    
+    // the cell storage in use, whichever of the above that is
+    unsigned char* cellData();
+    const unsigned char* cellData() const;
+    
+    // fadeField() only scales this, cells hold force / _decay
+    float _decay;
+    
+    // fold _decay into the cells and set it back to 1
+    void renormalize();
+    
+    // a cell as stored, without _decay
+    ofVec2f getStoredCell( int index ) const;
+    
+    // write _fieldSize cells scaled by scale to to, which may be from
+    void scaleCells( const unsigned char* from,
+                     unsigned char* to,
+                     float scale ) const;
+    
+    // cells that may be non zero, none when _writtenMaxX < _writtenMinX
+    int _writtenMinX;
+    int _writtenMinY;
+    int _writtenMaxX;
+    int _writtenMaxY;
+    
+    // any cell may be non zero
+    void markAllWritten();
+    
+    // draw() lines, DRAW_VERTS_PER_CELL vertices per cell in field order.
+    // Edits mark their rows dirty, and the indices pick out the crop
+    ofMesh _drawMesh;
+    vector <ofVec2f> _drawForces;   // each cell's force line from the stored value, before _decay
+    vector <unsigned char> _dirtyRows;
+    bool _bDrawDirty;           // some row is dirty
+    bool _bDrawIndicesDirty;
+    ofRectangle _drawCrop;      // crop the indices were built for
+    float _drawDecay;           // decay the placed lines are _drawForces times
+    
+    // mark every row to be rebuilt by the next draw(), setCell() marks its own
+    void markAllDirty();
+    
+    // rebuild the dirty rows of _drawMesh
+    void updateDrawRows();
+    
+    // put a cell's force and base lines at its _drawForces times _drawDecay
+    void placeForceLine( int index );
+    
+    // index the cells inside cropSection
+    void updateDrawIndices( const ofRectangle& cropSection );
+    
+    // sets every dimension and storage parameter without allocating cells
+    void setupDimensions( int externalWidth,
+                          int externalHeight,
+                          int fieldWidth,
+                          int fieldHeight,
+                          StorageType storage,
+                          float fixedRange );
+    
+    // fills in a header describing this field's layout
+    void fillHeader( ofxLabFlexVectorFieldHeader& header,
+                     unsigned int frameCount,
+                     float frameDuration ) const;
+    
+    // checks a header and the data after it, logs and returns false if it can't be used
+    static bool validateHeader( const unsigned char* data,
+                                size_t size,
+                                const string& path );
+    
+    // sequences swap mapped frames in and out of their fields
+    friend class ofxLabFlexVectorFieldSequence;
 	
 	enum ForceType {
         OUT_CIRCLE, 
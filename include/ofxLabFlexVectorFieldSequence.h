@@ -0,0 +1,113 @@
+//
+//  ofxLabFlexVectorFieldSequence.h
+//  ofxLabFlexParticleSystem
+//
+//  An animated vector field made of keyframes authored offline.  The
+//  keyframes live in one memory mapped file (same format as
+//  ofxLabFlexVectorField::saveField) and are paged in by the OS as playback
+//  reaches them, so an animated field costs no CPU to generate.
+//
+
+#pragma once
+
+#include "ofxLabFlexVectorField.h"
+
+class ofxLabFlexVectorFieldSequence
+{
+public:
+
+    /**
+     * ofxLabFlexVectorFieldSequence constructor, nothing plays until load()
+     */
+    ofxLabFlexVectorFieldSequence();
+
+    /**
+     * Write a set of keyframes to a single sequence file.  All frames must
+     * have the same dimensions and StorageType.
+     *
+     * @param path          File to write, passed through ofToDataPath()
+     * @param frames        The keyframes, in playback order
+     * @param frameDuration Seconds between two keyframes
+     *
+     * @return              true if the file was written
+     */
+    static bool saveSequence( const string& path,
+                              const vector<ofxLabFlexVectorField*>& frames,
+                              float frameDuration );
+
+    /**
+     * Map a sequence file.  Only the header is read here, frames are paged
+     * in as setTime() reaches them.
+     *
+     * @param path      File to read, passed through ofToDataPath()
+     *
+     * @return          true if the sequence was loaded
+     */
+    bool load( const string& path );
+
+    /**
+     * @return      Number of keyframes in the sequence, 0 if nothing is loaded
+     */
+    int getNumFrames() const;
+
+    /**
+     * @return      Length of the sequence in seconds
+     */
+    float getDuration() const;
+
+    /**
+     * Move the playhead.  The force at a time between two keyframes is the
+     * linear blend of the two.  This only swaps pointers into the mapping.
+     *
+     * @param seconds   Time since the start of the sequence
+     * @param loop      Wrap around at the end instead of holding the last frame
+     */
+    void setTime( float seconds,
+                  bool loop = true );
+
+    /**
+     * Same as ofxLabFlexVectorField::getForceFromPos(), blended between the
+     * two keyframes around the current time.
+     *
+     * @param x     The x coordinate (external world coordinate)
+     * @param y     The y coordinate (external world coordinate)
+     *
+     * @return      The 2 dimensional force at this location
+     */
+    ofVec2f getForceFromPos( float posX,
+                             float posY ) const;
+
+    /**
+     * See ofxLabFlexVectorField::setScale(), applied to every frame
+     */
+    void setScale( float scale );
+
+    /**
+     * See ofxLabFlexVectorField::setExternalOffset(), applied to every frame
+     */
+    void setExternalOffset( ofVec2f offset );
+
+    /**
+     * See ofxLabFlexVectorField::setHorizontalShift(), applied to every frame
+     */
+    void setHorizontalShift( float shiftPct );
+
+protected:
+
+    // points a field's cells at one frame of the mapping
+    void bindFrame( ofxLabFlexVectorField& field,
+                    int frame );
+
+    ofPtr<ofxLabFlexMappedFile> _mapping;
+
+    int                     _numFrames;
+    float                   _frameDuration;
+
+    // the two keyframes around the playhead and how far we are between them
+    ofxLabFlexVectorField   _from;
+    ofxLabFlexVectorField   _to;
+    int                     _fromFrame;
+    int                     _toFrame;
+    float                   _blend;
+
+};
@@ -0,0 +1,494 @@
+//
+//  ofxLabFlexBarnesHut.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexBarnesHut.h"
+
+#include <algorithm>
+
+const float ofxLabFlexBarnesHut::DEFAULT_THETA      = 0.5f;
+const float ofxLabFlexBarnesHut::DEFAULT_SOFTENING  = 1.0f;
+
+// bodies in a cell before it is split
+static const int LEAF_SIZE      = 8;
+
+// 16 bits per axis in the Morton codes, so 16 levels below the root
+static const int MAX_LEVEL      = 16;
+
+// cells at this level are built as separate subtrees, up to 4^3 of them
+static const int SPLIT_LEVEL    = 3;
+
+// particles per range handed to a thread
+static const int EVALUATE_GRAIN = 256;
+
+// deepest traversal is 3 cells waiting per level plus the one being opened
+static const int STACK_SIZE     = 3 * MAX_LEVEL + 4;
+
+
+//------------------------------------------------------------------------------------
+// orders Morton codes by their 2 bit quadrant at one level
+struct QuadrantLess {
+    int shift;
+
+    QuadrantLess( int shift ) : shift(shift) {}
+
+    bool operator()( unsigned int quadrant, unsigned int key ) const {
+        return quadrant < ((key >> shift) & 3);
+    }
+};
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexBarnesHut::ofxLabFlexBarnesHut() :
+_theta(DEFAULT_THETA),
+_softening(DEFAULT_SOFTENING),
+_strength(1),
+_bParticlesAttract(true),
+_rootSize(0)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::setTheta( float theta )
+{
+    _theta = MAX( theta, 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexBarnesHut::getTheta() const
+{
+    return _theta;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::setSoftening( float softening )
+{
+    _softening = MAX( softening, 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexBarnesHut::getSoftening() const
+{
+    return _softening;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::setStrength( float strength )
+{
+    _strength = strength;
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexBarnesHut::getStrength() const
+{
+    return _strength;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::setParticlesAttract( bool attract )
+{
+    _bParticlesAttract = attract;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexBarnesHut::getParticlesAttract() const
+{
+    return _bParticlesAttract;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexBarnesHut::addAttractor( const ofxLabFlexAttractor& attractor )
+{
+    _attractors.push_back( attractor );
+    return _attractors.size() - 1;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::setAttractor( int index,
+                                        const ofxLabFlexAttractor& attractor )
+{
+    if( index < 0 || index >= (int) _attractors.size() ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexBarnesHut: no attractor " + ofToString( index ) );
+        return;
+    }
+
+    _attractors[index] = attractor;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::clearAttractors()
+{
+    _attractors.clear();
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexBarnesHut::getNumAttractors() const
+{
+    return _attractors.size();
+}
+
+
+//------------------------------------------------------------------------------------
+const ofxLabFlexAttractor& ofxLabFlexBarnesHut::getAttractor( int index ) const
+{
+    return _attractors[index];
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexBarnesHut::getNumNodes() const
+{
+    return _nodes.size();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::apply( const vector<ofxLabFlexParticle*>& particles,
+                                 ofxLabFlexThreadPool* pool )
+{
+    _nodes.clear();
+
+    int numParticles = particles.size();
+    int numSources = (_bParticlesAttract ? numParticles : 0) + _attractors.size();
+
+    if( numParticles == 0 || numSources == 0 || _strength == 0 ) {
+        return;
+    }
+
+    // gather, particles first then attractors
+    _sourceX.resize( numSources );
+    _sourceY.resize( numSources );
+    _sourceMass.resize( numSources );
+
+    int source = 0;
+    if( _bParticlesAttract ) {
+        for( ; source<numParticles; ++source ) {
+            const ofxLabFlexParticle* p = particles[source];
+            _sourceX[source]    = p->x;
+            _sourceY[source]    = p->y;
+            _sourceMass[source] = p->mass;
+        }
+    }
+    for( unsigned int a=0; a<_attractors.size(); ++a, ++source ) {
+        _sourceX[source]    = _attractors[a].x;
+        _sourceY[source]    = _attractors[a].y;
+        _sourceMass[source] = _attractors[a].mass;
+    }
+
+    // Z-order, every cell of the tree is then a run of bodies
+    _mortonSort.sort( &_sourceX[0], &_sourceY[0], numSources, _order );
+
+    _bodyX.resize( numSources );
+    _bodyY.resize( numSources );
+    _bodyMass.resize( numSources );
+    _bodySource.resize( numSources );
+    _particleBody.assign( numParticles, -1 );
+
+    float minX = _sourceX[0];
+    float maxX = _sourceX[0];
+    float minY = _sourceY[0];
+    float maxY = _sourceY[0];
+
+    for( int i=0; i<numSources; ++i ) {
+        int s = _order[i];
+        _bodyX[i]       = _sourceX[s];
+        _bodyY[i]       = _sourceY[s];
+        _bodyMass[i]    = _sourceMass[s];
+        _bodySource[i]  = _bParticlesAttract && s < numParticles ? s : -1;
+        if( _bodySource[i] >= 0 ) {
+            _particleBody[s] = i;
+        }
+
+        minX = MIN( minX, _bodyX[i] );
+        maxX = MAX( maxX, _bodyX[i] );
+        minY = MIN( minY, _bodyY[i] );
+        maxY = MAX( maxY, _bodyY[i] );
+    }
+
+    // the square the Morton codes were quantized over
+    _rootSize = MAX( maxX - minX, maxY - minY );
+
+    // top levels here, what is below them in parallel, then stitched on
+    _pending.clear();
+    buildNode( _nodes, 0, numSources, 0, true );
+    int numTop = _nodes.size();
+
+    if( _subtrees.size() < _pending.size() ) {
+        _subtrees.resize( _pending.size() );
+    }
+
+    if( pool ) {
+        using namespace std::tr1::placeholders;
+        pool->parallelFor( _pending.size(), std::tr1::bind( &ofxLabFlexBarnesHut::buildSubtrees, this, _1, _2 ), 1 );
+    } else {
+        buildSubtrees( 0, _pending.size() );
+    }
+
+    for( unsigned int k=0; k<_pending.size(); ++k ) {
+        const vector<Node>& subtree = _subtrees[k];
+
+        // the subtree's root takes the place of the top level cell, the
+        // rest goes on the end
+        int base = _nodes.size() - 1;
+        for( unsigned int j=0; j<subtree.size(); ++j ) {
+            Node node = subtree[j];
+            for( int c=0; c<4; ++c ) {
+                if( node.child[c] >= 0 ) {
+                    node.child[c] += base;
+                }
+            }
+
+            if( j == 0 ) {
+                _nodes[_pending[k].node] = node;
+            } else {
+                _nodes.push_back( node );
+            }
+        }
+    }
+
+    // top level cells come before their children, so summing them back to
+    // front sees the subtrees first
+    if( !_pending.empty() ) {
+        for( int i=numTop-1; i>=0; --i ) {
+            if( !_nodes[i].leaf ) {
+                sumNode( _nodes, _nodes[i] );
+            }
+        }
+    }
+
+    if( pool ) {
+        using namespace std::tr1::placeholders;
+        pool->parallelFor( numParticles, std::tr1::bind( &ofxLabFlexBarnesHut::evaluateRange, this, _1, _2, &particles ), EVALUATE_GRAIN );
+    } else {
+        evaluateRange( 0, numParticles, &particles );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexBarnesHut::buildNode( vector<Node>& nodes,
+                                    int begin,
+                                    int end,
+                                    int level,
+                                    bool top )
+{
+    int index = nodes.size();
+    nodes.push_back( Node() );
+
+    Node node;
+    node.x      = 0;
+    node.y      = 0;
+    node.mass   = 0;
+    node.size   = _rootSize / (1 << level);
+    node.begin  = begin;
+    node.end    = end;
+    node.leaf   = end - begin <= LEAF_SIZE || level == MAX_LEVEL;
+    for( int c=0; c<4; ++c ) {
+        node.child[c] = -1;
+    }
+
+    if( !node.leaf && top && level == SPLIT_LEVEL ) {
+        Subtree subtree;
+        subtree.node    = index;
+        subtree.begin   = begin;
+        subtree.end     = end;
+        subtree.level   = level;
+        _pending.push_back( subtree );
+
+        nodes[index] = node;
+        return index;
+    }
+
+    if( !node.leaf ) {
+        const vector<unsigned int>& keys = _mortonSort.getKeys();
+        QuadrantLess less( 2 * (MAX_LEVEL - 1 - level) );
+
+        int start = begin;
+        for( unsigned int c=0; c<4 && start<end; ++c ) {
+            int split = std::upper_bound( keys.begin() + start, keys.begin() + end, c, less ) - keys.begin();
+            if( split > start ) {
+                node.child[c] = buildNode( nodes, start, split, level + 1, top );
+            }
+            start = split;
+        }
+    }
+
+    sumNode( nodes, node );
+
+    nodes[index] = node;
+    return index;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::sumNode( const vector<Node>& nodes,
+                                   Node& node ) const
+{
+    float x = 0;
+    float y = 0;
+    float mass = 0;
+
+    node.minX = node.maxX = _bodyX[node.begin];
+    node.minY = node.maxY = _bodyY[node.begin];
+
+    if( node.leaf ) {
+        for( int b=node.begin; b<node.end; ++b ) {
+            x       += _bodyX[b] * _bodyMass[b];
+            y       += _bodyY[b] * _bodyMass[b];
+            mass    += _bodyMass[b];
+
+            node.minX = MIN( node.minX, _bodyX[b] );
+            node.minY = MIN( node.minY, _bodyY[b] );
+            node.maxX = MAX( node.maxX, _bodyX[b] );
+            node.maxY = MAX( node.maxY, _bodyY[b] );
+        }
+    } else {
+        for( int c=0; c<4; ++c ) {
+            if( node.child[c] >= 0 ) {
+                const Node& child = nodes[node.child[c]];
+                x       += child.x * child.mass;
+                y       += child.y * child.mass;
+                mass    += child.mass;
+
+                node.minX = MIN( node.minX, child.minX );
+                node.minY = MIN( node.minY, child.minY );
+                node.maxX = MAX( node.maxX, child.maxX );
+                node.maxY = MAX( node.maxY, child.maxY );
+            }
+        }
+    }
+
+    node.mass = mass;
+    if( mass > 0 ) {
+        node.x = x / mass;
+        node.y = y / mass;
+    } else {
+        node.x = _bodyX[node.begin];
+        node.y = _bodyY[node.begin];
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::buildSubtrees( int begin,
+                                         int end )
+{
+    for( int k=begin; k<end; ++k ) {
+        const Subtree& subtree = _pending[k];
+        _subtrees[k].clear();
+        buildNode( _subtrees[k], subtree.begin, subtree.end, subtree.level, false );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBarnesHut::evaluateRange( int begin,
+                                         int end,
+                                         const vector<ofxLabFlexParticle*>* particles )
+{
+    float theta2 = _theta * _theta;
+    float soft2 = _softening * _softening;
+
+    int stack[STACK_SIZE];
+
+    for( int i=begin; i<end; ++i ) {
+        ofxLabFlexParticle* p = (*particles)[i];
+        float px = p->x;
+        float py = p->y;
+        float ax = 0;
+        float ay = 0;
+
+        // the particle's own body, if it is one
+        int self = _particleBody[i];
+
+        int top = 0;
+        stack[top++] = 0;
+
+        while( top > 0 ) {
+            const Node& node = _nodes[stack[--top]];
+            if( node.mass <= 0 ) {
+                continue;
+            }
+
+            float dx = node.x - px;
+            float dy = node.y - py;
+            float d2 = dx * dx + dy * dy;
+
+            if( node.leaf && node.end - node.begin > LEAF_SIZE ) {
+
+                // only a MAX_LEVEL cell holds more, its bodies are within a
+                // quantum of each other so they pull as one, less the
+                // particle's own mass
+                float mass = node.mass;
+                if( self >= node.begin && self < node.end ) {
+                    mass -= _bodyMass[self];
+                    if( mass <= 0 ) {
+                        continue;
+                    }
+                    dx = (node.x * node.mass - _bodyX[self] * _bodyMass[self]) / mass - px;
+                    dy = (node.y * node.mass - _bodyY[self] * _bodyMass[self]) / mass - py;
+                    d2 = dx * dx + dy * dy;
+                }
+
+                float r2 = d2 + soft2;
+                if( r2 <= 0 ) {
+                    continue;
+                }
+
+                float f = mass / (r2 * sqrtf( r2 ));
+                ax += dx * f;
+                ay += dy * f;
+            } else if( node.leaf ) {
+                for( int b=node.begin; b<node.end; ++b ) {
+                    if( b == self ) {
+                        continue;
+                    }
+
+                    float bx = _bodyX[b] - px;
+                    float by = _bodyY[b] - py;
+                    float r2 = bx * bx + by * by + soft2;
+                    if( r2 <= 0 ) {
+                        continue;
+                    }
+
+                    float f = _bodyMass[b] / (r2 * sqrtf( r2 ));
+                    ax += bx * f;
+                    ay += by * f;
+                }
+            } else if( node.size * node.size < theta2 * d2 &&
+
+                       // a cell around the particle is never far enough, its
+                       // centre of mass may be right on top of it or include
+                       // the particle itself
+                       (px < node.minX || px > node.maxX || py < node.minY || py > node.maxY) ) {
+                float r2 = d2 + soft2;
+                float f = node.mass / (r2 * sqrtf( r2 ));
+                ax += dx * f;
+                ay += dy * f;
+            } else {
+                for( int c=0; c<4; ++c ) {
+                    if( node.child[c] >= 0 ) {
+                        stack[top++] = node.child[c];
+                    }
+                }
+            }
+        }
+
+        p->acceleration.x += ax * _strength;
+        p->acceleration.y += ay * _strength;
+    }
+}
@@ -0,0 +1,207 @@
+//
+//  ofxLabFlexBroadphase.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexBroadphase.h"
+
+// points per range handed to a thread by findPairs()
+static const int PAIR_GRAIN = 512;
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexBroadphase::ofxLabFlexBroadphase() :
+_x(NULL),
+_y(NULL),
+_count(0),
+_cellSize(1),
+_invCellSize(1),
+_bucketMask(0)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBroadphase::build( const float* x,
+                                  const float* y,
+                                  int count,
+                                  float cellSize )
+{
+    _x              = x;
+    _y              = y;
+    _count          = count;
+    _cellSize       = MAX( cellSize, 0.0001f );
+    _invCellSize    = 1.0f / _cellSize;
+
+    // about two buckets per point keeps unrelated cells from sharing often
+    int buckets = 1;
+    while( buckets < count * 2 ) {
+        buckets <<= 1;
+    }
+    _bucketMask = buckets - 1;
+
+    _bucketStart.assign( buckets + 1, 0 );
+    _pointBucket.resize( count );
+    _sorted.resize( count );
+
+    for( int i=0; i<count; ++i ) {
+        int bucket = getBucket( (int) floorf( x[i] * _invCellSize ), (int) floorf( y[i] * _invCellSize ) );
+        _pointBucket[i] = bucket;
+        ++_bucketStart[bucket + 1];
+    }
+
+    for( int i=0; i<buckets; ++i ) {
+        _bucketStart[i + 1] += _bucketStart[i];
+    }
+
+    vector<int> fill( _bucketStart.begin(), _bucketStart.end() - 1 );
+    for( int i=0; i<count; ++i ) {
+        _sorted[fill[_pointBucket[i]]++] = i;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBroadphase::findPairs( const float* radius,
+                                      float cutoff,
+                                      vector<ofxLabFlexNeighbourPair>& pairs,
+                                      ofxLabFlexThreadPool* pool )
+{
+    pairs.clear();
+
+    if( _count == 0 ) {
+        return;
+    }
+
+    int ranges = (_count + PAIR_GRAIN - 1) / PAIR_GRAIN;
+    if( (int) _rangePairs.size() < ranges ) {
+        _rangePairs.resize( ranges );
+    }
+
+    if( pool ) {
+        using namespace std::tr1::placeholders;
+        pool->parallelFor( _count,
+                           std::tr1::bind( &ofxLabFlexBroadphase::findPairsRange, this, _1, _2, radius, cutoff, PAIR_GRAIN ),
+                           PAIR_GRAIN );
+    } else {
+        findPairsRange( 0, _count, radius, cutoff, PAIR_GRAIN );
+    }
+
+    size_t total = 0;
+    for( int i=0; i<ranges; ++i ) {
+        total += _rangePairs[i].size();
+    }
+
+    pairs.reserve( total );
+    for( int i=0; i<ranges; ++i ) {
+        pairs.insert( pairs.end(), _rangePairs[i].begin(), _rangePairs[i].end() );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexBroadphase::getCount() const
+{
+    return _count;
+}
+
+
+//------------------------------------------------------------------------------------
+const vector<int>& ofxLabFlexBroadphase::getSorted() const
+{
+    return _sorted;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexBroadphase::getBucket( int cellX,
+                                     int cellY ) const
+{
+    unsigned int hash = ((unsigned int) cellX * 73856093u) ^ ((unsigned int) cellY * 19349663u);
+    return (int)( hash & (unsigned int) _bucketMask );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBroadphase::findPairsRange( int begin,
+                                           int end,
+                                           const float* radius,
+                                           float cutoff,
+                                           int grain )
+{
+    // the pool may hand over several grains at once, each has its own output
+    for( int chunk=begin; chunk<end; chunk+=grain ) {
+        vector<ofxLabFlexNeighbourPair>& out = _rangePairs[chunk / grain];
+        out.clear();
+        
+        findPairsChunk( chunk, MIN( end, chunk + grain ), radius, cutoff, out );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexBroadphase::findPairsChunk( int begin,
+                                           int end,
+                                           const float* radius,
+                                           float cutoff,
+                                           vector<ofxLabFlexNeighbourPair>& out ) const
+{
+    float cutoffSq = cutoff * cutoff;
+
+    // walk in grid order so neighbouring points share cache lines
+    for( int s=begin; s<end; ++s ) {
+        int a = _sorted[s];
+        float ax = _x[a];
+        float ay = _y[a];
+
+        int cellX = (int) floorf( ax * _invCellSize );
+        int cellY = (int) floorf( ay * _invCellSize );
+
+        // two of the 9 cells can hash to the same bucket, only visit it once
+        int visited[9];
+        int numVisited = 0;
+
+        for( int dy=-1; dy<=1; ++dy ) {
+            for( int dx=-1; dx<=1; ++dx ) {
+                int bucket = getBucket( cellX + dx, cellY + dy );
+
+                bool seen = false;
+                for( int v=0; v<numVisited; ++v ) {
+                    if( visited[v] == bucket ) {
+                        seen = true;
+                        break;
+                    }
+                }
+                if( seen ) {
+                    continue;
+                }
+                visited[numVisited++] = bucket;
+
+                for( int k=_bucketStart[bucket]; k<_bucketStart[bucket + 1]; ++k ) {
+                    int b = _sorted[k];
+                    if( b <= a ) {
+                        continue;
+                    }
+
+                    float ddx = _x[b] - ax;
+                    float ddy = _y[b] - ay;
+                    float distSq = ddx * ddx + ddy * ddy;
+
+                    float reach = cutoffSq;
+                    if( radius ) {
+                        float r = radius[a] + radius[b] + cutoff;
+                        reach = r * r;
+                    }
+
+                    if( distSq < reach ) {
+                        ofxLabFlexNeighbourPair pair;
+                        pair.a = a;
+                        pair.b = b;
+                        out.push_back( pair );
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,266 @@
+//
+//  ofxLabFlexCollisionSolver.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexCollisionSolver.h"
+
+#include <algorithm>
+
+// share of last frame's separation applied up front to a pair still touching
+static const float WARM_START = 0.8f;
+
+// Jacobi over relaxation, a particle with n contacts moves by
+// MIN(1, RELAXATION / n) of the summed corrections
+static const float RELAXATION = 1.5f;
+
+// particles per range handed to a thread
+static const int SOLVER_GRAIN = 1024;
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexCollisionSolver::ofxLabFlexCollisionSolver() :
+_numTouching(0)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexCollisionSolver::solve( const vector<ofxLabFlexParticle*>& particles,
+                                       const vector<ofxLabFlexNeighbourPair>& candidates,
+                                       int iterations,
+                                       float minMass,
+                                       ofxLabFlexThreadPool* pool )
+{
+    int count = particles.size();
+
+    _contacts.clear();
+    _numTouching = 0;
+
+    if( count < 2 ) {
+        _cache.clear();
+        return;
+    }
+
+    _x.resize( count );
+    _y.resize( count );
+    _nextX.resize( count );
+    _nextY.resize( count );
+    _radius.resize( count );
+    _invMass.resize( count );
+    _ids.resize( count );
+
+    for( int i=0; i<count; ++i ) {
+        ofxLabFlexParticle* p = particles[i];
+        _x[i]       = p->x;
+        _y[i]       = p->y;
+        _radius[i]  = p->radius;
+        _invMass[i] = 1.0f / MAX( p->mass, minMass );
+        _ids[i]     = p->getUniqueID();
+    }
+
+    // every candidate is a contact, the ones not touching just never
+    // correct anything
+    int numContacts = candidates.size();
+    _contacts.resize( numContacts );
+
+    _contactStart.assign( count + 1, 0 );
+
+    for( int c=0; c<numContacts; ++c ) {
+        Contact& contact = _contacts[c];
+        contact.a       = candidates[c].a;
+        contact.b       = candidates[c].b;
+        contact.lambda  = 0;
+
+        ++_contactStart[contact.a + 1];
+        ++_contactStart[contact.b + 1];
+    }
+
+    for( int i=0; i<count; ++i ) {
+        _contactStart[i + 1] += _contactStart[i];
+    }
+
+    _particleContacts.resize( numContacts * 2 );
+    vector<int> fill( _contactStart.begin(), _contactStart.end() - 1 );
+
+    for( int c=0; c<numContacts; ++c ) {
+        _particleContacts[fill[_contacts[c].a]++] = c;
+        _particleContacts[fill[_contacts[c].b]++] = c;
+    }
+
+    using namespace std::tr1::placeholders;
+    ofxLabFlexThreadPool::RangeFunction measure = std::tr1::bind( &ofxLabFlexCollisionSolver::measureContacts, this, _1, _2 );
+    ofxLabFlexThreadPool::RangeFunction gather  = std::tr1::bind( &ofxLabFlexCollisionSolver::gatherCorrections, this, _1, _2 );
+
+    // warm start: pairs that were touching last frame get most of last
+    // frame's separation straight away, as long as they still overlap that much
+    if( !_cache.empty() ) {
+        measureContacts( 0, numContacts );
+
+        bool warm = false;
+        for( int c=0; c<numContacts; ++c ) {
+            Contact& contact = _contacts[c];
+
+            CachedContact key;
+            key.idA = MIN( _ids[contact.a], _ids[contact.b] );
+            key.idB = MAX( _ids[contact.a], _ids[contact.b] );
+
+            vector<CachedContact>::const_iterator cached = std::lower_bound( _cache.begin(), _cache.end(), key );
+            if( cached != _cache.end() && cached->idA == key.idA && cached->idB == key.idB ) {
+                contact.error = MIN( contact.error, cached->lambda * WARM_START );
+                warm = true;
+            } else {
+                contact.error = 0;
+            }
+            contact.lambda = contact.error;
+        }
+
+        if( warm ) {
+            if( pool ) {
+                pool->parallelFor( count, gather, SOLVER_GRAIN );
+            } else {
+                gatherCorrections( 0, count );
+            }
+            _x.swap( _nextX );
+            _y.swap( _nextY );
+        }
+    }
+
+    for( int i=0; i<iterations; ++i ) {
+        if( pool ) {
+            pool->parallelFor( numContacts, measure, SOLVER_GRAIN );
+            pool->parallelFor( count, gather, SOLVER_GRAIN );
+        } else {
+            measureContacts( 0, numContacts );
+            gatherCorrections( 0, count );
+        }
+        _x.swap( _nextX );
+        _y.swap( _nextY );
+    }
+
+    // write back, the position change becomes velocity
+    for( int i=0; i<count; ++i ) {
+        ofxLabFlexParticle* p = particles[i];
+
+        p->velocity.x += _x[i] - p->x;
+        p->velocity.y += _y[i] - p->y;
+        p->x = _x[i];
+        p->y = _y[i];
+    }
+
+    // remember what each pair needed for next frame
+    _cache.clear();
+    for( int c=0; c<numContacts; ++c ) {
+        const Contact& contact = _contacts[c];
+        if( contact.lambda <= 0 ) {
+            continue;
+        }
+        ++_numTouching;
+
+        CachedContact cached;
+        cached.idA      = MIN( _ids[contact.a], _ids[contact.b] );
+        cached.idB      = MAX( _ids[contact.a], _ids[contact.b] );
+        cached.lambda   = contact.lambda;
+        _cache.push_back( cached );
+    }
+    std::sort( _cache.begin(), _cache.end() );
+}
+
+
+//------------------------------------------------------------------------------------
+const vector<ofxLabFlexCollisionSolver::CachedContact>& ofxLabFlexCollisionSolver::getCachedContacts() const
+{
+    return _cache;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexCollisionSolver::setCachedContacts( const vector<CachedContact>& contacts )
+{
+    _cache = contacts;
+    std::sort( _cache.begin(), _cache.end() );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexCollisionSolver::clear()
+{
+    _cache.clear();
+    _contacts.clear();
+    _numTouching = 0;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexCollisionSolver::getNumContacts() const
+{
+    return _numTouching;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexCollisionSolver::measureContacts( int begin,
+                                                 int end )
+{
+    for( int c=begin; c<end; ++c ) {
+        Contact& contact = _contacts[c];
+
+        float dx = _x[contact.a] - _x[contact.b];
+        float dy = _y[contact.a] - _y[contact.b];
+        float distance = sqrtf( dx * dx + dy * dy );
+
+        float overlap = _radius[contact.a] + _radius[contact.b] - distance;
+
+        if( overlap <= 0 ) {
+            contact.error = 0;
+            continue;
+        }
+
+        // exactly on top of each other, split them along x
+        if( distance > 0 ) {
+            contact.nx = dx / distance;
+            contact.ny = dy / distance;
+        } else {
+            contact.nx = 1;
+            contact.ny = 0;
+        }
+
+        contact.error = overlap;
+        contact.lambda += overlap;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexCollisionSolver::gatherCorrections( int begin,
+                                                   int end )
+{
+    for( int i=begin; i<end; ++i ) {
+        float dx = 0;
+        float dy = 0;
+        int active = 0;
+
+        for( int k=_contactStart[i]; k<_contactStart[i + 1]; ++k ) {
+            const Contact& contact = _contacts[_particleContacts[k]];
+            if( contact.error <= 0 ) {
+                continue;
+            }
+
+            int other = contact.a == i ? contact.b : contact.a;
+            float sign = contact.a == i ? 1.0f : -1.0f;
+
+            // heavier particles move less
+            float share = _invMass[i] / (_invMass[i] + _invMass[other]);
+
+            dx += contact.nx * contact.error * share * sign;
+            dy += contact.ny * contact.error * share * sign;
+            ++active;
+        }
+
+        float scale = active > 0 ? MIN( 1.0f, RELAXATION / active ) : 0;
+
+        _nextX[i] = _x[i] + dx * scale;
+        _nextY[i] = _y[i] + dy * scale;
+    }
+}
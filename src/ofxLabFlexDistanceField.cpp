@@ -0,0 +1,461 @@
+//
+//  ofxLabFlexDistanceField.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexDistanceField.h"
+#include "ofxLabFlexMappedFile.h"
+
+#include <cfloat>
+
+const unsigned int ofxLabFlexDistanceField::FILE_VERSION = 1;
+
+// squared distance standing in for "no such cell"
+static const float FAR_AWAY = 1e20f;
+
+
+//------------------------------------------------------------------------------------
+// 1D squared euclidean distance transform (Felzenszwalb & Huttenlocher), the
+// lower envelope of the parabolas rooted at each sample of f.  v and z are
+// scratch of n and n + 1 entries
+static void transform1D( const float* f,
+                         int n,
+                         float* d,
+                         int* v,
+                         float* z )
+{
+    int k = 0;
+    v[0] = 0;
+    z[0] = -FLT_MAX;
+    z[1] = FLT_MAX;
+
+    for( int q=1; q<n; ++q ) {
+        float s = ( (f[q] + q * q) - (f[v[k]] + v[k] * v[k]) ) / (2.0f * (q - v[k]));
+        while( k > 0 && s <= z[k] ) {
+            --k;
+            s = ( (f[q] + q * q) - (f[v[k]] + v[k] * v[k]) ) / (2.0f * (q - v[k]));
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = FLT_MAX;
+    }
+
+    k = 0;
+    for( int q=0; q<n; ++q ) {
+        while( z[k + 1] < q ) {
+            ++k;
+        }
+        d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexDistanceField::ofxLabFlexDistanceField() :
+_cellSize(1),
+_cols(0),
+_rows(0),
+_sourceHash(0),
+_bBaked(false)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexDistanceField::setup( const ofRectangle& bounds,
+                                     float cellSize )
+{
+    _bounds     = bounds;
+    _cellSize   = MAX( cellSize, 0.0001f );
+    _cols       = MAX( 1, (int) ceilf( bounds.width / _cellSize ) );
+    _rows       = MAX( 1, (int) ceilf( bounds.height / _cellSize ) );
+
+    _inside.assign( _cols * _rows, 0 );
+    _samples.clear();
+    _bBaked = false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexDistanceField::addPolygon( const ofxLabFlexPolygon& polygon,
+                                          bool subtract )
+{
+    if( _inside.empty() || !polygon.isBuilt() ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexDistanceField: setup() the field and build() the polygon first" );
+        return;
+    }
+
+    for( int row=0; row<_rows; ++row ) {
+        float y = getY( row );
+        unsigned char* inside = &_inside[row * _cols];
+
+        for( int col=0; col<_cols; ++col ) {
+            if( polygon.inside( getX( col ), y ) ) {
+                inside[col] = subtract ? 0 : 1;
+            }
+        }
+    }
+
+    _bBaked = false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexDistanceField::addMask( const ofPixels& mask,
+                                       const ofRectangle& area,
+                                       unsigned char threshold,
+                                       bool subtract )
+{
+    if( _inside.empty() || mask.getWidth() <= 0 || mask.getHeight() <= 0 ||
+        area.width <= 0 || area.height <= 0 ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexDistanceField: setup() the field and give it a non empty mask" );
+        return;
+    }
+
+    const unsigned char* pixels = mask.getPixels();
+    int width       = mask.getWidth();
+    int height      = mask.getHeight();
+    int channels    = mask.getNumChannels();
+
+    float toPixelX = width / area.width;
+    float toPixelY = height / area.height;
+
+    for( int row=0; row<_rows; ++row ) {
+        int py = (int) floorf( (getY( row ) - area.y) * toPixelY );
+        if( py < 0 || py >= height ) {
+            continue;
+        }
+
+        for( int col=0; col<_cols; ++col ) {
+            int px = (int) floorf( (getX( col ) - area.x) * toPixelX );
+            if( px < 0 || px >= width ) {
+                continue;
+            }
+
+            if( pixels[(py * width + px) * channels] > threshold ) {
+                _inside[row * _cols + col] = subtract ? 0 : 1;
+            }
+        }
+    }
+
+    _bBaked = false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexDistanceField::bake( ofxLabFlexThreadPool* pool )
+{
+    if( _inside.empty() ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexDistanceField: setup() the field before baking" );
+        return;
+    }
+
+    int numCells = _cols * _rows;
+
+    _toOutside.resize( numCells );
+    _toInside.resize( numCells );
+    _samples.resize( numCells );
+
+    // the column pass needs every row done, and the gradient every distance
+    if( pool ) {
+        using namespace std::tr1::placeholders;
+        pool->parallelFor( _rows, std::tr1::bind( &ofxLabFlexDistanceField::transformRows, this, _1, _2 ) );
+        pool->parallelFor( _cols, std::tr1::bind( &ofxLabFlexDistanceField::transformCols, this, _1, _2 ) );
+        pool->parallelFor( _rows, std::tr1::bind( &ofxLabFlexDistanceField::gradientRows, this, _1, _2 ) );
+    } else {
+        transformRows( 0, _rows );
+        transformCols( 0, _cols );
+        gradientRows( 0, _rows );
+    }
+
+    // only needed while baking
+    vector<float>().swap( _toOutside );
+    vector<float>().swap( _toInside );
+
+    _sourceHash = getSourceHash();
+    _bBaked = true;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexDistanceField::loadOrBake( const string& path,
+                                          ofxLabFlexThreadPool* pool )
+{
+    if( _inside.empty() ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexDistanceField: setup() the field before baking" );
+        return false;
+    }
+
+    unsigned long long hash = getSourceHash();
+
+    ofxLabFlexDistanceField cached;
+    if( cached.load( path ) && cached._sourceHash == hash &&
+        cached._cols == _cols && cached._rows == _rows ) {
+        _samples.swap( cached._samples );
+        _sourceHash = hash;
+        _bBaked = true;
+        return true;
+    }
+
+    bake( pool );
+    save( path );
+
+    return _bBaked;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexDistanceField::save( const string& path ) const
+{
+    if( !_bBaked ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexDistanceField: nothing baked to save" );
+        return false;
+    }
+
+    string fullPath = ofToDataPath( path, true );
+
+    FILE* file = fopen( fullPath.c_str(), "wb" );
+    if( !file ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexDistanceField: unable to write " + fullPath );
+        return false;
+    }
+
+    ofxLabFlexDistanceFieldHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, "LFSD", 4 );
+
+    header.version      = FILE_VERSION;
+    header.cols         = _cols;
+    header.rows         = _rows;
+    header.bounds[0]    = _bounds.x;
+    header.bounds[1]    = _bounds.y;
+    header.bounds[2]    = _bounds.width;
+    header.bounds[3]    = _bounds.height;
+    header.cellSize     = _cellSize;
+    header.sourceHash   = _sourceHash;
+
+    size_t bytes = _samples.size() * sizeof(ofxLabFlexDistanceSample);
+
+    bool ok = fwrite( &header, 1, sizeof(header), file ) == sizeof(header) &&
+              fwrite( &_samples[0], 1, bytes, file ) == bytes;
+
+    fclose( file );
+
+    if( !ok ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexDistanceField: failed writing " + fullPath );
+    }
+    return ok;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexDistanceField::load( const string& path )
+{
+    ofxLabFlexMappedFile file;
+    if( !file.open( path ) ) {
+        return false;
+    }
+
+    const ofxLabFlexDistanceFieldHeader* header = (const ofxLabFlexDistanceFieldHeader*) file.getData();
+
+    if( file.getSize() < sizeof(ofxLabFlexDistanceFieldHeader) || memcmp( header->magic, "LFSD", 4 ) != 0 ||
+        header->version > FILE_VERSION || header->cols == 0 || header->rows == 0 || header->cellSize <= 0 ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexDistanceField: not a distance field " + path );
+        return false;
+    }
+
+    size_t numCells = (size_t) header->cols * header->rows;
+    if( file.getSize() < sizeof(ofxLabFlexDistanceFieldHeader) + numCells * sizeof(ofxLabFlexDistanceSample) ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexDistanceField: truncated distance field " + path );
+        return false;
+    }
+
+    _bounds     = ofRectangle( header->bounds[0], header->bounds[1], header->bounds[2], header->bounds[3] );
+    _cols       = header->cols;
+    _rows       = header->rows;
+    _cellSize   = header->cellSize;
+    _sourceHash = header->sourceHash;
+
+    const ofxLabFlexDistanceSample* samples = (const ofxLabFlexDistanceSample*)( file.getData() + sizeof(ofxLabFlexDistanceFieldHeader) );
+    _samples.assign( samples, samples + numCells );
+
+    _inside.clear();
+    _bBaked = true;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexDistanceField::isBaked() const
+{
+    return _bBaked;
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexDistanceField::sample( float x,
+                                       float y,
+                                       ofVec2f& normal ) const
+{
+    if( !_bBaked ) {
+        normal.set( 0, 0 );
+        return FAR_AWAY;
+    }
+
+    // grid points sit at cell centers
+    float fx = ofClamp( (x - _bounds.x) / _cellSize - 0.5f, 0, _cols - 1 );
+    float fy = ofClamp( (y - _bounds.y) / _cellSize - 0.5f, 0, _rows - 1 );
+
+    int col0 = (int) fx;
+    int row0 = (int) fy;
+    int col1 = MIN( col0 + 1, _cols - 1 );
+    int row1 = MIN( row0 + 1, _rows - 1 );
+
+    float tx = fx - col0;
+    float ty = fy - row0;
+
+    const ofxLabFlexDistanceSample& s00 = _samples[row0 * _cols + col0];
+    const ofxLabFlexDistanceSample& s10 = _samples[row0 * _cols + col1];
+    const ofxLabFlexDistanceSample& s01 = _samples[row1 * _cols + col0];
+    const ofxLabFlexDistanceSample& s11 = _samples[row1 * _cols + col1];
+
+    float w00 = (1 - tx) * (1 - ty);
+    float w10 = tx * (1 - ty);
+    float w01 = (1 - tx) * ty;
+    float w11 = tx * ty;
+
+    normal.set( s00.gradientX * w00 + s10.gradientX * w10 + s01.gradientX * w01 + s11.gradientX * w11,
+                s00.gradientY * w00 + s10.gradientY * w10 + s01.gradientY * w01 + s11.gradientY * w11 );
+
+    return s00.distance * w00 + s10.distance * w10 + s01.distance * w01 + s11.distance * w11;
+}
+
+
+//------------------------------------------------------------------------------------
+const ofRectangle& ofxLabFlexDistanceField::getBounds() const
+{
+    return _bounds;
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexDistanceField::getX( int col ) const
+{
+    return _bounds.x + (col + 0.5f) * _cellSize;
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexDistanceField::getY( int row ) const
+{
+    return _bounds.y + (row + 0.5f) * _cellSize;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexDistanceField::transformRows( int begin,
+                                             int end )
+{
+    vector<float>   f( _cols );
+    vector<int>     v( _cols );
+    vector<float>   z( _cols + 1 );
+
+    for( int row=begin; row<end; ++row ) {
+        const unsigned char* inside = &_inside[row * _cols];
+
+        for( int col=0; col<_cols; ++col ) {
+            f[col] = inside[col] ? FAR_AWAY : 0;
+        }
+        transform1D( &f[0], _cols, &_toOutside[row * _cols], &v[0], &z[0] );
+
+        for( int col=0; col<_cols; ++col ) {
+            f[col] = inside[col] ? 0 : FAR_AWAY;
+        }
+        transform1D( &f[0], _cols, &_toInside[row * _cols], &v[0], &z[0] );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexDistanceField::transformCols( int begin,
+                                             int end )
+{
+    vector<float>   f( _rows );
+    vector<float>   d( _rows );
+    vector<int>     v( _rows );
+    vector<float>   z( _rows + 1 );
+
+    for( int col=begin; col<end; ++col ) {
+
+        for( int row=0; row<_rows; ++row ) {
+            f[row] = _toOutside[row * _cols + col];
+        }
+        transform1D( &f[0], _rows, &d[0], &v[0], &z[0] );
+        for( int row=0; row<_rows; ++row ) {
+            _toOutside[row * _cols + col] = d[row];
+        }
+
+        for( int row=0; row<_rows; ++row ) {
+            f[row] = _toInside[row * _cols + col];
+        }
+        transform1D( &f[0], _rows, &d[0], &v[0], &z[0] );
+
+        // the boundary lies half way between an inside and an outside cell
+        for( int row=0; row<_rows; ++row ) {
+            int cell = row * _cols + col;
+            if( _inside[cell] ) {
+                _samples[cell].distance = ( sqrtf( _toOutside[cell] ) - 0.5f ) * _cellSize;
+            } else {
+                _samples[cell].distance = -( sqrtf( d[row] ) - 0.5f ) * _cellSize;
+            }
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexDistanceField::gradientRows( int begin,
+                                            int end )
+{
+    for( int row=begin; row<end; ++row ) {
+        int up      = MAX( row - 1, 0 );
+        int down    = MIN( row + 1, _rows - 1 );
+
+        for( int col=0; col<_cols; ++col ) {
+            int left    = MAX( col - 1, 0 );
+            int right   = MIN( col + 1, _cols - 1 );
+
+            ofVec2f gradient( _samples[row * _cols + right].distance - _samples[row * _cols + left].distance,
+                              _samples[down * _cols + col].distance - _samples[up * _cols + col].distance );
+            gradient.normalize();
+
+            ofxLabFlexDistanceSample& s = _samples[row * _cols + col];
+            s.gradientX = gradient.x;
+            s.gradientY = gradient.y;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+unsigned long long ofxLabFlexDistanceField::getSourceHash() const
+{
+    // 64 bit FNV-1a
+    unsigned long long hash = 14695981039346656037ULL;
+
+    float params[6] = { _bounds.x, _bounds.y, _bounds.width, _bounds.height, _cellSize, (float) _cols };
+
+    const unsigned char* bytes = (const unsigned char*) params;
+    for( unsigned int i=0; i<sizeof(params); ++i ) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+
+    for( unsigned int i=0; i<_inside.size(); ++i ) {
+        hash = (hash ^ _inside[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
@@ -0,0 +1,337 @@
+//
+//  ofxLabFlexFluidSolver.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexFluidSolver.h"
+
+// rows per strip handed to a thread
+static const int ROW_GRAIN = 16;
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexFluidSolver::ofxLabFlexFluidSolver() :
+_field(NULL),
+_pool(NULL),
+_width(0),
+_height(0),
+_speed(1),
+_viscosity(0),
+_diffusionIterations(DEFAULT_DIFFUSION_ITERATIONS),
+_pressureIterations(DEFAULT_PRESSURE_ITERATIONS),
+_dt(0),
+_diffusion(0),
+_cells(NULL)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::setup( ofxLabFlexVectorField* field,
+                                   ofxLabFlexThreadPool* pool )
+{
+    _field = field;
+    _pool = pool;
+
+    ofVec2f size = field ? field->getInternalSize() : ofVec2f( 0, 0 );
+    _width = size.x;
+    _height = size.y;
+
+    if( _width < 2 || _height < 2 ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexFluidSolver: the field needs at least 2x2 cells" );
+        _field = NULL;
+        return;
+    }
+
+    int count = _width * _height;
+    _u.assign( count, 0 );
+    _v.assign( count, 0 );
+    _uSource.assign( count, 0 );
+    _vSource.assign( count, 0 );
+    _uNext.assign( count, 0 );
+    _vNext.assign( count, 0 );
+    _pressure.assign( count, 0 );
+    _pressureNext.assign( count, 0 );
+    _divergence.assign( count, 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::setThreadPool( ofxLabFlexThreadPool* pool )
+{
+    _pool = pool;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::setSpeed( float speed )
+{
+    _speed = speed;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::setViscosity( float viscosity )
+{
+    _viscosity = MAX( viscosity, 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::setDiffusionIterations( int iterations )
+{
+    _diffusionIterations = MAX( iterations, 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::setPressureIterations( int iterations )
+{
+    _pressureIterations = MAX( iterations, 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::reset()
+{
+    _pressure.assign( _pressure.size(), 0 );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::update( float dt )
+{
+    if( !_field ) {
+        return;
+    }
+
+    ofVec2f size = _field->getInternalSize();
+    if( (int) size.x != _width || (int) size.y != _height ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexFluidSolver: the field changed size, call setup() again" );
+        return;
+    }
+
+    _dt = dt;
+    _diffusion = dt * _viscosity;
+
+    // the cells, whatever brushes did to them since the last update
+    vector<ofVec2f>* cells = _field->getField();
+    _cells = cells ? &(*cells)[0] : NULL;
+
+    if( _cells ) {
+        runRows( &ofxLabFlexFluidSolver::loadRows );
+    } else {
+        loadRows( 0, _height );
+    }
+
+    // move the velocity along itself
+    runRows( &ofxLabFlexFluidSolver::advectRows );
+    _u.swap( _uNext );
+    _v.swap( _vNext );
+
+    // viscosity, solving (1 - diffusion * laplacian) u = source
+    if( _diffusion > 0 && _diffusionIterations > 0 ) {
+        _uSource = _u;
+        _vSource = _v;
+        for( int i=0; i<_diffusionIterations; ++i ) {
+            runRows( &ofxLabFlexFluidSolver::diffuseRows );
+            _u.swap( _uNext );
+            _v.swap( _vNext );
+        }
+    }
+
+    // make it divergence free, laplacian pressure = divergence
+    runRows( &ofxLabFlexFluidSolver::divergenceRows );
+    for( int i=0; i<_pressureIterations; ++i ) {
+        runRows( &ofxLabFlexFluidSolver::pressureRows );
+        _pressure.swap( _pressureNext );
+    }
+    runRows( &ofxLabFlexFluidSolver::gradientRows );
+
+    if( _cells ) {
+        runRows( &ofxLabFlexFluidSolver::storeRows );
+    } else {
+        storeRows( 0, _height );
+    }
+    _cells = NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::runRows( RowPass pass )
+{
+    if( _pool ) {
+        using namespace std::tr1::placeholders;
+        _pool->parallelFor( _height, std::tr1::bind( pass, this, _1, _2 ), ROW_GRAIN );
+    } else {
+        (this->*pass)( 0, _height );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::loadRows( int begin,
+                                      int end )
+{
+    for( int i=begin * _width; i<end * _width; ++i ) {
+        ofVec2f cell = _cells ? _cells[i] : _field->getCell( i );
+        _u[i] = cell.x;
+        _v[i] = cell.y;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::storeRows( int begin,
+                                       int end )
+{
+    for( int i=begin * _width; i<end * _width; ++i ) {
+        if( _cells ) {
+            _cells[i].set( _u[i], _v[i] );
+        } else {
+            _field->setCell( i, ofVec2f( _u[i], _v[i] ) );
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::advectRows( int begin,
+                                        int end )
+{
+    float scale = _dt * _speed;
+    float maxX = _width - 1.001f;
+    float maxY = _height - 1.001f;
+
+    for( int y=begin; y<end; ++y ) {
+        for( int x=0; x<_width; ++x ) {
+            int i = y * _width + x;
+
+            // where this cell's fluid was a step ago
+            float fromX = ofClamp( x - scale * _u[i], 0, maxX );
+            float fromY = ofClamp( y - scale * _v[i], 0, maxY );
+
+            int x0 = (int) fromX;
+            int y0 = (int) fromY;
+            float sx = fromX - x0;
+            float sy = fromY - y0;
+
+            int a = y0 * _width + x0;
+            int b = a + _width;
+
+            _uNext[i] = (1 - sy) * ((1 - sx) * _u[a] + sx * _u[a + 1]) +
+                        sy       * ((1 - sx) * _u[b] + sx * _u[b + 1]);
+            _vNext[i] = (1 - sy) * ((1 - sx) * _v[a] + sx * _v[a + 1]) +
+                        sy       * ((1 - sx) * _v[b] + sx * _v[b + 1]);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+// one Jacobi step of (source + a * neighbours) / (1 + 4a) along a row, the
+// neighbours outside the field are the edge cell itself
+static void jacobiRow( const float* source,
+                       const float* row,
+                       const float* up,
+                       const float* down,
+                       float* out,
+                       int width,
+                       float a,
+                       float inv )
+{
+    out[0] = (source[0] + a * (row[0] + row[1] + up[0] + down[0])) * inv;
+
+    for( int x=1; x<width-1; ++x ) {
+        out[x] = (source[x] + a * (row[x - 1] + row[x + 1] + up[x] + down[x])) * inv;
+    }
+
+    int last = width - 1;
+    out[last] = (source[last] + a * (row[last - 1] + row[last] + up[last] + down[last])) * inv;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::diffuseRows( int begin,
+                                         int end )
+{
+    float inv = 1.0f / (1 + 4 * _diffusion);
+
+    for( int y=begin; y<end; ++y ) {
+        int row = y * _width;
+        int up = MAX( y - 1, 0 ) * _width;
+        int down = MIN( y + 1, _height - 1 ) * _width;
+
+        jacobiRow( &_uSource[row], &_u[row], &_u[up], &_u[down], &_uNext[row], _width, _diffusion, inv );
+        jacobiRow( &_vSource[row], &_v[row], &_v[up], &_v[down], &_vNext[row], _width, _diffusion, inv );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::divergenceRows( int begin,
+                                            int end )
+{
+    int last = _width - 1;
+
+    for( int y=begin; y<end; ++y ) {
+        const float* u = &_u[y * _width];
+        const float* vUp = &_v[MAX( y - 1, 0 ) * _width];
+        const float* vDown = &_v[MIN( y + 1, _height - 1 ) * _width];
+        float* divergence = &_divergence[y * _width];
+
+        // negated, so the pressure solve is the same Jacobi step as diffusion
+        divergence[0] = -0.5f * (u[1] - u[0] + vDown[0] - vUp[0]);
+        for( int x=1; x<last; ++x ) {
+            divergence[x] = -0.5f * (u[x + 1] - u[x - 1] + vDown[x] - vUp[x]);
+        }
+        divergence[last] = -0.5f * (u[last] - u[last - 1] + vDown[last] - vUp[last]);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::pressureRows( int begin,
+                                          int end )
+{
+    for( int y=begin; y<end; ++y ) {
+        int row = y * _width;
+        int up = MAX( y - 1, 0 ) * _width;
+        int down = MIN( y + 1, _height - 1 ) * _width;
+
+        jacobiRow( &_divergence[row], &_pressure[row], &_pressure[up], &_pressure[down], &_pressureNext[row], _width, 1.0f, 0.25f );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexFluidSolver::gradientRows( int begin,
+                                          int end )
+{
+    int last = _width - 1;
+
+    for( int y=begin; y<end; ++y ) {
+        const float* p = &_pressure[y * _width];
+        const float* pUp = &_pressure[MAX( y - 1, 0 ) * _width];
+        const float* pDown = &_pressure[MIN( y + 1, _height - 1 ) * _width];
+        float* u = &_u[y * _width];
+        float* v = &_v[y * _width];
+
+        for( int x=1; x<last; ++x ) {
+            u[x] -= 0.5f * (p[x + 1] - p[x - 1]);
+        }
+        for( int x=0; x<_width; ++x ) {
+            v[x] -= 0.5f * (pDown[x] - pUp[x]);
+        }
+
+        // nothing flows through the walls
+        u[0] = 0;
+        u[last] = 0;
+        if( y == 0 || y == _height - 1 ) {
+            for( int x=0; x<_width; ++x ) {
+                v[x] = 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,185 @@
+//
+//  ofxLabFlexMappedFile.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexMappedFile.h"
+
+#if defined _WIN64 || defined _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexMappedFile::ofxLabFlexMappedFile() :
+_data(NULL),
+_size(0),
+#if defined _WIN64 || defined _WIN32
+_file(NULL),
+_mapping(NULL)
+#else
+_file(-1)
+#endif
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexMappedFile::~ofxLabFlexMappedFile()
+{
+    close();
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexMappedFile::open( const string& path )
+{
+    close();
+
+    string fullPath = ofToDataPath( path, true );
+
+#if defined _WIN64 || defined _WIN32
+
+    HANDLE file = CreateFileA( fullPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( file == INVALID_HANDLE_VALUE ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexMappedFile: unable to open " + fullPath );
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx( file, &size ) || size.QuadPart == 0 ) {
+        CloseHandle( file );
+        ofLog( OF_LOG_ERROR, "ofxLabFlexMappedFile: empty file " + fullPath );
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+    if( mapping == NULL ) {
+        CloseHandle( file );
+        ofLog( OF_LOG_ERROR, "ofxLabFlexMappedFile: unable to map " + fullPath );
+        return false;
+    }
+
+    void * data = MapViewOfFile( mapping, FILE_MAP_COPY, 0, 0, 0 );
+    if( data == NULL ) {
+        CloseHandle( mapping );
+        CloseHandle( file );
+        ofLog( OF_LOG_ERROR, "ofxLabFlexMappedFile: unable to map " + fullPath );
+        return false;
+    }
+
+    _file = file;
+    _mapping = mapping;
+    _data = (unsigned char *) data;
+    _size = (size_t) size.QuadPart;
+
+#else
+
+    int file = ::open( fullPath.c_str(), O_RDONLY );
+    if( file < 0 ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexMappedFile: unable to open " + fullPath );
+        return false;
+    }
+
+    struct stat info;
+    if( fstat( file, &info ) != 0 || info.st_size == 0 ) {
+        ::close( file );
+        ofLog( OF_LOG_ERROR, "ofxLabFlexMappedFile: empty file " + fullPath );
+        return false;
+    }
+
+    // private + writable gives us copy on write pages, the file is never touched
+    void * data = mmap( NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0 );
+    if( data == MAP_FAILED ) {
+        ::close( file );
+        ofLog( OF_LOG_ERROR, "ofxLabFlexMappedFile: unable to map " + fullPath );
+        return false;
+    }
+
+    _file = file;
+    _data = (unsigned char *) data;
+    _size = (size_t) info.st_size;
+
+#endif
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexMappedFile::close()
+{
+#if defined _WIN64 || defined _WIN32
+    if( _data ) {
+        UnmapViewOfFile( _data );
+    }
+    if( _mapping ) {
+        CloseHandle( (HANDLE) _mapping );
+    }
+    if( _file ) {
+        CloseHandle( (HANDLE) _file );
+    }
+    _mapping = NULL;
+    _file = NULL;
+#else
+    if( _data ) {
+        munmap( _data, _size );
+    }
+    if( _file >= 0 ) {
+        ::close( _file );
+    }
+    _file = -1;
+#endif
+
+    _data = NULL;
+    _size = 0;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexMappedFile::isOpen() const
+{
+    return _data != NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+unsigned char * ofxLabFlexMappedFile::getData() const
+{
+    return _data;
+}
+
+
+//------------------------------------------------------------------------------------
+size_t ofxLabFlexMappedFile::getSize() const
+{
+    return _size;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexMappedFile::willNeed( size_t offset,
+                                     size_t length ) const
+{
+    if( !_data || offset >= _size ) {
+        return;
+    }
+
+    length = MIN( length, _size - offset );
+
+#if defined _WIN64 || defined _WIN32
+    // PrefetchVirtualMemory is Windows 8+ only, the page faults will do the work
+#else
+    // madvise wants a page aligned start
+    size_t pageSize = (size_t) sysconf( _SC_PAGESIZE );
+    size_t start = offset - (offset % pageSize);
+    madvise( _data + start, length + (offset - start), MADV_WILLNEED );
+#endif
+}
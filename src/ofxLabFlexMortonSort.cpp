@@ -0,0 +1,133 @@
+//
+//  ofxLabFlexMortonSort.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexMortonSort.h"
+
+// grid the bounding box is quantized to, per axis
+static const float QUANTIZE_MAX = 65535.0f;
+
+
+//------------------------------------------------------------------------------------
+// spread the low 16 bits of v into the even bits
+static unsigned int spreadBits( unsigned int v )
+{
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexMortonSort::ofxLabFlexMortonSort()
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+unsigned int ofxLabFlexMortonSort::encode( unsigned int x,
+                                           unsigned int y )
+{
+    return spreadBits( x ) | (spreadBits( y ) << 1);
+}
+
+
+//------------------------------------------------------------------------------------
+const vector<unsigned int>& ofxLabFlexMortonSort::getKeys() const
+{
+    return _keys;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexMortonSort::sort( const float* x,
+                                 const float* y,
+                                 int count,
+                                 vector<int>& order )
+{
+    order.resize( count );
+    for( int i=0; i<count; ++i ) {
+        order[i] = i;
+    }
+
+    if( count < 2 ) {
+        _keys.assign( count, 0 );
+        return;
+    }
+
+    float minX = x[0];
+    float maxX = x[0];
+    float minY = y[0];
+    float maxY = y[0];
+
+    for( int i=1; i<count; ++i ) {
+        minX = MIN( minX, x[i] );
+        maxX = MAX( maxX, x[i] );
+        minY = MIN( minY, y[i] );
+        maxY = MAX( maxY, y[i] );
+    }
+
+    // same scale on both axes so the curve isn't stretched
+    float extent = MAX( maxX - minX, maxY - minY );
+    float scale = extent > 0 ? QUANTIZE_MAX / extent : 0;
+
+    _keys.resize( count );
+    for( int i=0; i<count; ++i ) {
+        unsigned int qx = (unsigned int) ofClamp( (x[i] - minX) * scale, 0, QUANTIZE_MAX );
+        unsigned int qy = (unsigned int) ofClamp( (y[i] - minY) * scale, 0, QUANTIZE_MAX );
+        _keys[i] = encode( qx, qy );
+    }
+
+    // sorted last time and hardly moved since, nothing to do
+    bool sorted = true;
+    for( int i=1; i<count; ++i ) {
+        if( _keys[i] < _keys[i - 1] ) {
+            sorted = false;
+            break;
+        }
+    }
+    if( sorted ) {
+        return;
+    }
+
+    _tempKeys.resize( count );
+    _temp.resize( count );
+
+    for( int shift=0; shift<32; shift+=8 ) {
+        int counts[257] = { 0 };
+
+        for( int i=0; i<count; ++i ) {
+            ++counts[((_keys[i] >> shift) & 0xff) + 1];
+        }
+
+        // every key has the same byte here, nothing would move
+        bool skip = false;
+        for( int b=1; b<=256; ++b ) {
+            if( counts[b] == count ) {
+                skip = true;
+                break;
+            }
+        }
+        if( skip ) {
+            continue;
+        }
+
+        for( int b=0; b<256; ++b ) {
+            counts[b + 1] += counts[b];
+        }
+
+        for( int i=0; i<count; ++i ) {
+            int slot = counts[(_keys[i] >> shift) & 0xff]++;
+            _tempKeys[slot] = _keys[i];
+            _temp[slot]     = order[i];
+        }
+
+        _keys.swap( _tempKeys );
+        order.swap( _temp );
+    }
+}
@@ -0,0 +1,136 @@
+//
+//  ofxLabFlexNeighbourList.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexNeighbourList.h"
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexNeighbourList::ofxLabFlexNeighbourList() :
+_skin(0),
+_bValid(false),
+_version(0),
+_count(0),
+_cutoff(0),
+_bRadius(false),
+_numBuilds(0)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexNeighbourList::setSkin( float skin )
+{
+    _skin = MAX( skin, 0.0f );
+    _bValid = false;
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexNeighbourList::getSkin() const
+{
+    return _skin;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexNeighbourList::update( const float* x,
+                                      const float* y,
+                                      const float* radius,
+                                      int count,
+                                      float cutoff,
+                                      unsigned int version,
+                                      ofxLabFlexThreadPool* pool )
+{
+    bool bRadius = radius != NULL;
+
+    if( _bValid &&
+        _skin > 0 &&
+        _version == version &&
+        _count == count &&
+        _cutoff == cutoff &&
+        _bRadius == bRadius &&
+        !hasMoved( x, y, radius ) ) {
+        return false;
+    }
+
+    _bValid     = true;
+    _version    = version;
+    _count      = count;
+    _cutoff     = cutoff;
+    _bRadius    = bRadius;
+    ++_numBuilds;
+
+    _refX.assign( x, x + count );
+    _refY.assign( y, y + count );
+
+    float maxRadius = 0;
+    if( bRadius ) {
+        _refRadius.assign( radius, radius + count );
+        for( int i=0; i<count; ++i ) {
+            maxRadius = MAX( maxRadius, radius[i] );
+        }
+    } else {
+        _refRadius.clear();
+    }
+
+    if( count < 2 ) {
+        _pairs.clear();
+        return true;
+    }
+
+    float range = cutoff + _skin;
+    _broadphase.build( &_refX[0], &_refY[0], count, maxRadius * 2 + range );
+    _broadphase.findPairs( bRadius ? &_refRadius[0] : NULL, range, _pairs, pool );
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexNeighbourList::invalidate()
+{
+    _bValid = false;
+}
+
+
+//------------------------------------------------------------------------------------
+const vector<ofxLabFlexNeighbourPair>& ofxLabFlexNeighbourList::getPairs() const
+{
+    return _pairs;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexNeighbourList::getNumBuilds() const
+{
+    return _numBuilds;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexNeighbourList::hasMoved( const float* x,
+                                        const float* y,
+                                        const float* radius ) const
+{
+    // a pair can only come into range once the two together have closed the
+    // skin, so each one gets half of it
+    float limit = _skin * 0.5f;
+
+    for( int i=0; i<_count; ++i ) {
+        float dx = x[i] - _refX[i];
+        float dy = y[i] - _refY[i];
+        float moved = sqrtf( dx * dx + dy * dy );
+
+        if( radius && radius[i] > _refRadius[i] ) {
+            moved += radius[i] - _refRadius[i];
+        }
+
+        if( moved > limit ) {
+            return true;
+        }
+    }
+    return false;
+}
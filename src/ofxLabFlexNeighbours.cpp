@@ -0,0 +1,254 @@
+//
+//  ofxLabFlexNeighbours.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexNeighbours.h"
+
+// pairs per range handed to a thread
+static const int KERNEL_GRAIN = 2048;
+
+// particles per range when summing the thread buffers
+static const int REDUCE_GRAIN = 4096;
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexNeighbours::ofxLabFlexNeighbours() :
+_particles(NULL),
+_pairs(NULL),
+_current(0),
+_threads(1)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexNeighbours::addKernel( const Kernel& kernel,
+                                     float cutoff )
+{
+    KernelInfo info;
+    info.func   = kernel;
+    info.cutoff = MAX( cutoff, 0.0f );
+    _kernels.push_back( info );
+
+    return _kernels.size() - 1;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexNeighbours::removeKernel( int kernel )
+{
+    if( kernel < 0 || kernel >= (int) _kernels.size() ) {
+        return;
+    }
+
+    _kernels[kernel].func = NULL;
+    _kernels[kernel].values.clear();
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexNeighbours::hasKernels() const
+{
+    for( unsigned int k=0; k<_kernels.size(); ++k ) {
+        if( _kernels[k].func ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexNeighbours::setSkin( float skin )
+{
+    _list.setSkin( skin );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexNeighbours::invalidate()
+{
+    _list.invalidate();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexNeighbours::run( const vector<ofxLabFlexParticle*>& particles,
+                                unsigned int version,
+                                ofxLabFlexThreadPool* pool )
+{
+    int count = particles.size();
+
+    float maxCutoff = 0;
+    for( unsigned int k=0; k<_kernels.size(); ++k ) {
+        if( _kernels[k].func ) {
+            maxCutoff = MAX( maxCutoff, _kernels[k].cutoff );
+            _kernels[k].values.assign( count, 0 );
+        }
+    }
+
+    if( count < 2 || maxCutoff <= 0 ) {
+        return;
+    }
+
+    _particles = &particles;
+    _x.resize( count );
+    _y.resize( count );
+
+    for( int i=0; i<count; ++i ) {
+        _x[i] = particles[i]->x;
+        _y[i] = particles[i]->y;
+    }
+
+    // one pair list for every kernel, each skips what is past its own cutoff
+    _list.update( &_x[0], &_y[0], NULL, count, maxCutoff, version, pool );
+    _pairs = &_list.getPairs();
+    int numPairs = _pairs->size();
+
+    _threads = pool ? pool->getNumThreads() + 1 : 1;
+    _accelX.assign( _threads * count, 0 );
+    _accelY.assign( _threads * count, 0 );
+    _value.assign( _threads * count, 0 );
+
+    using namespace std::tr1::placeholders;
+    ofxLabFlexThreadPool::ThreadRangeFunction pairs = std::tr1::bind( &ofxLabFlexNeighbours::runPairs, this, _1, _2, _3 );
+    ofxLabFlexThreadPool::RangeFunction sum         = std::tr1::bind( &ofxLabFlexNeighbours::reduce, this, _1, _2 );
+
+    for( _current=0; _current<(int) _kernels.size(); ++_current ) {
+        if( !_kernels[_current].func ) {
+            continue;
+        }
+
+        if( pool ) {
+            pool->parallelForThreads( numPairs, pairs, KERNEL_GRAIN );
+            pool->parallelFor( count, sum, REDUCE_GRAIN );
+        } else {
+            runPairs( 0, numPairs, 0 );
+            reduce( 0, count );
+        }
+    }
+
+    _particles = NULL;
+    _pairs = NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexNeighbours::getValue( int kernel,
+                                      int index ) const
+{
+    if( kernel < 0 || kernel >= (int) _kernels.size() ) {
+        return 0;
+    }
+
+    const vector<float>& values = _kernels[kernel].values;
+    if( index < 0 || index >= (int) values.size() ) {
+        return 0;
+    }
+    return values[index];
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexNeighbours::getNumPairs() const
+{
+    return _list.getPairs().size();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexNeighbours::runPairs( int begin,
+                                     int end,
+                                     int thread )
+{
+    const KernelInfo& kernel = _kernels[_current];
+    const vector<ofxLabFlexParticle*>& particles = *_particles;
+    const vector<ofxLabFlexNeighbourPair>& pairs = *_pairs;
+    float cutoffSq = kernel.cutoff * kernel.cutoff;
+
+    int offset = thread * particles.size();
+    float* accelX = &_accelX[offset];
+    float* accelY = &_accelY[offset];
+    float* value  = &_value[offset];
+
+    ofxLabFlexNeighbour neighbour;
+    ofxLabFlexNeighbourContribution contribution;
+
+    for( int p=begin; p<end; ++p ) {
+        int a = pairs[p].a;
+        int b = pairs[p].b;
+
+        float dx = _x[b] - _x[a];
+        float dy = _y[b] - _y[a];
+        float distanceSq = dx * dx + dy * dy;
+
+        if( distanceSq >= cutoffSq ) {
+            continue;
+        }
+
+        neighbour.distance = sqrtf( distanceSq );
+
+        // a's side
+        neighbour.self          = particles[a];
+        neighbour.other         = particles[b];
+        neighbour.selfIndex     = a;
+        neighbour.otherIndex    = b;
+        neighbour.delta.set( dx, dy );
+
+        contribution.acceleration.set( 0, 0 );
+        contribution.value = 0;
+        kernel.func( neighbour, contribution );
+
+        accelX[a]   += contribution.acceleration.x;
+        accelY[a]   += contribution.acceleration.y;
+        value[a]    += contribution.value;
+
+        // b's side
+        neighbour.self          = particles[b];
+        neighbour.other         = particles[a];
+        neighbour.selfIndex     = b;
+        neighbour.otherIndex    = a;
+        neighbour.delta.set( -dx, -dy );
+
+        contribution.acceleration.set( 0, 0 );
+        contribution.value = 0;
+        kernel.func( neighbour, contribution );
+
+        accelX[b]   += contribution.acceleration.x;
+        accelY[b]   += contribution.acceleration.y;
+        value[b]    += contribution.value;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexNeighbours::reduce( int begin,
+                                   int end )
+{
+    const vector<ofxLabFlexParticle*>& particles = *_particles;
+    vector<float>& values = _kernels[_current].values;
+    int count = particles.size();
+
+    for( int i=begin; i<end; ++i ) {
+        float ax = 0;
+        float ay = 0;
+        float v = 0;
+
+        // zeroed on the way so the buffers are ready for the next kernel
+        for( int t=0; t<_threads; ++t ) {
+            int slot = t * count + i;
+            ax += _accelX[slot];
+            ay += _accelY[slot];
+            v  += _value[slot];
+            _accelX[slot]   = 0;
+            _accelY[slot]   = 0;
+            _value[slot]    = 0;
+        }
+
+        particles[i]->acceleration.x += ax;
+        particles[i]->acceleration.y += ay;
+        values[i] = v;
+    }
+}
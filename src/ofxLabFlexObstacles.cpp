@@ -0,0 +1,353 @@
+//
+//  ofxLabFlexObstacles.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexObstacles.h"
+
+// keeps a few huge obstacles from turning into a huge grid
+static const int MAX_GRID_SIZE = 1024;
+
+
+// closest point to p on the segment a-b
+static inline ofVec2f closestOnSegment( const ofVec2f& a,
+                                        const ofVec2f& b,
+                                        const ofVec2f& p )
+{
+    ofVec2f delta = b - a;
+    float lengthSq = delta.lengthSquared();
+    if( lengthSq <= 0 ) {
+        return a;
+    }
+    float t = ofClamp( (p - a).dot( delta ) / lengthSq, 0, 1 );
+    return a + delta * t;
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexObstacles::ofxLabFlexObstacles() :
+_cellSize(1),
+_invCellSize(1),
+_cols(0),
+_rows(0),
+_bBuilt(false)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexObstacles::addCircle( const ofVec2f& center,
+                                    float radius )
+{
+    Obstacle obstacle;
+    obstacle.type       = CIRCLE;
+    obstacle.a          = center;
+    obstacle.b          = center;
+    obstacle.radius     = radius;
+    obstacle.firstPoint = 0;
+    obstacle.numPoints  = 0;
+    obstacle.bounds     = ofRectangle( center.x - radius, center.y - radius, radius * 2, radius * 2 );
+
+    return addObstacle( obstacle );
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexObstacles::addCapsule( const ofVec2f& a,
+                                     const ofVec2f& b,
+                                     float radius )
+{
+    Obstacle obstacle;
+    obstacle.type       = CAPSULE;
+    obstacle.a          = a;
+    obstacle.b          = b;
+    obstacle.radius     = radius;
+    obstacle.firstPoint = 0;
+    obstacle.numPoints  = 0;
+
+    float minX = MIN( a.x, b.x ) - radius;
+    float minY = MIN( a.y, b.y ) - radius;
+    obstacle.bounds = ofRectangle( minX, minY,
+                                   MAX( a.x, b.x ) + radius - minX,
+                                   MAX( a.y, b.y ) + radius - minY );
+
+    return addObstacle( obstacle );
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexObstacles::addPolygon( const vector<ofVec2f>& points )
+{
+    if( points.size() < 3 ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexObstacles: a polygon needs at least 3 points" );
+        return -1;
+    }
+
+    Obstacle obstacle;
+    obstacle.type       = POLYGON;
+    obstacle.radius     = 0;
+    obstacle.firstPoint = _points.size();
+    obstacle.numPoints  = points.size();
+
+    float minX = points[0].x, maxX = minX;
+    float minY = points[0].y, maxY = minY;
+    for( unsigned int i=1; i<points.size(); ++i ) {
+        minX = MIN( minX, points[i].x );
+        maxX = MAX( maxX, points[i].x );
+        minY = MIN( minY, points[i].y );
+        maxY = MAX( maxY, points[i].y );
+    }
+    obstacle.bounds = ofRectangle( minX, minY, maxX - minX, maxY - minY );
+
+    _points.insert( _points.end(), points.begin(), points.end() );
+
+    return addObstacle( obstacle );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexObstacles::clear()
+{
+    _obstacles.clear();
+    _points.clear();
+    _cellStart.clear();
+    _cellObstacles.clear();
+    _cols = _rows = 0;
+    _bBuilt = false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexObstacles::build( float cellSize )
+{
+    _bBuilt = false;
+
+    if( _obstacles.empty() ) {
+        return;
+    }
+
+    float minX = _obstacles[0].bounds.x, maxX = _obstacles[0].bounds.getMaxX();
+    float minY = _obstacles[0].bounds.y, maxY = _obstacles[0].bounds.getMaxY();
+    float averageSize = 0;
+
+    for( unsigned int i=0; i<_obstacles.size(); ++i ) {
+        const ofRectangle& bounds = _obstacles[i].bounds;
+        minX = MIN( minX, bounds.x );
+        maxX = MAX( maxX, bounds.getMaxX() );
+        minY = MIN( minY, bounds.y );
+        maxY = MAX( maxY, bounds.getMaxY() );
+        averageSize += MAX( bounds.width, bounds.height );
+    }
+    averageSize /= _obstacles.size();
+
+    _bounds = ofRectangle( minX, minY, maxX - minX, maxY - minY );
+
+    if( cellSize <= 0 ) {
+        cellSize = averageSize;
+    }
+    cellSize = MAX( cellSize, MAX( _bounds.width, _bounds.height ) / MAX_GRID_SIZE );
+    if( cellSize <= 0 ) {
+        cellSize = 1;
+    }
+
+    _cellSize       = cellSize;
+    _invCellSize    = 1.0f / cellSize;
+    _cols           = MAX( 1, (int) ceilf( _bounds.width * _invCellSize ) );
+    _rows           = MAX( 1, (int) ceilf( _bounds.height * _invCellSize ) );
+
+    int numCells = _cols * _rows;
+
+    // count, then fill, so each cell's list is contiguous
+    _cellStart.assign( numCells + 1, 0 );
+
+    for( int pass=0; pass<2; ++pass ) {
+
+        vector<int> fill;
+        if( pass == 1 ) {
+            for( int i=0; i<numCells; ++i ) {
+                _cellStart[i + 1] += _cellStart[i];
+            }
+            _cellObstacles.resize( _cellStart[numCells] );
+            fill.assign( _cellStart.begin(), _cellStart.end() - 1 );
+        }
+
+        for( unsigned int i=0; i<_obstacles.size(); ++i ) {
+            const ofRectangle& bounds = _obstacles[i].bounds;
+
+            int col0 = MAX( 0, MIN( _cols - 1, (int) floorf( (bounds.x - _bounds.x) * _invCellSize ) ) );
+            int row0 = MAX( 0, MIN( _rows - 1, (int) floorf( (bounds.y - _bounds.y) * _invCellSize ) ) );
+            int col1 = MAX( 0, MIN( _cols - 1, (int) floorf( (bounds.getMaxX() - _bounds.x) * _invCellSize ) ) );
+            int row1 = MAX( 0, MIN( _rows - 1, (int) floorf( (bounds.getMaxY() - _bounds.y) * _invCellSize ) ) );
+
+            for( int row=row0; row<=row1; ++row ) {
+                for( int col=col0; col<=col1; ++col ) {
+                    int cell = row * _cols + col;
+                    if( pass == 0 ) {
+                        ++_cellStart[cell + 1];
+                    } else {
+                        _cellObstacles[fill[cell]++] = i;
+                    }
+                }
+            }
+        }
+    }
+
+    _bBuilt = true;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexObstacles::isBuilt() const
+{
+    return _bBuilt;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexObstacles::getNumObstacles() const
+{
+    return _obstacles.size();
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexObstacles::collide( float x,
+                                  float y,
+                                  float radius,
+                                  ofVec2f& normal,
+                                  float& depth ) const
+{
+    if( !_bBuilt ) {
+        return -1;
+    }
+
+    // nowhere near any obstacle
+    if( x + radius < _bounds.x || x - radius > _bounds.getMaxX() ||
+        y + radius < _bounds.y || y - radius > _bounds.getMaxY() ) {
+        return -1;
+    }
+
+    int col0 = MAX( 0, (int) floorf( (x - radius - _bounds.x) * _invCellSize ) );
+    int row0 = MAX( 0, (int) floorf( (y - radius - _bounds.y) * _invCellSize ) );
+    int col1 = MIN( _cols - 1, (int) floorf( (x + radius - _bounds.x) * _invCellSize ) );
+    int row1 = MIN( _rows - 1, (int) floorf( (y + radius - _bounds.y) * _invCellSize ) );
+
+    int     hit = -1;
+    ofVec2f outward;
+
+    // an obstacle spanning several of these cells is tested more than once,
+    // which is cheaper than tracking what was already tested
+    for( int row=row0; row<=row1; ++row ) {
+        for( int col=col0; col<=col1; ++col ) {
+            int cell = row * _cols + col;
+
+            for( int i=_cellStart[cell]; i<_cellStart[cell + 1]; ++i ) {
+                const Obstacle& obstacle = _obstacles[_cellObstacles[i]];
+
+                if( x + radius < obstacle.bounds.x || x - radius > obstacle.bounds.getMaxX() ||
+                    y + radius < obstacle.bounds.y || y - radius > obstacle.bounds.getMaxY() ) {
+                    continue;
+                }
+
+                float overlap = radius - signedDistance( obstacle, x, y, outward );
+                if( overlap > 0 && (hit < 0 || overlap > depth) ) {
+                    hit     = _cellObstacles[i];
+                    depth   = overlap;
+                    normal  = outward;
+                }
+            }
+        }
+    }
+
+    return hit;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexObstacles::draw()
+{
+    for( unsigned int i=0; i<_obstacles.size(); ++i ) {
+        const Obstacle& obstacle = _obstacles[i];
+
+        if( obstacle.type == CIRCLE ) {
+            ofCircle( obstacle.a.x, obstacle.a.y, obstacle.radius );
+        } else if( obstacle.type == CAPSULE ) {
+            ofVec2f side = (obstacle.b - obstacle.a).getPerpendicular() * obstacle.radius;
+            ofLine( obstacle.a.x + side.x, obstacle.a.y + side.y, obstacle.b.x + side.x, obstacle.b.y + side.y );
+            ofLine( obstacle.a.x - side.x, obstacle.a.y - side.y, obstacle.b.x - side.x, obstacle.b.y - side.y );
+            ofCircle( obstacle.a.x, obstacle.a.y, obstacle.radius );
+            ofCircle( obstacle.b.x, obstacle.b.y, obstacle.radius );
+        } else {
+            const ofVec2f* points = &_points[obstacle.firstPoint];
+            for( int p=0; p<obstacle.numPoints; ++p ) {
+                const ofVec2f& next = points[(p + 1) % obstacle.numPoints];
+                ofLine( points[p].x, points[p].y, next.x, next.y );
+            }
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexObstacles::addObstacle( const Obstacle& obstacle )
+{
+    _obstacles.push_back( obstacle );
+    _bBuilt = false;
+    return _obstacles.size() - 1;
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexObstacles::signedDistance( const Obstacle& obstacle,
+                                           float x,
+                                           float y,
+                                           ofVec2f& normal ) const
+{
+    ofVec2f p( x, y );
+
+    if( obstacle.type == CIRCLE || obstacle.type == CAPSULE ) {
+        ofVec2f closest = obstacle.type == CIRCLE ? obstacle.a : closestOnSegment( obstacle.a, obstacle.b, p );
+        ofVec2f delta = p - closest;
+        float length = delta.length();
+
+        // dead center, any direction will do
+        normal = length > 0 ? delta / length : ofVec2f( 0, -1 );
+        return length - obstacle.radius;
+    }
+
+    // polygon: nearest edge for the distance, even-odd crossings for the sign
+    const ofVec2f* points = &_points[obstacle.firstPoint];
+
+    float   bestDistSq = -1;
+    ofVec2f bestPoint;
+    bool    inside = false;
+
+    for( int i=0, j=obstacle.numPoints - 1; i<obstacle.numPoints; j = i++ ) {
+        const ofVec2f& a = points[j];
+        const ofVec2f& b = points[i];
+
+        if( (a.y > y) != (b.y > y) &&
+            x < a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y) ) {
+            inside = !inside;
+        }
+
+        ofVec2f closest = closestOnSegment( a, b, p );
+        float distSq = (p - closest).lengthSquared();
+        if( bestDistSq < 0 || distSq < bestDistSq ) {
+            bestDistSq = distSq;
+            bestPoint = closest;
+        }
+    }
+
+    float distance = sqrtf( bestDistSq );
+    ofVec2f delta = p - bestPoint;
+
+    if( distance > 0 ) {
+        normal = (inside ? -delta : delta) / distance;
+    } else {
+        normal.set( 0, -1 );
+    }
+
+    return inside ? -distance : distance;
+}
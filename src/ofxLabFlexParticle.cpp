@@ -70,6 +70,11 @@ void ofxLabFlexParticle::draw(){
 
 }
 
+ofxLabFlexParticle* ofxLabFlexParticle::clone() const
+{
+    return new ofxLabFlexParticle( *this );
+}
+
 void ofxLabFlexParticle::repel(const ofxLabFlexParticle& b)
 {
     // TODO this should be explored, right now it's pretty straight forward
@@ -127,6 +132,44 @@ void ofxLabFlexParticle::setData( void * data ){
     this->data = data;
 }
 
+void ofxLabFlexParticle::getState( ofxLabFlexParticleState& state ) const
+{
+    state.uniqueID          = uniqueID;
+    state.position[0]       = x;
+    state.position[1]       = y;
+    state.position[2]       = z;
+    state.velocity[0]       = velocity.x;
+    state.velocity[1]       = velocity.y;
+    state.acceleration[0]   = acceleration.x;
+    state.acceleration[1]   = acceleration.y;
+    state.rotation[0]       = rotation.x;
+    state.rotation[1]       = rotation.y;
+    state.rotation[2]       = rotation.z;
+    state.rotateVelocity[0] = rotateVelocity.x;
+    state.rotateVelocity[1] = rotateVelocity.y;
+    state.rotateVelocity[2] = rotateVelocity.z;
+    state.radius            = radius;
+    state.damping           = damping;
+    state.mass              = mass;
+    state.startSecond       = startSecond;
+    state.age               = age;
+}
+
+void ofxLabFlexParticle::setState( const ofxLabFlexParticleState& state )
+{
+    uniqueID = (unsigned long) state.uniqueID;
+    set( state.position[0], state.position[1], state.position[2] );
+    velocity.set( state.velocity[0], state.velocity[1] );
+    acceleration.set( state.acceleration[0], state.acceleration[1] );
+    rotation.set( state.rotation[0], state.rotation[1], state.rotation[2] );
+    rotateVelocity.set( state.rotateVelocity[0], state.rotateVelocity[1], state.rotateVelocity[2] );
+    radius      = state.radius;
+    damping     = state.damping;
+    mass        = state.mass;
+    startSecond = state.startSecond;
+    age         = state.age;
+}
+
 unsigned long ofxLabFlexParticle::getUniqueID()
 {
     return uniqueID;
@@ -139,3 +182,4 @@ void ofxLabFlexParticle::setUniqueID( unsigned long id )
 
 
 
+
@@ -0,0 +1,506 @@
+//
+//  ofxLabFlexParticleStore.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexParticleStore.h"
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexParticleSchema::ofxLabFlexParticleSchema( unsigned int attributes ) :
+_attributes(attributes)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexParticleSchema::add( Attribute attribute )
+{
+    _attributes |= attribute;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexParticleSchema::addChannel( const string& name,
+                                          float value )
+{
+    _channelNames.push_back( name );
+    _channelDefaults.push_back( value );
+    return _channelNames.size() - 1;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexParticleSchema::has( Attribute attribute ) const
+{
+    return (_attributes & attribute) != 0;
+}
+
+
+//------------------------------------------------------------------------------------
+unsigned int ofxLabFlexParticleSchema::getAttributes() const
+{
+    return _attributes;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexParticleSchema::getNumChannels() const
+{
+    return _channelNames.size();
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexParticleSchema::getChannelIndex( const string& name ) const
+{
+    for( unsigned int i=0; i<_channelNames.size(); ++i ) {
+        if( _channelNames[i] == name ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+//------------------------------------------------------------------------------------
+const string& ofxLabFlexParticleSchema::getChannelName( int channel ) const
+{
+    return _channelNames[channel];
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexParticleSchema::getChannelDefault( int channel ) const
+{
+    return _channelDefaults[channel];
+}
+
+
+//------------------------------------------------------------------------------------
+size_t ofxLabFlexParticleSchema::getBytesPerParticle() const
+{
+    // position, velocity, radius
+    size_t bytes = 5 * sizeof(float);
+
+    if( has( ACCELERATION ) )   bytes += 2 * sizeof(float);
+    if( has( ROTATION ) )       bytes += 2 * sizeof(float);
+    if( has( MASS ) )           bytes += sizeof(float);
+    if( has( DAMPING ) )        bytes += sizeof(float);
+    if( has( START_SECOND ) )   bytes += sizeof(float);
+    if( has( AGE ) )            bytes += sizeof(int);
+    if( has( USER_DATA ) )      bytes += sizeof(void*);
+    if( has( UNIQUE_ID ) )      bytes += sizeof(unsigned long);
+
+    return bytes + _channelNames.size() * sizeof(float);
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexParticleStore::ofxLabFlexParticleStore() :
+_count(0),
+_nextID(0)
+{
+    setup( ofxLabFlexParticleSchema() );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexParticleStore::setup( const ofxLabFlexParticleSchema& schema )
+{
+    _schema = schema;
+    clear();
+
+    int numColumns = NUM_COLUMNS + schema.getNumChannels();
+    _columns.assign( numColumns, vector<float>() );
+    _columnUsed.assign( numColumns, true );
+    _columnDefaults.assign( numColumns, 0 );
+
+    _columnUsed[ACCELERATION_X]     = schema.has( ofxLabFlexParticleSchema::ACCELERATION );
+    _columnUsed[ACCELERATION_Y]     = schema.has( ofxLabFlexParticleSchema::ACCELERATION );
+    _columnUsed[ROTATION_Z]         = schema.has( ofxLabFlexParticleSchema::ROTATION );
+    _columnUsed[ROTATE_VELOCITY]    = schema.has( ofxLabFlexParticleSchema::ROTATION );
+    _columnUsed[MASS_VALUE]         = schema.has( ofxLabFlexParticleSchema::MASS );
+    _columnUsed[DAMPING_VALUE]      = schema.has( ofxLabFlexParticleSchema::DAMPING );
+    _columnUsed[START]              = schema.has( ofxLabFlexParticleSchema::START_SECOND );
+
+    // same defaults as ofxLabFlexParticle::setDefaults()
+    _columnDefaults[RADIUS]         = 2;
+    _columnDefaults[MASS_VALUE]     = 1;
+    _columnDefaults[DAMPING_VALUE]  = 1;
+
+    for( int c=0; c<schema.getNumChannels(); ++c ) {
+        _columnDefaults[NUM_COLUMNS + c] = schema.getChannelDefault( c );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+const ofxLabFlexParticleSchema& ofxLabFlexParticleStore::getSchema() const
+{
+    return _schema;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexParticleStore::add( float x,
+                                  float y,
+                                  float radius )
+{
+    for( unsigned int c=0; c<_columns.size(); ++c ) {
+        if( _columnUsed[c] ) {
+            _columns[c].push_back( _columnDefaults[c] );
+        }
+    }
+
+    _columns[X].back()      = x;
+    _columns[Y].back()      = y;
+    _columns[RADIUS].back() = radius;
+
+    if( _columnUsed[START] ) {
+        _columns[START].back() = ofGetElapsedTimef();
+    }
+
+    if( _schema.has( ofxLabFlexParticleSchema::AGE ) ) {
+        _age.push_back( 0 );
+    }
+    if( _schema.has( ofxLabFlexParticleSchema::USER_DATA ) ) {
+        _data.push_back( NULL );
+    }
+    if( _schema.has( ofxLabFlexParticleSchema::UNIQUE_ID ) ) {
+        _ids.push_back( _nextID++ );
+    }
+
+    return _count++;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexParticleStore::add( ofxLabFlexParticle& particle )
+{
+    ofxLabFlexParticleState state;
+    particle.getState( state );
+
+    int index = add( state.position[0], state.position[1], state.radius );
+
+    _columns[VELOCITY_X][index] = state.velocity[0];
+    _columns[VELOCITY_Y][index] = state.velocity[1];
+
+    if( _columnUsed[ACCELERATION_X] ) {
+        _columns[ACCELERATION_X][index] = state.acceleration[0];
+        _columns[ACCELERATION_Y][index] = state.acceleration[1];
+    }
+    if( _columnUsed[ROTATION_Z] ) {
+        _columns[ROTATION_Z][index]         = state.rotation[2];
+        _columns[ROTATE_VELOCITY][index]    = state.rotateVelocity[2];
+    }
+    if( _columnUsed[MASS_VALUE] ) {
+        _columns[MASS_VALUE][index] = state.mass;
+    }
+    if( _columnUsed[DAMPING_VALUE] ) {
+        _columns[DAMPING_VALUE][index] = state.damping;
+    }
+    if( _columnUsed[START] ) {
+        _columns[START][index] = state.startSecond;
+    }
+    if( _schema.has( ofxLabFlexParticleSchema::AGE ) ) {
+        _age[index] = state.age;
+    }
+    if( _schema.has( ofxLabFlexParticleSchema::USER_DATA ) ) {
+        _data[index] = particle.getData();
+    }
+
+    return index;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexParticleStore::get( int index,
+                                   ofxLabFlexParticle& particle ) const
+{
+    ofxLabFlexParticleState state;
+    particle.getState( state );
+
+    state.position[0]   = _columns[X][index];
+    state.position[1]   = _columns[Y][index];
+    state.velocity[0]   = _columns[VELOCITY_X][index];
+    state.velocity[1]   = _columns[VELOCITY_Y][index];
+    state.radius        = _columns[RADIUS][index];
+
+    if( _columnUsed[ACCELERATION_X] ) {
+        state.acceleration[0] = _columns[ACCELERATION_X][index];
+        state.acceleration[1] = _columns[ACCELERATION_Y][index];
+    }
+    if( _columnUsed[ROTATION_Z] ) {
+        state.rotation[2]       = _columns[ROTATION_Z][index];
+        state.rotateVelocity[2] = _columns[ROTATE_VELOCITY][index];
+    }
+    if( _columnUsed[MASS_VALUE] ) {
+        state.mass = _columns[MASS_VALUE][index];
+    }
+    if( _columnUsed[DAMPING_VALUE] ) {
+        state.damping = _columns[DAMPING_VALUE][index];
+    }
+    if( _columnUsed[START] ) {
+        state.startSecond = _columns[START][index];
+    }
+    if( _schema.has( ofxLabFlexParticleSchema::AGE ) ) {
+        state.age = _age[index];
+    }
+    if( _schema.has( ofxLabFlexParticleSchema::UNIQUE_ID ) ) {
+        state.uniqueID = _ids[index];
+    }
+
+    particle.setState( state );
+
+    if( _schema.has( ofxLabFlexParticleSchema::USER_DATA ) ) {
+        particle.setData( _data[index] );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexParticleStore::remove( int index )
+{
+    if( index < 0 || index >= _count ) {
+        return;
+    }
+
+    int last = _count - 1;
+
+    for( unsigned int c=0; c<_columns.size(); ++c ) {
+        if( _columnUsed[c] ) {
+            _columns[c][index] = _columns[c][last];
+            _columns[c].pop_back();
+        }
+    }
+
+    if( !_age.empty() ) {
+        _age[index] = _age[last];
+        _age.pop_back();
+    }
+    if( !_data.empty() ) {
+        _data[index] = _data[last];
+        _data.pop_back();
+    }
+    if( !_ids.empty() ) {
+        _ids[index] = _ids[last];
+        _ids.pop_back();
+    }
+
+    --_count;
+}
+
+
+//------------------------------------------------------------------------------------
+// gather values into their new order through scratch, then copy them back so
+// the array itself doesn't move
+template<class T>
+static void reorderArray( vector<T>& values,
+                          vector<T>& scratch,
+                          const vector<int>& order )
+{
+    int count = order.size();
+    scratch.resize( count );
+    for( int i=0; i<count; ++i ) {
+        scratch[i] = values[order[i]];
+    }
+    std::copy( scratch.begin(), scratch.end(), values.begin() );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexParticleStore::reorder( const vector<int>& order )
+{
+    if( (int) order.size() != _count ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexParticleStore: reorder() needs an index for every particle" );
+        return;
+    }
+
+    for( unsigned int c=0; c<_columns.size(); ++c ) {
+        if( _columnUsed[c] ) {
+            reorderArray( _columns[c], _reorderFloats, order );
+        }
+    }
+
+    if( !_age.empty() ) {
+        vector<int> scratch;
+        reorderArray( _age, scratch, order );
+    }
+    if( !_data.empty() ) {
+        vector<void*> scratch;
+        reorderArray( _data, scratch, order );
+    }
+    if( !_ids.empty() ) {
+        vector<unsigned long> scratch;
+        reorderArray( _ids, scratch, order );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexParticleStore::clear()
+{
+    for( unsigned int c=0; c<_columns.size(); ++c ) {
+        _columns[c].clear();
+    }
+    _age.clear();
+    _data.clear();
+    _ids.clear();
+
+    _count = 0;
+    _nextID = 0;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexParticleStore::reserve( int count )
+{
+    for( unsigned int c=0; c<_columns.size(); ++c ) {
+        if( _columnUsed[c] ) {
+            _columns[c].reserve( count );
+        }
+    }
+
+    if( _schema.has( ofxLabFlexParticleSchema::AGE ) ) {
+        _age.reserve( count );
+    }
+    if( _schema.has( ofxLabFlexParticleSchema::USER_DATA ) ) {
+        _data.reserve( count );
+    }
+    if( _schema.has( ofxLabFlexParticleSchema::UNIQUE_ID ) ) {
+        _ids.reserve( count );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexParticleStore::size() const
+{
+    return _count;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexParticleStore::update()
+{
+    float* x    = column( X );
+    float* y    = column( Y );
+    float* vx   = column( VELOCITY_X );
+    float* vy   = column( VELOCITY_Y );
+    float* ax   = column( ACCELERATION_X );
+    float* ay   = column( ACCELERATION_Y );
+    float* rot  = column( ROTATION_Z );
+    float* rotV = column( ROTATE_VELOCITY );
+    float* damp = column( DAMPING_VALUE );
+
+    // one attribute at a time, each loop is a straight walk over its arrays
+    if( ax ) {
+        for( int i=0; i<_count; ++i ) {
+            vx[i] += ax[i];
+            vy[i] += ay[i];
+            ax[i] = 0;
+            ay[i] = 0;
+        }
+    }
+
+    if( damp ) {
+        for( int i=0; i<_count; ++i ) {
+            vx[i] *= damp[i];
+            vy[i] *= damp[i];
+        }
+    }
+
+    if( rot ) {
+        for( int i=0; i<_count; ++i ) {
+            rot[i] += rotV[i];
+            if( damp ) {
+                rotV[i] *= damp[i];
+            }
+        }
+    }
+
+    for( int i=0; i<_count; ++i ) {
+        x[i] += vx[i];
+        y[i] += vy[i];
+    }
+
+    for( unsigned int i=0; i<_age.size(); ++i ) {
+        ++_age[i];
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+size_t ofxLabFlexParticleStore::getBytesPerParticle() const
+{
+    return _schema.getBytesPerParticle();
+}
+
+
+//------------------------------------------------------------------------------------
+size_t ofxLabFlexParticleStore::getMemoryUsed() const
+{
+    size_t bytes = 0;
+    for( unsigned int c=0; c<_columns.size(); ++c ) {
+        bytes += _columns[c].capacity() * sizeof(float);
+    }
+    bytes += _age.capacity() * sizeof(int);
+    bytes += _data.capacity() * sizeof(void*);
+    bytes += _ids.capacity() * sizeof(unsigned long);
+    return bytes;
+}
+
+
+//------------------------------------------------------------------------------------
+float* ofxLabFlexParticleStore::getX()              { return column( X ); }
+float* ofxLabFlexParticleStore::getY()              { return column( Y ); }
+float* ofxLabFlexParticleStore::getVelocityX()      { return column( VELOCITY_X ); }
+float* ofxLabFlexParticleStore::getVelocityY()      { return column( VELOCITY_Y ); }
+float* ofxLabFlexParticleStore::getRadius()         { return column( RADIUS ); }
+float* ofxLabFlexParticleStore::getAccelerationX()  { return column( ACCELERATION_X ); }
+float* ofxLabFlexParticleStore::getAccelerationY()  { return column( ACCELERATION_Y ); }
+float* ofxLabFlexParticleStore::getRotation()       { return column( ROTATION_Z ); }
+float* ofxLabFlexParticleStore::getRotateVelocity() { return column( ROTATE_VELOCITY ); }
+float* ofxLabFlexParticleStore::getMass()           { return column( MASS_VALUE ); }
+float* ofxLabFlexParticleStore::getDamping()        { return column( DAMPING_VALUE ); }
+float* ofxLabFlexParticleStore::getStartSecond()    { return column( START ); }
+
+
+//------------------------------------------------------------------------------------
+int* ofxLabFlexParticleStore::getAge()
+{
+    return _schema.has( ofxLabFlexParticleSchema::AGE ) && _count > 0 ? &_age[0] : NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+void** ofxLabFlexParticleStore::getData()
+{
+    return _schema.has( ofxLabFlexParticleSchema::USER_DATA ) && _count > 0 ? &_data[0] : NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+unsigned long* ofxLabFlexParticleStore::getUniqueID()
+{
+    return _schema.has( ofxLabFlexParticleSchema::UNIQUE_ID ) && _count > 0 ? &_ids[0] : NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+float* ofxLabFlexParticleStore::getChannel( int channel )
+{
+    if( channel < 0 || channel >= _schema.getNumChannels() ) {
+        return NULL;
+    }
+    return column( NUM_COLUMNS + channel );
+}
+
+
+//------------------------------------------------------------------------------------
+float* ofxLabFlexParticleStore::column( int c )
+{
+    return _columnUsed[c] && _count > 0 ? &_columns[c][0] : NULL;
+}
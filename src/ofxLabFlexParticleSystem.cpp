@@ -17,6 +17,52 @@ const float ofxLabFlexParticleSystem::MIN_PARTICLE_MASS        = .1;
 //  the forces within the field to make it managable.
 const float ofxLabFlexParticleSystem::VEC_FIELD_FORCE_DIVIDER  = 100;
 
+// checkpoint format version
+const unsigned int ofxLabFlexParticleSystem::STATE_VERSION      = 2;
+
+// handles, slots come in chunks of 1 << SLOT_CHUNK_BITS
+static const unsigned int SLOT_CHUNK_BITS   = 10;
+static const unsigned int SLOT_CHUNK_SIZE   = 1 << SLOT_CHUNK_BITS;
+static const unsigned int MAX_SLOT_CHUNKS   = 2048;
+
+// handle lookups read the slots while update() may be writing them, so
+// slot fields shared with readers are loaded and stored through these
+template<class T>
+static inline T loadAcquire( const T& value )
+{
+#if defined _WIN64 || defined _WIN32
+    // volatile reads acquire under MSVC
+    return *(const volatile T*) &value;
+#else
+    return __atomic_load_n( &value, __ATOMIC_ACQUIRE );
+#endif
+}
+
+template<class T>
+static inline void storeRelease( T& target,
+                                 T value )
+{
+#if defined _WIN64 || defined _WIN32
+    *(volatile T*) &target = value;
+#else
+    __atomic_store_n( &target, value, __ATOMIC_RELEASE );
+#endif
+}
+
+// particles per span handed to a forEach() function
+static const int FOREACH_CHUNK_SIZE         = 1024;
+
+// positions gathered for one call into a procedural field
+static const int FIELD_BATCH_SIZE           = 256;
+
+// neighbour lists are reused until a particle moves half of this
+const float ofxLabFlexParticleSystem::DEFAULT_NEIGHBOUR_SKIN    = 2.0f;
+const float ofxLabFlexParticleSystem::DEFAULT_LOD_CELL_PIXELS   = 2.0f;
+
+// smallest area a particle adds to a density cell, so a cell with only
+// zero radius particles still shows up
+static const float LOD_MIN_AREA = 1e-6f;
+
 
 ofxLabFlexParticleSystem::ofxLabFlexParticleSystem()
 {
@@ -29,6 +75,40 @@ ofxLabFlexParticleSystem::ofxLabFlexParticleSystem()
     }
 
 	_maxParticles = 0;
+    
+    _boundaryCallback = NULL;
+    _boundaryCallbackOverride = false;
+    
+    _obstacleCallback = NULL;
+    _obstacleCallbackOverride = false;
+    
+    _recorder = NULL;
+    _store = NULL;
+    
+    _pool = NULL;
+    _fieldSource = NULL;
+    _solverIterations = DEFAULT_SOLVER_ITERATIONS;
+    
+    _orderVersion = 0;
+    _orderBuiltVersion = 0;
+    _sortInterval = DEFAULT_SORT_INTERVAL;
+    _framesSinceSort = 0;
+    
+    _lodMinPixels = 0;
+    _lodCellPixels = DEFAULT_LOD_CELL_PIXELS;
+    _lodColor = ofColor( 0, 0, 0 );
+    _drawScale = 1;
+    _bLodActive = false;
+    
+    _pendingVelMult.set( 1, 1, 1 );
+    _pendingAccel.set( 0, 0, 0 );
+    _bPendingForces = false;
+    
+    _numSlots = 0;
+    _slots.reserve( MAX_SLOT_CHUNKS );
+    
+    _contactList.setSkin( DEFAULT_NEIGHBOUR_SKIN );
+    _neighbours.setSkin( DEFAULT_NEIGHBOUR_SKIN );
 }
 
 
@@ -51,10 +131,27 @@ void ofxLabFlexParticleSystem::setupQuad( ofVec2f& topLeft,
 {
 
     _worldType = QUAD;
-    _worldQuad.tl = topLeft;
-    _worldQuad.tr = topRight;
-    _worldQuad.bl = bottomLeft;
-    _worldQuad.br = bottomRight;
+    _worldQuad.setCorners( topLeft, topRight, bottomLeft, bottomRight );
+}
+
+void ofxLabFlexParticleSystem::setupPolygon( const ofxLabFlexPolygon& polygon )
+{
+    _worldType = POLYGON;
+    _worldPolygon = polygon;
+    
+    if( !_worldPolygon.isBuilt() ) {
+        _worldPolygon.build();
+    }
+}
+
+void ofxLabFlexParticleSystem::setupDistanceField( const ofxLabFlexDistanceField& field )
+{
+    _worldType = DISTANCE_FIELD;
+    _worldField = field;
+    
+    if( !_worldField.isBaked() ) {
+        ofLog( OF_LOG_WARNING, "ofxLabFlexParticleSystem: distance field isn't baked, particles won't hit anything" );
+    }
 }
 
 void ofxLabFlexParticleSystem::setWallCallback( std::tr1::function<void ( ofxLabFlexParticle* )> func,
@@ -66,6 +163,20 @@ void ofxLabFlexParticleSystem::setWallCallback( std::tr1::function<void ( ofxLab
     
 }
 
+void ofxLabFlexParticleSystem::setBoundaryCallback( std::tr1::function<void ( ofxLabFlexParticle*, int )> func,
+                                                    bool override )
+{
+    _boundaryCallback = func;
+    _boundaryCallbackOverride = override;
+}
+
+void ofxLabFlexParticleSystem::setObstacleCallback( std::tr1::function<void ( ofxLabFlexParticle*, int )> func,
+                                                    bool override )
+{
+    _obstacleCallback = func;
+    _obstacleCallbackOverride = override;
+}
+
 void ofxLabFlexParticleSystem::setOption(Options  option,
                                   bool enabled,
                                   float param)
@@ -77,6 +188,28 @@ void ofxLabFlexParticleSystem::setOption(Options  option,
         _options &= ~option;
     }
     
+    if( option == SOLVE_COLLISIONS ) {
+        
+        // zero param means the default iterations, and forget old contacts
+        _solverIterations = param > 0 ? (int) param : DEFAULT_SOLVER_ITERATIONS;
+        _collisionSolver.clear();
+    }
+    
+    if( option == SPATIAL_ORDER ) {
+        
+        // zero param means the default interval, and go back to uniqueID
+        // order when it is turned off
+        _sortInterval = param > 0 ? (int) param : DEFAULT_SORT_INTERVAL;
+        _framesSinceSort = 0;
+        ++_orderVersion;
+    }
+    
+    if( option == LONG_RANGE_FORCES ) {
+        
+        // zero param means the default opening angle
+        _barnesHut.setTheta( param > 0 ? param : ofxLabFlexBarnesHut::DEFAULT_THETA );
+    }
+    
     if( option == VECTOR_FIELD && enabled) {
         
         
@@ -90,27 +223,608 @@ void ofxLabFlexParticleSystem::setOption(Options  option,
     
 }
 
+bool ofxLabFlexParticleSystem::saveState( const string& path )
+{
+    vector<unsigned char> blob;
+    serializeState( blob );
+    
+    string fullPath = ofToDataPath( path, true );
+    
+    FILE* file = fopen( fullPath.c_str(), "wb" );
+    if( !file ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexParticleSystem: unable to write " + fullPath );
+        return false;
+    }
+    
+    bool ok = fwrite( &blob[0], 1, blob.size(), file ) == blob.size();
+    fclose( file );
+    
+    if( !ok ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexParticleSystem: failed writing " + fullPath );
+    }
+    return ok;
+}
+
+void ofxLabFlexParticleSystem::serializeState( vector<unsigned char>& blob )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    
+    ofxLabFlexSystemStateHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, "LFSS", 4 );
+    
+    header.version              = STATE_VERSION;
+    header.particleStateSize    = sizeof(ofxLabFlexParticleState);
+    header.numParticles         = _particles.size();
+    header.nextID               = _nextID;
+    header.options              = _options;
+    header.worldType            = _worldType;
+    header.worldBox[0]          = _worldBox.x;
+    header.worldBox[1]          = _worldBox.y;
+    header.worldQuad[0]         = _worldQuad.getTopLeft().x;
+    header.worldQuad[1]         = _worldQuad.getTopLeft().y;
+    header.worldQuad[2]         = _worldQuad.getTopRight().x;
+    header.worldQuad[3]         = _worldQuad.getTopRight().y;
+    header.worldQuad[4]         = _worldQuad.getBottomLeft().x;
+    header.worldQuad[5]         = _worldQuad.getBottomLeft().y;
+    header.worldQuad[6]         = _worldQuad.getBottomRight().x;
+    header.worldQuad[7]         = _worldQuad.getBottomRight().y;
+    header.maxParticles         = _maxParticles;
+    
+    for( int i=0; i<SUPPORTED_WALL_CALLBACKS; ++i ) {
+        header.wallCallbackOverride[i] = _wallCallbackOverride[i];
+    }
+    
+    ofxLabFlexSystemStateSettings settings;
+    memset( &settings, 0, sizeof(settings) );
+    
+    settings.solverIterations   = _solverIterations;
+    settings.sortInterval       = _sortInterval;
+    settings.framesSinceSort    = _framesSinceSort;
+    
+    _forceLock.lock();
+    settings.pendingVelMult[0]  = _pendingVelMult.x;
+    settings.pendingVelMult[1]  = _pendingVelMult.y;
+    settings.pendingVelMult[2]  = _pendingVelMult.z;
+    settings.pendingAccel[0]    = _pendingAccel.x;
+    settings.pendingAccel[1]    = _pendingAccel.y;
+    settings.pendingAccel[2]    = _pendingAccel.z;
+    settings.pendingForces      = _bPendingForces;
+    _forceLock.unlock();
+    
+    settings.theta              = _barnesHut.getTheta();
+    settings.softening          = _barnesHut.getSoftening();
+    settings.strength           = _barnesHut.getStrength();
+    settings.particlesAttract   = _barnesHut.getParticlesAttract();
+    settings.numAttractors      = _barnesHut.getNumAttractors();
+    
+    const vector<ofxLabFlexCollisionSolver::CachedContact>& contacts = _collisionSolver.getCachedContacts();
+    settings.numContacts        = contacts.size();
+    
+    size_t attractorBytes = settings.numAttractors * sizeof(ofxLabFlexAttractor);
+    size_t settingsBytes = sizeof(settings) + attractorBytes + settings.numContacts * sizeof(ofxLabFlexSystemStateContact);
+    size_t particleBytes = _particles.size() * sizeof(ofxLabFlexParticleState);
+    
+    blob.resize( sizeof(header) + settingsBytes + particleBytes );
+    
+    // the attractors are 12 bytes each, so what follows them can start at
+    // any alignment.  Everything goes in and out through memcpy
+    unsigned char* out = &blob[0];
+    memcpy( out, &header, sizeof(header) );
+    out += sizeof(header);
+    memcpy( out, &settings, sizeof(settings) );
+    out += sizeof(settings);
+    
+    for( unsigned int i=0; i<settings.numAttractors; ++i ) {
+        ofxLabFlexAttractor attractor = _barnesHut.getAttractor( i );
+        memcpy( out, &attractor, sizeof(attractor) );
+        out += sizeof(attractor);
+    }
+    
+    for( unsigned int i=0; i<settings.numContacts; ++i ) {
+        ofxLabFlexSystemStateContact contact;
+        contact.idA     = contacts[i].idA;
+        contact.idB     = contacts[i].idB;
+        contact.lambda  = contacts[i].lambda;
+        contact.padding = 0;
+        memcpy( out, &contact, sizeof(contact) );
+        out += sizeof(contact);
+    }
+    
+    Iterator it;
+    for( it = _particles.begin(); it != _particles.end(); ++it ) {
+        ofxLabFlexParticleState state;
+        it->second->getState( state );
+        memcpy( out, &state, sizeof(state) );
+        out += sizeof(state);
+    }
+    
+    _vectorField.serialize( blob );
+}
+
+const unsigned char* ofxLabFlexParticleSystem::restoreState( const unsigned char* data,
+                                                             size_t size,
+                                                             unsigned int& numParticles )
+{
+    // the sections aren't aligned in the blob, and it may not be aligned
+    // itself, so everything is copied out before it is read
+    if( size < sizeof(ofxLabFlexSystemStateHeader) ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexParticleSystem: not a particle system state" );
+        return NULL;
+    }
+    
+    ofxLabFlexSystemStateHeader headerCopy;
+    memcpy( &headerCopy, data, sizeof(headerCopy) );
+    const ofxLabFlexSystemStateHeader* header = &headerCopy;
+    
+    if( memcmp( header->magic, "LFSS", 4 ) != 0 ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexParticleSystem: not a particle system state" );
+        return NULL;
+    }
+    
+    if( header->version > STATE_VERSION || header->particleStateSize != sizeof(ofxLabFlexParticleState) ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexParticleSystem: particle system state is from another version" );
+        return NULL;
+    }
+    
+    // version 1 checkpoints have no settings, the current ones are kept
+    ofxLabFlexSystemStateSettings settingsCopy;
+    const ofxLabFlexSystemStateSettings* settings = NULL;
+    size_t settingsBytes = 0;
+    
+    if( header->version >= 2 ) {
+        if( size < sizeof(ofxLabFlexSystemStateHeader) + sizeof(ofxLabFlexSystemStateSettings) ) {
+            ofLog( OF_LOG_ERROR, "ofxLabFlexParticleSystem: particle system state is truncated" );
+            return NULL;
+        }
+        memcpy( &settingsCopy, data + sizeof(ofxLabFlexSystemStateHeader), sizeof(settingsCopy) );
+        settings = &settingsCopy;
+        settingsBytes = sizeof(ofxLabFlexSystemStateSettings) +
+                        (size_t) settings->numAttractors * sizeof(ofxLabFlexAttractor) +
+                        (size_t) settings->numContacts * sizeof(ofxLabFlexSystemStateContact);
+    }
+    
+    size_t particleOffset = sizeof(ofxLabFlexSystemStateHeader) + settingsBytes;
+    size_t particleBytes = (size_t) header->numParticles * sizeof(ofxLabFlexParticleState);
+    
+    if( size < particleOffset + particleBytes ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexParticleSystem: particle system state is truncated" );
+        return NULL;
+    }
+    
+    size_t fieldOffset = particleOffset + particleBytes;
+    if( !_vectorField.deserialize( data + fieldOffset, size - fieldOffset ) ) {
+        return NULL;
+    }
+    
+    releaseAllSlots();
+    _particles.clear();
+    _ghosts.clear();
+    ++_orderVersion;
+    
+    _nextID         = (unsigned long) header->nextID;
+    _options        = header->options;
+    _worldType      = (WorldType) header->worldType;
+    _worldBox.set( header->worldBox[0], header->worldBox[1] );
+    _worldQuad.setCorners( ofVec2f( header->worldQuad[0], header->worldQuad[1] ),
+                           ofVec2f( header->worldQuad[2], header->worldQuad[3] ),
+                           ofVec2f( header->worldQuad[4], header->worldQuad[5] ),
+                           ofVec2f( header->worldQuad[6], header->worldQuad[7] ) );
+    _maxParticles   = header->maxParticles;
+    
+    for( int i=0; i<SUPPORTED_WALL_CALLBACKS; ++i ) {
+        _wallCallbackOverride[i] = header->wallCallbackOverride[i] != 0;
+    }
+    
+    if( settings ) {
+        _solverIterations   = settings->solverIterations;
+        _sortInterval       = settings->sortInterval;
+        _framesSinceSort    = settings->framesSinceSort;
+        
+        _forceLock.lock();
+        _pendingVelMult.set( settings->pendingVelMult[0], settings->pendingVelMult[1], settings->pendingVelMult[2] );
+        _pendingAccel.set( settings->pendingAccel[0], settings->pendingAccel[1], settings->pendingAccel[2] );
+        _bPendingForces = settings->pendingForces != 0;
+        _forceLock.unlock();
+        
+        _barnesHut.setTheta( settings->theta );
+        _barnesHut.setSoftening( settings->softening );
+        _barnesHut.setStrength( settings->strength );
+        _barnesHut.setParticlesAttract( settings->particlesAttract != 0 );
+        _barnesHut.clearAttractors();
+        
+        const unsigned char* in = data + sizeof(ofxLabFlexSystemStateHeader) + sizeof(ofxLabFlexSystemStateSettings);
+        for( unsigned int i=0; i<settings->numAttractors; ++i ) {
+            ofxLabFlexAttractor attractor;
+            memcpy( &attractor, in, sizeof(attractor) );
+            in += sizeof(attractor);
+            _barnesHut.addAttractor( attractor );
+        }
+        
+        vector<ofxLabFlexCollisionSolver::CachedContact> contacts( settings->numContacts );
+        for( unsigned int i=0; i<settings->numContacts; ++i ) {
+            ofxLabFlexSystemStateContact contact;
+            memcpy( &contact, in, sizeof(contact) );
+            in += sizeof(contact);
+            contacts[i].idA     = (unsigned long) contact.idA;
+            contacts[i].idB     = (unsigned long) contact.idB;
+            contacts[i].lambda  = contact.lambda;
+        }
+        _collisionSolver.setCachedContacts( contacts );
+    }
+    
+    numParticles = header->numParticles;
+    return data + particleOffset;
+}
+
+void ofxLabFlexParticleSystem::setThreadPool( ofxLabFlexThreadPool* pool )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    _pool = pool;
+}
+
+int ofxLabFlexParticleSystem::addNeighbourKernel( const ofxLabFlexNeighbours::Kernel& kernel,
+                                                  float cutoff )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    return _neighbours.addKernel( kernel, cutoff );
+}
+
+void ofxLabFlexParticleSystem::removeNeighbourKernel( int kernel )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    _neighbours.removeKernel( kernel );
+}
+
+float ofxLabFlexParticleSystem::getNeighbourValue( int kernel,
+                                                   int index ) const
+{
+    return _neighbours.getValue( kernel, index );
+}
+
+void ofxLabFlexParticleSystem::setNeighbourSkin( float skin )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    _contactList.setSkin( skin );
+    _neighbours.setSkin( skin );
+}
+
+void ofxLabFlexParticleSystem::setLongRangeForces( float strength,
+                                                   float softening,
+                                                   bool particlesAttract )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    _barnesHut.setStrength( strength );
+    _barnesHut.setSoftening( softening );
+    _barnesHut.setParticlesAttract( particlesAttract );
+}
+
+int ofxLabFlexParticleSystem::addAttractor( const ofxLabFlexAttractor& attractor )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    return _barnesHut.addAttractor( attractor );
+}
+
+void ofxLabFlexParticleSystem::setAttractor( int index,
+                                             const ofxLabFlexAttractor& attractor )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    _barnesHut.setAttractor( index, attractor );
+}
+
+void ofxLabFlexParticleSystem::clearAttractors()
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    _barnesHut.clearAttractors();
+}
+
+void ofxLabFlexParticleSystem::buildOrder()
+{
+    if( _orderBuiltVersion == _orderVersion && _order.size() == _particles.size() ) {
+        return;
+    }
+    _orderBuiltVersion = _orderVersion;
+    
+    _order.clear();
+    _order.reserve( _particles.size() );
+    for( Iterator it = _particles.begin(); it != _particles.end(); ++it ) {
+        _order.push_back( it->second );
+    }
+    
+    // new and removed particles, sort again straight away
+    if( _options & SPATIAL_ORDER ) {
+        sortOrder();
+    }
+}
+
+void ofxLabFlexParticleSystem::sortOrder()
+{
+    int count = _order.size();
+    _sortX.resize( count );
+    _sortY.resize( count );
+    
+    for( int i=0; i<count; ++i ) {
+        _sortX[i] = _order[i]->x;
+        _sortY[i] = _order[i]->y;
+    }
+    
+    if( count > 0 ) {
+        _mortonSort.sort( &_sortX[0], &_sortY[0], count, _sortPermutation );
+    }
+    
+    _sorted.resize( count );
+    for( int i=0; i<count; ++i ) {
+        _sorted[i] = _order[_sortPermutation[i]];
+    }
+    _order.swap( _sorted );
+    
+    // indices changed, the neighbour lists have to be rebuilt
+    _framesSinceSort = 0;
+    ++_orderVersion;
+    _orderBuiltVersion = _orderVersion;
+}
+
+void ofxLabFlexParticleSystem::sortStore()
+{
+    int count = _store->size();
+    if( count < 2 ) {
+        return;
+    }
+    
+    // _order is already sorted, the scratch is free until the next sort
+    _mortonSort.sort( _store->getX(), _store->getY(), count, _sortPermutation );
+    _store->reorder( _sortPermutation );
+}
+
+void ofxLabFlexParticleSystem::updateContactList()
+{
+    int count = _order.size();
+    _contactX.resize( count );
+    _contactY.resize( count );
+    _contactRadius.resize( count );
+    
+    for( int i=0; i<count; ++i ) {
+        _contactX[i]        = _order[i]->x;
+        _contactY[i]        = _order[i]->y;
+        _contactRadius[i]   = _order[i]->radius;
+    }
+    
+    if( count == 0 ) {
+        _contactList.update( NULL, NULL, NULL, 0, 0, _orderVersion, _pool );
+        return;
+    }
+    _contactList.update( &_contactX[0], &_contactY[0], &_contactRadius[0], count, 0, _orderVersion, _pool );
+}
+
+void ofxLabFlexParticleSystem::setRecorder( ofxLabFlexRecorder* recorder )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    _recorder = recorder;
+}
+
+void ofxLabFlexParticleSystem::setParticleStore( ofxLabFlexParticleStore* store )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    _store = store;
+}
+
+ofxLabFlexParticleStore* ofxLabFlexParticleSystem::getParticleStore()
+{
+    return _store;
+}
+
 ofxLabFlexVectorField* ofxLabFlexParticleSystem::getVectorField()
 {
     return &_vectorField;
 }
 
+ofxLabFlexObstacles* ofxLabFlexParticleSystem::getObstacles()
+{
+    return &_obstacles;
+}
+
+void ofxLabFlexParticleSystem::forEach( const ParticleFunction& func,
+                                        AccessMode mode )
+{
+    using namespace std::tr1::placeholders;
+    forEachChunk( std::tr1::bind( &ofxLabFlexParticleSystem::forEachInChunk, this, _1, _2, &func ), mode );
+}
+
+void ofxLabFlexParticleSystem::forEachChunk( const ChunkFunction& func,
+                                             AccessMode mode,
+                                             int chunkSize )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    
+    buildOrder();
+    
+    if( chunkSize <= 0 ) {
+        chunkSize = FOREACH_CHUNK_SIZE;
+    }
+    
+    if( _pool ) {
+        using namespace std::tr1::placeholders;
+        _pool->parallelFor( _order.size(), std::tr1::bind( &ofxLabFlexParticleSystem::forEachChunkRange, this, _1, _2, &func ), chunkSize );
+    } else {
+        for( int begin=0; begin<(int) _order.size(); begin+=chunkSize ) {
+            forEachChunkRange( begin, MIN( begin + chunkSize, (int) _order.size() ), &func );
+        }
+    }
+    
+    // particles may have jumped anywhere
+    if( mode == READ_WRITE ) {
+        _contactList.invalidate();
+        _neighbours.invalidate();
+        _framesSinceSort = _sortInterval;
+        buildGhosts();
+    }
+}
+
+void ofxLabFlexParticleSystem::forEachInChunk( ofxLabFlexParticle* const* particles,
+                                               int count,
+                                               const ParticleFunction* func )
+{
+    for( int i=0; i<count; ++i ) {
+        (*func)( *particles[i] );
+    }
+}
+
+void ofxLabFlexParticleSystem::forEachChunkRange( int begin,
+                                                  int end,
+                                                  const ChunkFunction* func )
+{
+    if( begin < end ) {
+        (*func)( &_order[begin], end - begin );
+    }
+}
+
 ofxLabFlexParticleSystem::Container const * ofxLabFlexParticleSystem::getParticles()
 {
     return &_particles;
 }
 
-ofxLabFlexParticle* ofxLabFlexParticleSystem::getParticle( unsigned long uniqueID )
+ofxLabFlexParticle* ofxLabFlexParticleSystem::getParticle( unsigned long uniqueID )
+{
+	Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+	Iterator it;
+	it = _particles.find( uniqueID );
+	if( it != _particles.end() ) {
+		return it->second;
+	}
+	return NULL;
+}
+    
+
+ofxLabFlexParticle* ofxLabFlexParticleSystem::getParticle( const ofxLabFlexHandle& handle ) const
+{
+    ofxLabFlexParticle* particle;
+    unsigned long uniqueID;
+    return readSlot( handle, particle, uniqueID ) ? particle : NULL;
+}
+
+bool ofxLabFlexParticleSystem::readSlot( const ofxLabFlexHandle& handle,
+                                         ofxLabFlexParticle*& particle,
+                                         unsigned long& uniqueID ) const
+{
+    // chunks below _numSlots are in place before it is raised
+    if( handle.index >= loadAcquire( _numSlots ) ) {
+        return false;
+    }
+    
+    const Slot& slot = _slots[handle.index >> SLOT_CHUNK_BITS][handle.index & (SLOT_CHUNK_SIZE - 1)];
+    
+    unsigned int generation = loadAcquire( slot.generation );
+    if( generation != handle.generation ) {
+        return false;
+    }
+    
+    uniqueID = loadAcquire( slot.uniqueID );
+    particle = loadAcquire( slot.particle );
+    
+    // released while it was read, what was read may be the next particle's
+    if( loadAcquire( slot.generation ) != generation ) {
+        return false;
+    }
+    return particle != NULL;
+}
+
+ofxLabFlexHandle ofxLabFlexParticleSystem::getHandle( unsigned long uniqueID )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    
+    ofxLabFlexHandle handle;
+    
+    map<unsigned long, unsigned int>::const_iterator it = _slotIndices.find( uniqueID );
+    if( it == _slotIndices.end() ) {
+        return handle;
+    }
+    
+    // slots only change under _updateLock, no need to load carefully
+    handle.index        = it->second;
+    handle.generation   = _slots[it->second >> SLOT_CHUNK_BITS][it->second & (SLOT_CHUNK_SIZE - 1)].generation;
+    return handle;
+}
+
+bool ofxLabFlexParticleSystem::isAlive( const ofxLabFlexHandle& handle ) const
+{
+    return getParticle( handle ) != NULL;
+}
+
+bool ofxLabFlexParticleSystem::removeParticle( const ofxLabFlexHandle& handle )
+{
+    // the slot's uniqueID is this system's, the particle's own may be
+    // another system's.  uniqueIDs aren't reused, so if the particle goes
+    // before the removal gets the lock nothing else is removed
+    ofxLabFlexParticle* particle;
+    unsigned long uniqueID;
+    if( !readSlot( handle, particle, uniqueID ) ) {
+        return false;
+    }
+    return removeParticle( uniqueID );
+}
+
+void ofxLabFlexParticleSystem::acquireSlot( unsigned long uniqueID,
+                                            ofxLabFlexParticle* particle )
+{
+    unsigned int index;
+    
+    if( !_freeSlots.empty() ) {
+        index = _freeSlots.back();
+        _freeSlots.pop_back();
+    } else {
+        if( _numSlots >= MAX_SLOT_CHUNKS * SLOT_CHUNK_SIZE ) {
+            ofLog( OF_LOG_ERROR, "ofxLabFlexParticleSystem: out of particle handles" );
+            return;
+        }
+        
+        index = _numSlots;
+        if( (index & (SLOT_CHUNK_SIZE - 1)) == 0 ) {
+            
+            // generations start at 1, a default handle never matches
+            Slot empty;
+            empty.particle      = NULL;
+            empty.uniqueID      = 0;
+            empty.generation    = 1;
+            _slots.push_back( vector<Slot>( SLOT_CHUNK_SIZE, empty ) );
+        }
+        storeRelease( _numSlots, _numSlots + 1 );
+    }
+    
+    // no handle has this slot's generation yet, so readers don't look at it
+    Slot& slot = _slots[index >> SLOT_CHUNK_BITS][index & (SLOT_CHUNK_SIZE - 1)];
+    storeRelease( slot.uniqueID, uniqueID );
+    storeRelease( slot.particle, particle );
+    
+    _slotIndices[uniqueID] = index;
+}
+
+void ofxLabFlexParticleSystem::releaseSlot( unsigned long uniqueID )
+{
+    map<unsigned long, unsigned int>::iterator it = _slotIndices.find( uniqueID );
+    if( it == _slotIndices.end() ) {
+        return;
+    }
+    
+    // the generation moves on first, so old handles stop matching and a
+    // reader that saw the old one notices the change
+    Slot& slot = _slots[it->second >> SLOT_CHUNK_BITS][it->second & (SLOT_CHUNK_SIZE - 1)];
+    unsigned int generation = slot.generation + 1;
+    if( generation == 0 ) {
+        generation = 1;
+    }
+    storeRelease( slot.generation, generation );
+    storeRelease( slot.particle, (ofxLabFlexParticle*) NULL );
+    
+    _freeSlots.push_back( it->second );
+    _slotIndices.erase( it );
+}
+
+void ofxLabFlexParticleSystem::releaseAllSlots()
 {
-	Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
-	Iterator it;
-	it = _particles.find( uniqueID );
-	if( it != _particles.end() ) {
-		return it->second;
-	}
-	return NULL;
+    while( !_slotIndices.empty() ) {
+        releaseSlot( _slotIndices.begin()->first );
+    }
 }
-    
 
 void ofxLabFlexParticleSystem::applyVectorField( const ofxLabFlexVectorField& externalVectorField )
 {
@@ -126,6 +840,70 @@ void ofxLabFlexParticleSystem::applyVectorField( const ofxLabFlexVectorField& ex
     }
 }
 
+void ofxLabFlexParticleSystem::applyVectorField( const ofxLabFlexVectorFieldSequence& sequence )
+{
+    ofVec2f vecFieldForce;
+    
+    Iterator it;
+    for( it = _particles.begin(); it != _particles.end(); ++it )
+    {
+        ofxLabFlexParticle* p = it->second;
+        vecFieldForce = sequence.getForceFromPos(p->x, p->y);
+    
+        p->acceleration += vecFieldForce / MIN(p->mass, MIN_PARTICLE_MASS) / VEC_FIELD_FORCE_DIVIDER;
+    }
+}
+
+void ofxLabFlexParticleSystem::applyVectorField( const ofxLabFlexForceSource& source )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    
+    buildOrder();
+    applySource( &source );
+}
+
+void ofxLabFlexParticleSystem::setVectorFieldSource( const ofxLabFlexForceSource* source )
+{
+    Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
+    _fieldSource = source;
+}
+
+void ofxLabFlexParticleSystem::applySource( const ofxLabFlexForceSource* source )
+{
+    if( _pool ) {
+        using namespace std::tr1::placeholders;
+        _pool->parallelFor( _order.size(), std::tr1::bind( &ofxLabFlexParticleSystem::applySourceRange, this, _1, _2, source ), FIELD_BATCH_SIZE );
+    } else {
+        applySourceRange( 0, _order.size(), source );
+    }
+}
+
+void ofxLabFlexParticleSystem::applySourceRange( int begin,
+                                                 int end,
+                                                 const ofxLabFlexForceSource* source )
+{
+    float x[FIELD_BATCH_SIZE];
+    float y[FIELD_BATCH_SIZE];
+    float forceX[FIELD_BATCH_SIZE];
+    float forceY[FIELD_BATCH_SIZE];
+    
+    for( int start=begin; start<end; start+=FIELD_BATCH_SIZE ) {
+        int count = MIN( FIELD_BATCH_SIZE, end - start );
+        
+        for( int i=0; i<count; ++i ) {
+            x[i] = _order[start + i]->x;
+            y[i] = _order[start + i]->y;
+        }
+        
+        source->getForces( x, y, count, forceX, forceY );
+        
+        for( int i=0; i<count; ++i ) {
+            ofxLabFlexParticle* p = _order[start + i];
+            p->acceleration += ofVec2f( forceX[i], forceY[i] ) / MIN(p->mass, MIN_PARTICLE_MASS) / VEC_FIELD_FORCE_DIVIDER;
+        }
+    }
+}
+
 
 void ofxLabFlexParticleSystem::update()
 {
@@ -135,38 +913,80 @@ void ofxLabFlexParticleSystem::update()
     
     ofVec2f vecFieldForce;
     
-    Iterator it = _particles.begin();
-    for( it = _particles.begin(); it != _particles.end(); ++it )
+    bool hasObstacles = _obstacles.getNumObstacles() > 0;
+    if( hasObstacles && !_obstacles.isBuilt() ) {
+        _obstacles.build();
+    }
+    
+    // walk the particles in _order, spatially sorted with SPATIAL_ORDER so
+    // field lookups and neighbours land on nearby memory
+    buildOrder();
+    
+    bool sortDue = false;
+    if( _options & SPATIAL_ORDER ) {
+        if( ++_framesSinceSort >= _sortInterval ) {
+            sortOrder();
+            sortDue = true;
+        }
+    }
+    
+    // global forces from multForce() and addForce(), applied as each
+    // particle is integrated instead of a pass per call
+    _forceLock.lock();
+    bool hasForces = _bPendingForces;
+    ofVec3f velMult = _pendingVelMult;
+    ofVec3f accel = _pendingAccel;
+    _pendingVelMult.set( 1, 1, 1 );
+    _pendingAccel.set( 0, 0, 0 );
+    _bPendingForces = false;
+    _forceLock.unlock();
+    
+    for( unsigned int i=0; i<_order.size(); ++i )
     {
-        ofxLabFlexParticle* p = it->second;
-        p->update();
+        ofxLabFlexParticle* p = _order[i];
         
-        if ( _options & DETECT_COLLISIONS ){
-            
-            // check collision
-            Iterator inner_it = it;
-            for(++inner_it; inner_it != _particles.end(); ++inner_it )
-            {
-                
-                ofxLabFlexParticle* inner_p = inner_it->second;
-                
-                //if( (*it)->distance(*(*inner_it)) <= (*it)->radius + (*inner_it)->radius ) {
-                //    //cout << "collision!" << endl;
-                //
-                //}
-                 
-                p->repel( *inner_p );
-                inner_p->repel( *p );
-
-            }
+        if( hasForces ) {
+            p->velocity *= velMult;
+            p->acceleration += accel;
         }
         
-        if( _options & VECTOR_FIELD ) {
+        p->update();
+        
+        if( (_options & VECTOR_FIELD) && !_fieldSource ) {
             vecFieldForce = _vectorField.getForceFromPos(p->x, p->y);
             
             p->acceleration += vecFieldForce / MIN(p->mass, MIN_PARTICLE_MASS) / VEC_FIELD_FORCE_DIVIDER;
         }
         
+        // obstacles, only the ones in the grid cells the particle overlaps
+        if( hasObstacles ) {
+            ofVec2f normal;
+            float depth;
+            int obstacle = _obstacles.collide( p->x, p->y, p->radius, normal, depth );
+            
+            if( obstacle >= 0 ) {
+                if( _obstacleCallback && _obstacleCallbackOverride ) {
+                    
+                    _obstacleCallback(p, obstacle);
+                    
+                } else {
+                    
+                    // push it out and bounce it if it is still heading in
+                    p->x += normal.x * depth;
+                    p->y += normal.y * depth;
+                    
+                    float inward = p->velocity.dot( normal );
+                    if( inward < 0 ) {
+                        p->velocity -= normal * (2 * inward);
+                    }
+                    
+                    if( _obstacleCallback ) {
+                        _obstacleCallback(p, obstacle);
+                    }
+                }
+            }
+        }
+        
         
         // if we are an open world don't do any edge detection
         if( _worldType == OPEN ) {
@@ -196,10 +1016,14 @@ void ofxLabFlexParticleSystem::update()
             
             // top wall
             if( p->y <= 0 ) {
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), TOP_WALL );
+                }
+                
                 // if callback and override, only call callback
                 if( _wallCallbacks[TOP_WALL] && _wallCallbackOverride[TOP_WALL] ) {
                 
-                    _wallCallbacks[TOP_WALL](it->second);
+                    _wallCallbacks[TOP_WALL](p);
 
                 } else {
                     // otherwise do our internal logic, and hit the callback if one exists
@@ -213,16 +1037,20 @@ void ofxLabFlexParticleSystem::update()
                     }
                     
                     if( _wallCallbacks[TOP_WALL] ) {
-                        _wallCallbacks[TOP_WALL](it->second);
+                        _wallCallbacks[TOP_WALL](p);
                     }
                 }
             }
             
             // right wall
             if( p->x - p->radius >= _worldBox.x ) {
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), RIGHT_WALL );
+                }
+                
                 if( _wallCallbacks[RIGHT_WALL] && _wallCallbackOverride[RIGHT_WALL] ) {
            
-                    _wallCallbacks[RIGHT_WALL](it->second);
+                    _wallCallbacks[RIGHT_WALL](p);
             
                 } else {
                     
@@ -235,16 +1063,20 @@ void ofxLabFlexParticleSystem::update()
                     }
                     
                     if( _wallCallbacks[RIGHT_WALL] ) {
-                        _wallCallbacks[RIGHT_WALL](it->second);
+                        _wallCallbacks[RIGHT_WALL](p);
                     }
                 }
             }
             
             // bottom wall
             if( p->y >= _worldBox.y ) {
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), BOTTOM_WALL );
+                }
+                
                 if( _wallCallbacks[BOTTOM_WALL] && _wallCallbackOverride[BOTTOM_WALL] ) {
              
-                    _wallCallbacks[BOTTOM_WALL](it->second);
+                    _wallCallbacks[BOTTOM_WALL](p);
              
                 } else {
                     
@@ -256,128 +1088,447 @@ void ofxLabFlexParticleSystem::update()
                     }
                     
                     if( _wallCallbacks[BOTTOM_WALL] ) {
-                        _wallCallbacks[BOTTOM_WALL](it->second);
+                        _wallCallbacks[BOTTOM_WALL](p);
                     }
                 }
             }
             
             // left wall
             if( p->x + p->radius <= 0 ) {
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), LEFT_WALL );
+                }
+                
                 if( _wallCallbacks[LEFT_WALL] && _wallCallbackOverride[LEFT_WALL] ) {
               
-                    _wallCallbacks[LEFT_WALL](it->second);
+                    _wallCallbacks[LEFT_WALL](p);
+            
+                } else {
+                    
+                    if( _options & HORIZONTAL_WRAP ) {
+                        p->x += p->velocity.x + _worldBox.x;
+                        p->x = _worldBox.x;
+                    } else {
+                        p->velocity.x = (p->velocity.x < 0 ? p->velocity.x * -1 : p->velocity.x);
+                        p->x += p->velocity.x;
+                    }
+                    
+                    if( _wallCallbacks[LEFT_WALL] ) {
+                        _wallCallbacks[LEFT_WALL](p);
+                    }
+                }
+            
+            }
+        } else if ( _worldType == QUAD ){
+            
+            
+            // top wall
+            if( _worldQuad.checkTopBounds( p->x, p->y ) ) {
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), TOP_WALL );
+                }
+                
+                // if callback and override, only call callback
+                if( _wallCallbacks[TOP_WALL] && _wallCallbackOverride[TOP_WALL] ) {
+                    
+                    _wallCallbacks[TOP_WALL](p);
+                    
+                } else {
+                    // otherwise do our internal logic, and hit the callback if one exists
+                    
+                    if( _options & VERTICAL_WRAP ) {
+                        p->y += p->velocity.y + _worldBox.y;
+                    } else {
+                        // put it in the right direction
+                        p->velocity.y = (p->velocity.y < 0 ? p->velocity.y * -1 : p->velocity.y);
+                        p->y += p->velocity.y;
+                    }
+                    
+                    if( _wallCallbacks[TOP_WALL] ) {
+                        _wallCallbacks[TOP_WALL](p);
+                    }
+                }
+            }
+            
+            // right wall
+            if ( _worldQuad.checkRightBounds( p->x - p->radius, p->y ) && p->velocity.x > 0){
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), RIGHT_WALL );
+                }
+                
+            //if( p->x - p->radius >= _worldBox.x ) {
+                if( _wallCallbacks[RIGHT_WALL] && _wallCallbackOverride[RIGHT_WALL] ) {
+                    
+                    _wallCallbacks[RIGHT_WALL](p);
+                    
+                } else {
+                    
+                    if( _options & HORIZONTAL_WRAP ) {
+                        p->x = _worldQuad.getLeftX( p->y ) - p->radius;
+                    } else {
+                        p->velocity.x = (p->velocity.x > 0 ? p->velocity.x * -1 : p->velocity.x);
+                        p->x += p->velocity.x;
+                    }
+                    
+                    if( _wallCallbacks[RIGHT_WALL] ) {
+                        _wallCallbacks[RIGHT_WALL](p);
+                    }
+                }
+            }
+            
+            // bottom wall
+            if ( _worldQuad.checkBottomBounds( p->x, p->y ) ){
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), BOTTOM_WALL );
+                }
+                
+                if( _wallCallbacks[BOTTOM_WALL] && _wallCallbackOverride[BOTTOM_WALL] ) {
+                    
+                    _wallCallbacks[BOTTOM_WALL](p);
+                    
+                } else {
+                    
+                    if( _options & VERTICAL_WRAP ) {
+                        p->y += p->velocity.y - _worldBox.y;
+                    } else {
+                        p->velocity.y = (p->velocity.y > 0 ? p->velocity.y * -1 : p->velocity.y);
+                        p->y += p->velocity.y;
+                    }
+                    
+                    if( _wallCallbacks[BOTTOM_WALL] ) {
+                        _wallCallbacks[BOTTOM_WALL](p);
+                    }
+                }
+            }
+            
+            // left wall
+            if ( _worldQuad.checkLeftBounds( p->x + p->radius, p->y ) && p->velocity.x < 0 ){
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), LEFT_WALL );
+                }
+                
+                if( _wallCallbacks[LEFT_WALL] && _wallCallbackOverride[LEFT_WALL] ) {
+                    
+                    _wallCallbacks[LEFT_WALL](p);
+                    
+                } else {
+                    
+                    if( _options & HORIZONTAL_WRAP ) {
+                        p->x = p->radius + _worldQuad.getRightX( p->y );
+                    } else {
+                        p->velocity.x = (p->velocity.x < 0 ? p->velocity.x * -1 : p->velocity.x);
+                        p->x += p->velocity.x;
+                    }
+                    
+                    if( _wallCallbacks[LEFT_WALL] ) {
+                        _wallCallbacks[LEFT_WALL](p);
+                    }
+                }
+                
+            }
+        } else if ( _worldType == POLYGON ){
+            
+            // only the edges in the particle's grid cell are tested
+            if( !_worldPolygon.inside( p->x, p->y ) ) {
+                
+                ofVec2f closest;
+                int edge = _worldPolygon.findNearestEdge( p->x, p->y, closest );
+                if( edge < 0 ) {
+                    continue;
+                }
+                
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), edge );
+                }
+                
+                if( _boundaryCallback && _boundaryCallbackOverride ) {
+                    
+                    _boundaryCallback(p, edge);
+                    
+                } else {
+                    
+                    // mirror the particle back across the edge and reflect its
+                    // velocity if it is still heading out
+                    const ofVec2f& normal = _worldPolygon.getEdge( edge ).normal;
+                    
+                    float depth = (p->x - closest.x) * normal.x + (p->y - closest.y) * normal.y;
+                    if( depth > 0 ) {
+                        p->x -= 2 * depth * normal.x;
+                        p->y -= 2 * depth * normal.y;
+                    }
+                    
+                    float outward = p->velocity.dot( normal );
+                    if( outward > 0 ) {
+                        p->velocity -= normal * (2 * outward);
+                    }
+                    
+                    if( _boundaryCallback ) {
+                        _boundaryCallback(p, edge);
+                    }
+                }
+            }
+        } else if ( _worldType == DISTANCE_FIELD ){
+            
+            // one lookup gives containment, depth and the way back in
+            ofVec2f normal;
+            float distance = _worldField.sample( p->x, p->y, normal );
+            
+            if( distance < p->radius ) {
+                if( _recorder ) {
+                    _recorder->addWallEvent( p->getUniqueID(), -1 );
+                }
+                
+                if( _boundaryCallback && _boundaryCallbackOverride ) {
+                    
+                    _boundaryCallback(p, -1);
+                    
+                } else {
+                    
+                    normal.normalize();
+                    
+                    float depth = p->radius - distance;
+                    p->x += normal.x * depth;
+                    p->y += normal.y * depth;
+                    
+                    float inward = p->velocity.dot( normal );
+                    if( inward < 0 ) {
+                        p->velocity -= normal * (2 * inward);
+                    }
+                    
+                    if( _boundaryCallback ) {
+                        _boundaryCallback(p, -1);
+                    }
+                }
+            }
+        }
+    }
+    
+    if( _store ) {
+        updateStore( hasForces, velMult, accel, hasObstacles, sortDue );
+    }
+    
+    // separate overlapping particles once everything has moved
+    bool hasKernels = _neighbours.hasKernels();
+    
+    // touching particles push each other, only pairs from the neighbour list
+    // can be touching
+    if ( _options & DETECT_COLLISIONS ){
+        updateContactList();
+        
+        const vector<ofxLabFlexNeighbourPair>& pairs = _contactList.getPairs();
+        for( unsigned int i=0; i<pairs.size(); ++i ) {
+            ofxLabFlexParticle* p = _order[pairs[i].a];
+            ofxLabFlexParticle* inner_p = _order[pairs[i].b];
+            
+            p->repel( *inner_p );
+            inner_p->repel( *p );
+        }
+    }
+    
+    if( _options & SOLVE_COLLISIONS ) {
+        updateContactList();
+        _collisionSolver.solve( _order, _contactList.getPairs(), _solverIterations, MIN_PARTICLE_MASS, _pool );
+    }
+    
+    // pair forces from where the particles ended up, applied next update()
+    if( hasKernels ) {
+        _neighbours.run( _order, _orderVersion, _pool );
+    }
+    
+    // long range pulls, also applied next update()
+    if( _options & LONG_RANGE_FORCES ) {
+        _barnesHut.apply( _order, _pool );
+    }
+    
+    // a procedural field is worked out in batches once the particles have
+    // moved, instead of one lookup each in the loop above
+    if( (_options & VECTOR_FIELD) && _fieldSource ) {
+        applySource( _fieldSource );
+    }
+    
+    // wrapped copies for draw(), from where the particles ended up
+    buildGhosts();
+    
+    // the recorder wants uniqueID order
+    if( _recorder ) {
+        for( Iterator it = _particles.begin(); it != _particles.end(); ++it ) {
+            _recorder->addParticle( *it->second );
+        }
+        _recorder->endFrame();
+    }
+    
+    //cout << "end update" << endl;
+}
+
+void ofxLabFlexParticleSystem::updateStore( bool hasForces,
+                                            const ofVec3f& velMult,
+                                            const ofVec3f& accel,
+                                            bool hasObstacles,
+                                            bool sort )
+{
+    int count = _store->size();
+    if( count == 0 ) {
+        return;
+    }
+    
+    // the arrays stay put, so the pointers below are still good after
+    if( sort ) {
+        sortStore();
+    }
+    
+    float* x = _store->getX();
+    float* y = _store->getY();
+    float* vx = _store->getVelocityX();
+    float* vy = _store->getVelocityY();
+    float* radius = _store->getRadius();
+    float* mass = _store->getMass();
+    
+    // without an acceleration, forces go straight into the velocity
+    float* forceX = _store->getAccelerationX() ? _store->getAccelerationX() : vx;
+    float* forceY = _store->getAccelerationY() ? _store->getAccelerationY() : vy;
+    
+    if( hasForces ) {
+        for( int i=0; i<count; ++i ) {
+            vx[i] *= velMult.x;
+            vy[i] *= velMult.y;
+            forceX[i] += accel.x;
+            forceY[i] += accel.y;
+        }
+    }
+    
+    _store->update();
+    
+    if( _options & VECTOR_FIELD ) {
+        float fieldX[FIELD_BATCH_SIZE];
+        float fieldY[FIELD_BATCH_SIZE];
+        
+        for( int start=0; start<count; start+=FIELD_BATCH_SIZE ) {
+            int batch = MIN( FIELD_BATCH_SIZE, count - start );
             
-                } else {
-                    
-                    if( _options & HORIZONTAL_WRAP ) {
-                        p->x += p->velocity.x + _worldBox.x;
-                        p->x = _worldBox.x;
-                    } else {
-                        p->velocity.x = (p->velocity.x < 0 ? p->velocity.x * -1 : p->velocity.x);
-                        p->x += p->velocity.x;
-                    }
-                    
-                    if( _wallCallbacks[LEFT_WALL] ) {
-                        _wallCallbacks[LEFT_WALL](it->second);
-                    }
+            if( _fieldSource ) {
+                _fieldSource->getForces( x + start, y + start, batch, fieldX, fieldY );
+            } else {
+                for( int i=0; i<batch; ++i ) {
+                    ofVec2f force = _vectorField.getForceFromPos( x[start + i], y[start + i] );
+                    fieldX[i] = force.x;
+                    fieldY[i] = force.y;
                 }
+            }
             
+            for( int i=0; i<batch; ++i ) {
+                float scale = 1.0f / MIN( mass ? mass[start + i] : 1, MIN_PARTICLE_MASS ) / VEC_FIELD_FORCE_DIVIDER;
+                forceX[start + i] += fieldX[i] * scale;
+                forceY[start + i] += fieldY[i] * scale;
             }
-        } else if ( _worldType == QUAD ){
+        }
+    }
+    
+    for( int i=0; i<count; ++i ) {
+        
+        // push out of obstacles and bounce, the same as the particles
+        if( hasObstacles ) {
+            ofVec2f normal;
+            float depth;
+            if( _obstacles.collide( x[i], y[i], radius[i], normal, depth ) >= 0 ) {
+                x[i] += normal.x * depth;
+                y[i] += normal.y * depth;
+                
+                float inward = vx[i] * normal.x + vy[i] * normal.y;
+                if( inward < 0 ) {
+                    vx[i] -= normal.x * (2 * inward);
+                    vy[i] -= normal.y * (2 * inward);
+                }
+            }
+        }
+        
+        if ( _worldType == SQUARE || _worldType == QUAD ){
             
+            bool square = _worldType == SQUARE;
             
             // top wall
-            if( _worldQuad.checkTopBounds(*p) ) {
-                // if callback and override, only call callback
-                if( _wallCallbacks[TOP_WALL] && _wallCallbackOverride[TOP_WALL] ) {
-                    
-                    _wallCallbacks[TOP_WALL](it->second);
-                    
+            if( square ? y[i] <= 0 : _worldQuad.checkTopBounds( x[i], y[i] ) ) {
+                if( _options & VERTICAL_WRAP ) {
+                    y[i] += vy[i] + _worldBox.y;
                 } else {
-                    // otherwise do our internal logic, and hit the callback if one exists
-                    
-                    if( _options & VERTICAL_WRAP ) {
-                        p->y += p->velocity.y + _worldBox.y;
-                    } else {
-                        // put it in the right direction
-                        p->velocity.y = (p->velocity.y < 0 ? p->velocity.y * -1 : p->velocity.y);
-                        p->y += p->velocity.y;
-                    }
-                    
-                    if( _wallCallbacks[TOP_WALL] ) {
-                        _wallCallbacks[TOP_WALL](it->second);
-                    }
+                    vy[i] = fabsf( vy[i] );
+                    y[i] += vy[i];
                 }
             }
             
             // right wall
-            if ( _worldQuad.checkRightBounds(ofVec2f(p->x - p->radius, p->y)) && p->velocity.x > 0){
-            //if( p->x - p->radius >= _worldBox.x ) {
-                if( _wallCallbacks[RIGHT_WALL] && _wallCallbackOverride[RIGHT_WALL] ) {
-                    
-                    _wallCallbacks[RIGHT_WALL](it->second);
-                    
+            if( square ? x[i] - radius[i] >= _worldBox.x : _worldQuad.checkRightBounds( x[i] - radius[i], y[i] ) && vx[i] > 0 ) {
+                if( _options & HORIZONTAL_WRAP ) {
+                    x[i] = square ? 0 : _worldQuad.getLeftX( y[i] ) - radius[i];
                 } else {
-                    
-                    if( _options & HORIZONTAL_WRAP ) {
-                        p->x = ofLerp(_worldQuad.tl.x, _worldQuad.bl.x, p->y/(_worldQuad.tl.y-_worldQuad.bl.y)) - p->radius;
-                    } else {
-                        p->velocity.x = (p->velocity.x > 0 ? p->velocity.x * -1 : p->velocity.x);
-                        p->x += p->velocity.x;
-                    }
-                    
-                    if( _wallCallbacks[RIGHT_WALL] ) {
-                        _wallCallbacks[RIGHT_WALL](it->second);
-                    }
+                    vx[i] = -fabsf( vx[i] );
+                    x[i] += vx[i];
                 }
             }
             
             // bottom wall
-            if ( _worldQuad.checkBottomBounds(*p) ){
-                if( _wallCallbacks[BOTTOM_WALL] && _wallCallbackOverride[BOTTOM_WALL] ) {
-                    
-                    _wallCallbacks[BOTTOM_WALL](it->second);
-                    
+            if( square ? y[i] >= _worldBox.y : _worldQuad.checkBottomBounds( x[i], y[i] ) ) {
+                if( _options & VERTICAL_WRAP ) {
+                    y[i] += vy[i] - _worldBox.y;
                 } else {
-                    
-                    if( _options & VERTICAL_WRAP ) {
-                        p->y += p->velocity.y - _worldBox.y;
-                    } else {
-                        p->velocity.y = (p->velocity.y > 0 ? p->velocity.y * -1 : p->velocity.y);
-                        p->y += p->velocity.y;
-                    }
-                    
-                    if( _wallCallbacks[BOTTOM_WALL] ) {
-                        _wallCallbacks[BOTTOM_WALL](it->second);
-                    }
+                    vy[i] = -fabsf( vy[i] );
+                    y[i] += vy[i];
                 }
             }
             
             // left wall
-            if ( _worldQuad.checkLeftBounds(ofVec2f(p->x + p->radius, p->y)) && p->velocity.x < 0 ){
-                if( _wallCallbacks[LEFT_WALL] && _wallCallbackOverride[LEFT_WALL] ) {
-                    
-                    _wallCallbacks[LEFT_WALL](it->second);
-                    
+            if( square ? x[i] + radius[i] <= 0 : _worldQuad.checkLeftBounds( x[i] + radius[i], y[i] ) && vx[i] < 0 ) {
+                if( _options & HORIZONTAL_WRAP ) {
+                    x[i] = square ? _worldBox.x : radius[i] + _worldQuad.getRightX( y[i] );
                 } else {
-                    
-                    if( _options & HORIZONTAL_WRAP ) {
-                        p->x = p-> radius + ofLerp(_worldQuad.tr.x, _worldQuad.br.x, fabs(p->y/(_worldQuad.tl.y-_worldQuad.bl.y)));
-                    } else {
-                        p->velocity.x = (p->velocity.x < 0 ? p->velocity.x * -1 : p->velocity.x);
-                        p->x += p->velocity.x;
-                    }
-                    
-                    if( _wallCallbacks[LEFT_WALL] ) {
-                        _wallCallbacks[LEFT_WALL](it->second);
-                    }
+                    vx[i] = fabsf( vx[i] );
+                    x[i] += vx[i];
+                }
+            }
+            
+        } else if ( _worldType == POLYGON ){
+            
+            if( !_worldPolygon.inside( x[i], y[i] ) ) {
+                ofVec2f closest;
+                int edge = _worldPolygon.findNearestEdge( x[i], y[i], closest );
+                if( edge < 0 ) {
+                    continue;
+                }
+                
+                const ofVec2f& normal = _worldPolygon.getEdge( edge ).normal;
+                
+                float depth = (x[i] - closest.x) * normal.x + (y[i] - closest.y) * normal.y;
+                if( depth > 0 ) {
+                    x[i] -= 2 * depth * normal.x;
+                    y[i] -= 2 * depth * normal.y;
+                }
+                
+                float outward = vx[i] * normal.x + vy[i] * normal.y;
+                if( outward > 0 ) {
+                    vx[i] -= normal.x * (2 * outward);
+                    vy[i] -= normal.y * (2 * outward);
                 }
+            }
+            
+        } else if ( _worldType == DISTANCE_FIELD ){
+            
+            ofVec2f normal;
+            float distance = _worldField.sample( x[i], y[i], normal );
+            
+            if( distance < radius[i] ) {
+                normal.normalize();
                 
+                float depth = radius[i] - distance;
+                x[i] += normal.x * depth;
+                y[i] += normal.y * depth;
+                
+                float inward = vx[i] * normal.x + vy[i] * normal.y;
+                if( inward < 0 ) {
+                    vx[i] -= normal.x * (2 * inward);
+                    vy[i] -= normal.y * (2 * inward);
+                }
             }
         }
     }
-    
-    //cout << "end update" << endl;
 }
 
 /*
@@ -413,112 +1564,385 @@ void ofxLabFlexParticleSystem::draw()
 }
  */
 
-bool ofxLabFlexParticleSystem::shouldDraw( ofxLabFlexParticle* p, 
-                                    const ofRectangle& ws,
-                                    float rotation)
+void ofxLabFlexParticleSystem::setDensityLOD( float minPixels,
+                                              float cellPixels,
+                                              const ofColor& color )
 {
-	//return true;
+    _lodMinPixels = minPixels;
+    _lodCellPixels = MAX( cellPixels, 1 );
+    _lodColor = color;
+}
+
+void ofxLabFlexParticleSystem::setDrawScale( float pixelsPerUnit )
+{
+    _drawScale = pixelsPerUnit;
+}
+
+void ofxLabFlexParticleSystem::buildGhosts()
+{
+    _ghosts.clear();
+    
+    if( _worldType != SQUARE || !(_options & (HORIZONTAL_WRAP | VERTICAL_WRAP)) ) {
+        return;
+    }
+    
+    for( unsigned int i=0; i<_order.size(); ++i ) {
+        ofxLabFlexParticle* p = _order[i];
+        float offsetX;
+        float offsetY;
+        getWrapOffsets( p->x, p->y, p->radius, offsetX, offsetY );
+        
+        Ghost ghost;
+        ghost.particle = p;
+        
+        if( offsetX != 0 ) {
+            ghost.offsetX = offsetX;
+            ghost.offsetY = 0;
+            _ghosts.push_back( ghost );
+        }
+        if( offsetY != 0 ) {
+            ghost.offsetX = 0;
+            ghost.offsetY = offsetY;
+            _ghosts.push_back( ghost );
+        }
+        
+        // in a corner it shows in the opposite one too
+        if( offsetX != 0 && offsetY != 0 ) {
+            ghost.offsetX = offsetX;
+            ghost.offsetY = offsetY;
+            _ghosts.push_back( ghost );
+        }
+    }
+}
+
+void ofxLabFlexParticleSystem::removeGhosts( const ofxLabFlexParticle* particle )
+{
+    unsigned int kept = 0;
+    for( unsigned int i=0; i<_ghosts.size(); ++i ) {
+        if( _ghosts[i].particle != particle ) {
+            _ghosts[kept++] = _ghosts[i];
+        }
+    }
+    _ghosts.resize( kept );
+}
 
-    //particle rotated
-    ofVec2f pr(p->x, p->y);
- 
-    pr.rotate( -rotation,
-               ws.getCenter() );
+void ofxLabFlexParticleSystem::getWrapOffsets( float x,
+                                               float y,
+                                               float radius,
+                                               float& offsetX,
+                                               float& offsetY ) const
+{
+    offsetX = 0;
+    offsetY = 0;
     
+    // straddling the right edge shows on the left and so on
+    if( _options & HORIZONTAL_WRAP ) {
+        if( x + radius > _worldBox.x ) {
+            offsetX = -_worldBox.x;
+        } else if( x - radius < 0 ) {
+            offsetX = _worldBox.x;
+        }
+    }
     
+    if( _options & VERTICAL_WRAP ) {
+        if( y + radius > _worldBox.y ) {
+            offsetY = -_worldBox.y;
+        } else if( y - radius < 0 ) {
+            offsetY = _worldBox.y;
+        }
+    }
+}
+
+bool ofxLabFlexParticleSystem::isInStencil( float x,
+                                            float y,
+                                            float radius,
+                                            const ofRectangle& ws ) const
+{
     // TODO figure out how to not increase this buffer by 2x and still not lose corners
     // on hard rotations
     
-	if( p->x + p->radius >= ws.getMinX() - ws.getWidth() &&
-        p->x - p->radius <= ws.getMaxX() + ws.getWidth() &&
-        p->y + p->radius >= ws.getMinY() - ws.getHeight() &&
-        p->y - p->radius <= ws.getMaxY() + ws.getHeight() )
-    {
-        return true;
+    return x + radius >= ws.getMinX() - ws.getWidth() &&
+           x - radius <= ws.getMaxX() + ws.getWidth() &&
+           y + radius >= ws.getMinY() - ws.getHeight() &&
+           y - radius <= ws.getMaxY() + ws.getHeight();
+}
+
+void ofxLabFlexParticleSystem::drawParticle( ofxLabFlexParticle* p,
+                                             const ofRectangle& ws,
+                                             float offsetX,
+                                             float offsetY )
+{
+    float x = p->x + offsetX;
+    float y = p->y + offsetY;
+    
+    if( !isInStencil( x, y, p->radius, ws ) ) {
+        return;
+    }
+    
+    if( !_bLodActive || p->radius * _drawScale >= _lodMinPixels ) {
+        if( offsetX != 0 || offsetY != 0 ) {
+            ofPushMatrix();
+            ofTranslate( offsetX, offsetY );
+            p->draw();
+            ofPopMatrix();
+        } else {
+            p->draw();
+        }
+        return;
     }
     
-    return false;
+    // too small to see on its own
+    binParticle( x, y, p->radius );
 }
 
-void ofxLabFlexParticleSystem::draw( const ofRectangle& ws,
-                              float rotation )
+void ofxLabFlexParticleSystem::drawParticleWrapped( ofxLabFlexParticle* p,
+                                                    const ofRectangle& ws )
+{
+    drawParticle( p, ws );
+    
+    if( _worldType != SQUARE || !(_options & (HORIZONTAL_WRAP | VERTICAL_WRAP)) ) {
+        return;
+    }
+    
+    float offsetX;
+    float offsetY;
+    getWrapOffsets( p->x, p->y, p->radius, offsetX, offsetY );
+    
+    if( offsetX != 0 ) {
+        drawParticle( p, ws, offsetX, 0 );
+    }
+    if( offsetY != 0 ) {
+        drawParticle( p, ws, 0, offsetY );
+    }
+    if( offsetX != 0 && offsetY != 0 ) {
+        drawParticle( p, ws, offsetX, offsetY );
+    }
+}
+
+void ofxLabFlexParticleSystem::drawPlainParticle( float x,
+                                                  float y,
+                                                  float radius,
+                                                  const ofRectangle& ws )
+{
+    if( !isInStencil( x, y, radius, ws ) ) {
+        return;
+    }
+    
+    if( !_bLodActive || radius * _drawScale >= _lodMinPixels ) {
+        ofSetColor( 0, 0, 0 );
+        ofCircle( x, y, radius );
+        
+        ofSetColor( 255, 255, 255 );
+        ofCircle( x, y, radius * .5 );
+        return;
+    }
+    
+    binParticle( x, y, radius );
+}
+
+void ofxLabFlexParticleSystem::drawPlainParticleWrapped( float x,
+                                                         float y,
+                                                         float radius,
+                                                         const ofRectangle& ws )
 {
+    drawPlainParticle( x, y, radius, ws );
+    
+    if( _worldType != SQUARE || !(_options & (HORIZONTAL_WRAP | VERTICAL_WRAP)) ) {
+        return;
+    }
+    
+    float offsetX;
+    float offsetY;
+    getWrapOffsets( x, y, radius, offsetX, offsetY );
+    
+    if( offsetX != 0 ) {
+        drawPlainParticle( x + offsetX, y, radius, ws );
+    }
+    if( offsetY != 0 ) {
+        drawPlainParticle( x, y + offsetY, radius, ws );
+    }
+    if( offsetX != 0 && offsetY != 0 ) {
+        drawPlainParticle( x + offsetX, y + offsetY, radius, ws );
+    }
+}
 
+void ofxLabFlexParticleSystem::binParticle( float x,
+                                            float y,
+                                            float radius )
+{
+    int col = (int) floorf( (x - _lodOriginX) / _lodCellSize );
+    int row = (int) floorf( (y - _lodOriginY) / _lodCellSize );
+    if( col < 0 || col >= _lodCols || row < 0 || row >= _lodRows ) {
+        return;
+    }
+    
+    int cell = row * _lodCols + col;
+    if( _lodCoverage[cell] == 0 ) {
+        _lodCells.push_back( cell );
+    }
+    _lodCoverage[cell] += MAX( PI * radius * radius, LOD_MIN_AREA );
+}
 
-    float tempf;
+void ofxLabFlexParticleSystem::beginDensityLOD( const ofRectangle& ws )
+{
+    _bLodActive = _lodMinPixels > 0 && _drawScale > 0;
+    if( !_bLodActive ) {
+        return;
+    }
     
-    ofVec2f middleBox = _worldBox / 2;
+    // square around the stencil's circumcircle, so it covers any rotation
+    float half = 0.5f * sqrtf( ws.width * ws.width + ws.height * ws.height );
+    ofPoint centre = ws.getCenter();
     
-    Iterator it;
+    _lodCellSize = _lodCellPixels / _drawScale;
+    _lodOriginX = centre.x - half;
+    _lodOriginY = centre.y - half;
+    _lodCols = MAX( 1, (int) ceilf( 2 * half / _lodCellSize ) );
+    _lodRows = _lodCols;
     
-    for( it = _particles.begin(); it != _particles.end(); ++it )
-    {
-        ofxLabFlexParticle* p = (it->second);
+    if( (int) _lodCoverage.size() != _lodCols * _lodRows ) {
+        _lodCoverage.assign( _lodCols * _lodRows, 0 );
+    }
+}
+
+void ofxLabFlexParticleSystem::endDensityLOD()
+{
+    if( !_bLodActive ) {
+        return;
+    }
+    _bLodActive = false;
+    
+    if( _lodCells.empty() ) {
+        return;
+    }
+    
+    _lodMesh.clear();
+    _lodMesh.setMode( OF_PRIMITIVE_TRIANGLES );
+    
+    float cellArea = _lodCellSize * _lodCellSize;
+    
+    // one square per cell, as opaque as the particles in it cover
+    for( unsigned int i=0; i<_lodCells.size(); ++i ) {
+        int cell = _lodCells[i];
+        float coverage = MIN( _lodCoverage[cell] / cellArea, 1 );
+        _lodCoverage[cell] = 0;
         
-        if( shouldDraw( p, ws, rotation ) ) {
-            p->draw();
-        }
+        ofFloatColor color( _lodColor.r / 255.0f,
+                            _lodColor.g / 255.0f,
+                            _lodColor.b / 255.0f,
+                            _lodColor.a / 255.0f * coverage );
         
+        float x0 = _lodOriginX + (cell % _lodCols) * _lodCellSize;
+        float y0 = _lodOriginY + (cell / _lodCols) * _lodCellSize;
+        float x1 = x0 + _lodCellSize;
+        float y1 = y0 + _lodCellSize;
         
-        // need to check if the particle wrap is inside
-        if( _worldType == SQUARE ) {
-            
-            if( _options & HORIZONTAL_WRAP ) {
-                if( p->x + p->radius > _worldBox.x ) {
-                    // check right side of screen and wrap back to left if needed
-                    
-                    tempf = p->x;
-                    p->x -= _worldBox.x;
-                    if( shouldDraw( p, ws, rotation ) ) {
-                        p->draw();
-                    }
-                    p->x = tempf;
-                } else if ( p->x - p->radius < 0 ) {
-                    // check right side of screen and wrap back to right if needed
-                    
-                    tempf = p->x;
-                    tempf = p->x;
-                    p->x += _worldBox.x;
-                    if( shouldDraw( p, ws, rotation ) ) {
-                        p->draw();
-                    }
-                    p->x = tempf;                
-                }
-            }
-            
-            if( _options & VERTICAL_WRAP ) {
-                if( p->y + p->radius > _worldBox.y ) {
-                    // check bottom side of screen and wrap back to top if needed
-                    
-                    tempf = p->y;
-                    p->y -= _worldBox.y;
-                    if( shouldDraw( p, ws, rotation ) ) {
-                        p->draw();
-                    }
-                    p->y = tempf;
-                } else if ( p->y - p->radius < 0 ) {
-                    // check top side of screen and wrap back to bottom if needed
-                    
-                    tempf = p->y;
-                    p->y += _worldBox.y;
-                    if( shouldDraw( p, ws, rotation ) ) {
-                        p->draw();
-                    }
-                    p->y = tempf;
-                }
-            }
+        _lodMesh.addVertex( ofVec3f( x0, y0, 0 ) );
+        _lodMesh.addVertex( ofVec3f( x1, y0, 0 ) );
+        _lodMesh.addVertex( ofVec3f( x1, y1, 0 ) );
+        _lodMesh.addVertex( ofVec3f( x0, y0, 0 ) );
+        _lodMesh.addVertex( ofVec3f( x1, y1, 0 ) );
+        _lodMesh.addVertex( ofVec3f( x0, y1, 0 ) );
+        for( int v=0; v<6; ++v ) {
+            _lodMesh.addColor( color );
         }
+    }
+    _lodCells.clear();
+    
+    ofPushStyle();
+    ofEnableAlphaBlending();
+    _lodMesh.draw();
+    ofPopStyle();
+}
+
+void ofxLabFlexParticleSystem::draw( const ofRectangle& ws,
+                              float /*rotation*/ )
+{
+    beginDensityLOD( ws );
+    
+    Iterator it;
+    
+    for( it = _particles.begin(); it != _particles.end(); ++it )
+    {
+        drawParticle( it->second, ws );
+    }
+    
+    // copies wrapping around the edges, found by update() so nothing here
+    // moves the particles
+    for( unsigned int i=0; i<_ghosts.size(); ++i )
+    {
+        const Ghost& ghost = _ghosts[i];
+        drawParticle( ghost.particle, ws, ghost.offsetX, ghost.offsetY );
+    }
+    
+    // the compact swarm, and its wrapped copies
+    if( _store && _store->size() > 0 ) {
+        const float* x = _store->getX();
+        const float* y = _store->getY();
+        const float* radius = _store->getRadius();
         
+        for( int i=0; i<_store->size(); ++i ) {
+            drawPlainParticleWrapped( x[i], y[i], radius[i], ws );
+        }
     }
     
+    endDensityLOD();
     
     //cout << "bool is " << ( _options & VECTOR_FIELD & VECTOR_FIELD_DRAW ) << endl;
-    if( (_options & VECTOR_FIELD) && (_options & VECTOR_FIELD_DRAW) )  {
+    if( (_options & VECTOR_FIELD) && (_options & VECTOR_FIELD_DRAW) && !_fieldSource )  {
         //cout << "drawing.. " << endl;
         _vectorField.draw( ws );
     }
 }
 
+void ofxLabFlexParticleSystem::drawStates( const vector<ofxLabFlexParticleState>& particles,
+                                           const vector<ofxLabFlexParticleState>& storeParticles,
+                                           const ofRectangle& ws )
+{
+    beginDensityLOD( ws );
+    
+    // the copies aren't moved by update(), so the wrapped ones are worked
+    // out here instead of taken from _ghosts
+    for( unsigned int i=0; i<particles.size(); ++i ) {
+        const ofxLabFlexParticleState& p = particles[i];
+        drawPlainParticleWrapped( p.position[0], p.position[1], p.radius, ws );
+    }
+    
+    for( unsigned int i=0; i<storeParticles.size(); ++i ) {
+        const ofxLabFlexParticleState& p = storeParticles[i];
+        drawPlainParticleWrapped( p.position[0], p.position[1], p.radius, ws );
+    }
+    
+    endDensityLOD();
+    
+    if( (_options & VECTOR_FIELD) && (_options & VECTOR_FIELD_DRAW) && !_fieldSource )  {
+        _vectorField.draw( ws );
+    }
+}
+
+void ofxLabFlexParticleSystem::drawCopies( const vector<ofxLabFlexParticle*>& particles,
+                                           const vector<ofxLabFlexParticleState>& storeParticles,
+                                           const ofRectangle& ws )
+{
+    beginDensityLOD( ws );
+    
+    // as in drawStates(), the wrapped copies are worked out here
+    for( unsigned int i=0; i<particles.size(); ++i ) {
+        drawParticleWrapped( particles[i], ws );
+    }
+    
+    for( unsigned int i=0; i<storeParticles.size(); ++i ) {
+        const ofxLabFlexParticleState& p = storeParticles[i];
+        drawPlainParticleWrapped( p.position[0], p.position[1], p.radius, ws );
+    }
+    
+    endDensityLOD();
+    
+    if( (_options & VECTOR_FIELD) && (_options & VECTOR_FIELD_DRAW) && !_fieldSource )  {
+        _vectorField.draw( ws );
+    }
+}
+
 void ofxLabFlexParticleSystem::addParticle( ofxLabFlexParticle* p )
 {
     Poco::ScopedLock<ofMutex> scopeLock(_updateLock);
@@ -526,9 +1950,13 @@ void ofxLabFlexParticleSystem::addParticle( ofxLabFlexParticle* p )
     p->setUniqueID(_nextID++);
     
     _particles[p->getUniqueID()] = p;
+    acquireSlot( p->getUniqueID(), p );
+    ++_orderVersion;
 
 	while(_maxParticles > 0 && _particles.size() > _maxParticles) {
         cout << "add erase" << endl;
+        releaseSlot( _particles.begin()->first );
+        removeGhosts( _particles.begin()->second );
 		_particles.erase( _particles.begin() );
 	}
 
@@ -556,12 +1984,15 @@ bool ofxLabFlexParticleSystem::removeParticle( unsigned long uniqueID )
     
     if( it == _particles.end() ) {
 
-        //_updateLock.unlock();
+        _updateLock.unlock();
         cerr << "unable to find particle " << uniqueID << endl;
         return false;
     }
 
+    releaseSlot( it->first );
+    removeGhosts( it->second );
 	_particles.erase( it );
+    ++_orderVersion;
 
     _updateLock.unlock();
     
@@ -577,25 +2008,26 @@ void ofxLabFlexParticleSystem::clear(){
     }
 
     _updateLock.lock();
+    releaseAllSlots();
     _particles.clear();
+    _ghosts.clear();
     _nextID = 0;
+    ++_orderVersion;
     _updateLock.unlock();
 }
 
 void ofxLabFlexParticleSystem::multForce( const ofVec3f& force )
 {
-    Iterator it;
-    for( it = _particles.begin(); it != _particles.end(); ++it ) {
-        (*it).second->velocity *= force;
-    }
+    Poco::ScopedLock<ofMutex> scopeLock(_forceLock);
+    _pendingVelMult *= force;
+    _bPendingForces = true;
 }
 
 void ofxLabFlexParticleSystem::addForce( const ofVec3f& force )
 {
-    Iterator it;
-    for( it = _particles.begin(); it != _particles.end(); ++it ) {
-        (*it).second->acceleration += force;
-    }
+    Poco::ScopedLock<ofMutex> scopeLock(_forceLock);
+    _pendingAccel += force;
+    _bPendingForces = true;
 }
 
 int ofxLabFlexParticleSystem::getNumParticles()
@@ -0,0 +1,267 @@
+//
+//  ofxLabFlexPipeline.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexPipeline.h"
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexPipeline::ofxLabFlexPipeline() :
+_system(NULL),
+_latency(1),
+_start(0, 1),
+_finished(0, 1),
+_bInFlight(false),
+_bStopping(false),
+_frameNumber(0),
+_bDrawPlain(false)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexPipeline::~ofxLabFlexPipeline()
+{
+    stop();
+    clearDrawParticles();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::setup( ofxLabFlexParticleSystem* system,
+                                int latency )
+{
+    wait();
+
+    _system = system;
+    _latency = (int) ofClamp( latency, 0, 1 );
+    _frameNumber = 0;
+
+    if( _system ) {
+        publish();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::setLatency( int latency )
+{
+    if( _bInFlight ) {
+        wait();
+        publish();
+    }
+    _latency = (int) ofClamp( latency, 0, 1 );
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexPipeline::getLatency() const
+{
+    return _latency;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::setDrawPlain( bool plain )
+{
+    if( plain == _bDrawPlain ) {
+        return;
+    }
+    _bDrawPlain = plain;
+
+    // the copies of a frame in flight are taken when it is published
+    if( !_bInFlight && _system ) {
+        publish();
+    } else if( plain ) {
+        clearDrawParticles();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexPipeline::getDrawPlain() const
+{
+    return _bDrawPlain;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::update()
+{
+    if( !_system ) {
+        return;
+    }
+
+    if( !isThreadRunning() ) {
+        _bStopping = false;
+        startThread( true, false );
+    }
+
+    // back-pressure, never more than one frame ahead
+    if( _bInFlight ) {
+        wait();
+        publish();
+    }
+
+    _bInFlight = true;
+    _start.set();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::sync()
+{
+    if( _latency == 0 && _bInFlight ) {
+        wait();
+        publish();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::draw( const ofRectangle& windowStencil,
+                               float rotate )
+{
+    sync();
+
+    if( !_system ) {
+        return;
+    }
+
+    if( _bInFlight ) {
+        drawFrame( _frame, _storeFrame, windowStencil );
+    } else {
+        _system->draw( windowStencil, rotate );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::drawFrame( const vector<ofxLabFlexParticleState>& particles,
+                                    const vector<ofxLabFlexParticleState>& storeParticles,
+                                    const ofRectangle& windowStencil )
+{
+    // frames published before setDrawPlain( false ) have no copies yet
+    if( _bDrawPlain || _drawParticles.size() != particles.size() ) {
+        _system->drawStates( particles, storeParticles, windowStencil );
+    } else {
+        _system->drawCopies( _drawParticles, storeParticles, windowStencil );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+const vector<ofxLabFlexParticleState>& ofxLabFlexPipeline::getFrame()
+{
+    sync();
+    return _frame;
+}
+
+
+//------------------------------------------------------------------------------------
+unsigned int ofxLabFlexPipeline::getFrameNumber() const
+{
+    return _frameNumber;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::stop()
+{
+    if( !isThreadRunning() ) {
+        return;
+    }
+
+    if( _bInFlight ) {
+        wait();
+        publish();
+    }
+
+    _bStopping = true;
+    stopThread();
+    _start.set();
+    waitForThread( false );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::threadedFunction()
+{
+    while( true ) {
+        _start.wait();
+
+        if( _bStopping ) {
+            return;
+        }
+
+        _system->update();
+        _finished.set();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::wait()
+{
+    if( !_bInFlight ) {
+        return;
+    }
+
+    _finished.wait();
+    _bInFlight = false;
+    ++_frameNumber;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::publish()
+{
+    const ofxLabFlexParticleSystem::Container* particles = _system->getParticles();
+
+    _frame.resize( particles->size() );
+
+    ofxLabFlexParticleSystem::const_Iterator it = particles->begin();
+    for( unsigned int i=0; it != particles->end(); ++it, ++i ) {
+        it->second->getState( _frame[i] );
+    }
+
+    // copies of each particle's own type, so they draw themselves
+    clearDrawParticles();
+    if( !_bDrawPlain ) {
+        _drawParticles.reserve( particles->size() );
+        for( it = particles->begin(); it != particles->end(); ++it ) {
+            _drawParticles.push_back( it->second->clone() );
+        }
+    }
+
+    ofxLabFlexParticleStore* store = _system->getParticleStore();
+    int storeSize = store ? store->size() : 0;
+
+    ofxLabFlexParticleState blank;
+    memset( &blank, 0, sizeof(blank) );
+    _storeFrame.assign( storeSize, blank );
+
+    if( storeSize > 0 ) {
+        const float* x = store->getX();
+        const float* y = store->getY();
+        const float* radius = store->getRadius();
+
+        for( int i=0; i<storeSize; ++i ) {
+            _storeFrame[i].position[0] = x[i];
+            _storeFrame[i].position[1] = y[i];
+            _storeFrame[i].radius = radius[i];
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPipeline::clearDrawParticles()
+{
+    for( unsigned int i=0; i<_drawParticles.size(); ++i ) {
+        delete _drawParticles[i];
+    }
+    _drawParticles.clear();
+}
@@ -0,0 +1,361 @@
+//
+//  ofxLabFlexPolygon.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexPolygon.h"
+
+
+// which side of the line a->b the point p is on
+static inline float orient( const ofVec2f& a,
+                            const ofVec2f& b,
+                            float px,
+                            float py )
+{
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexPolygon::ofxLabFlexPolygon() :
+_bBuilt(false),
+_cellSize(1),
+_invCellSize(1),
+_cols(0),
+_rows(0)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPolygon::addContour( const vector<ofVec2f>& points )
+{
+    if( points.size() < 3 ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexPolygon: a contour needs at least 3 points" );
+        return;
+    }
+
+    for( unsigned int i=0; i<points.size(); ++i ) {
+        Edge edge;
+        edge.a = points[i];
+        edge.b = points[(i + 1) % points.size()];
+
+        ofVec2f delta = edge.b - edge.a;
+        float lengthSq = delta.lengthSquared();
+
+        edge.invLengthSq = lengthSq > 0 ? 1.0f / lengthSq : 0;
+        edge.normal = lengthSq > 0 ? ofVec2f( delta.y, -delta.x ) / sqrtf(lengthSq) : ofVec2f(0,0);
+
+        _edges.push_back( edge );
+    }
+
+    _bBuilt = false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPolygon::clear()
+{
+    _edges.clear();
+    _cellStart.clear();
+    _cellEdges.clear();
+    _cellInside.clear();
+    _cols = _rows = 0;
+    _bBuilt = false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPolygon::build( float cellSize )
+{
+    _bBuilt = false;
+
+    if( _edges.empty() ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexPolygon: nothing to build, add a contour first" );
+        return;
+    }
+
+    float minX = _edges[0].a.x, maxX = minX;
+    float minY = _edges[0].a.y, maxY = minY;
+
+    for( unsigned int i=1; i<_edges.size(); ++i ) {
+        minX = MIN( minX, _edges[i].a.x );
+        maxX = MAX( maxX, _edges[i].a.x );
+        minY = MIN( minY, _edges[i].a.y );
+        maxY = MAX( maxY, _edges[i].a.y );
+    }
+
+    _bounds = ofRectangle( minX, minY, maxX - minX, maxY - minY );
+
+    // by default aim for a couple of edges per cell along the outline
+    if( cellSize <= 0 ) {
+        cellSize = MAX( _bounds.width, _bounds.height ) / MAX( 1.0f, 2.0f * sqrtf( (float) _edges.size() ) );
+    }
+    if( cellSize <= 0 ) {
+        cellSize = 1;
+    }
+
+    _cellSize       = cellSize;
+    _invCellSize    = 1.0f / cellSize;
+    _cols           = MAX( 1, (int) ceilf( _bounds.width * _invCellSize ) );
+    _rows           = MAX( 1, (int) ceilf( _bounds.height * _invCellSize ) );
+
+    int numCells = _cols * _rows;
+
+    // bin the edges, counting first so the lists are one contiguous block
+    _cellStart.assign( numCells + 1, 0 );
+
+    for( int pass=0; pass<2; ++pass ) {
+
+        vector<int> fill;
+        if( pass == 1 ) {
+            for( int i=0; i<numCells; ++i ) {
+                _cellStart[i + 1] += _cellStart[i];
+            }
+            _cellEdges.resize( _cellStart[numCells] );
+            fill.assign( _cellStart.begin(), _cellStart.end() - 1 );
+        }
+
+        for( unsigned int i=0; i<_edges.size(); ++i ) {
+            const Edge& edge = _edges[i];
+
+            int col0, row0, col1, row1;
+            getCell( MIN( edge.a.x, edge.b.x ), MIN( edge.a.y, edge.b.y ), col0, row0 );
+            getCell( MAX( edge.a.x, edge.b.x ), MAX( edge.a.y, edge.b.y ), col1, row1 );
+
+            for( int row=row0; row<=row1; ++row ) {
+                for( int col=col0; col<=col1; ++col ) {
+                    if( !edgeTouchesCell( edge, col, row ) ) {
+                        continue;
+                    }
+                    int cell = row * _cols + col;
+                    if( pass == 0 ) {
+                        ++_cellStart[cell + 1];
+                    } else {
+                        _cellEdges[fill[cell]++] = i;
+                    }
+                }
+            }
+        }
+    }
+
+    // inside flag of each cell center, one scanline per row
+    _cellInside.assign( numCells, 0 );
+
+    vector<float> crossings;
+    for( int row=0; row<_rows; ++row ) {
+        float y = _bounds.y + (row + 0.5f) * _cellSize;
+
+        crossings.clear();
+        for( unsigned int i=0; i<_edges.size(); ++i ) {
+            const Edge& edge = _edges[i];
+            if( (edge.a.y > y) != (edge.b.y > y) ) {
+                crossings.push_back( edge.a.x + (y - edge.a.y) * (edge.b.x - edge.a.x) / (edge.b.y - edge.a.y) );
+            }
+        }
+        sort( crossings.begin(), crossings.end() );
+
+        unsigned int passed = 0;
+        for( int col=0; col<_cols; ++col ) {
+            float x = _bounds.x + (col + 0.5f) * _cellSize;
+            while( passed < crossings.size() && crossings[passed] < x ) {
+                ++passed;
+            }
+            _cellInside[row * _cols + col] = passed & 1;
+        }
+    }
+
+    _bBuilt = true;
+
+    // point every normal out of the polygon
+    float eps = _cellSize * 0.001f;
+    for( unsigned int i=0; i<_edges.size(); ++i ) {
+        Edge& edge = _edges[i];
+        ofVec2f mid = (edge.a + edge.b) * 0.5f + edge.normal * eps;
+        if( inside( mid.x, mid.y ) ) {
+            edge.normal = -edge.normal;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexPolygon::isBuilt() const
+{
+    return _bBuilt;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexPolygon::inside( float x,
+                                float y ) const
+{
+    if( !_bBuilt || !_bounds.inside( x, y ) ) {
+        return false;
+    }
+
+    int col, row;
+    getCell( x, y, col, row );
+
+    int cell = row * _cols + col;
+
+    // walk from the cell center, whose side we know, to the point.  The path
+    // stays in the cell so only this cell's edges can cross it
+    ofVec2f center( _bounds.x + (col + 0.5f) * _cellSize,
+                    _bounds.y + (row + 0.5f) * _cellSize );
+
+    bool in = _cellInside[cell] != 0;
+
+    for( int i=_cellStart[cell]; i<_cellStart[cell + 1]; ++i ) {
+        const Edge& edge = _edges[_cellEdges[i]];
+
+        if( (orient( edge.a, edge.b, center.x, center.y ) > 0) != (orient( edge.a, edge.b, x, y ) > 0) &&
+            (orient( center, ofVec2f(x,y), edge.a.x, edge.a.y ) > 0) != (orient( center, ofVec2f(x,y), edge.b.x, edge.b.y ) > 0) ) {
+            in = !in;
+        }
+    }
+
+    return in;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexPolygon::findNearestEdge( float x,
+                                        float y,
+                                        ofVec2f& closest ) const
+{
+    if( !_bBuilt ) {
+        return -1;
+    }
+
+    int col, row;
+    getCell( x, y, col, row );
+
+    int     best = -1;
+    float   bestDistSq = 0;
+    ofVec2f point;
+
+    int maxRing = MAX( _cols, _rows );
+
+    for( int ring=0; ring<=maxRing; ++ring ) {
+
+        for( int r=row - ring; r<=row + ring; ++r ) {
+            if( r < 0 || r >= _rows ) {
+                continue;
+            }
+
+            // full rows at the top and bottom of the ring, only the ends otherwise
+            int step = (r == row - ring || r == row + ring) ? 1 : MAX( 1, 2 * ring );
+
+            for( int c=col - ring; c<=col + ring; c+=step ) {
+                if( c < 0 || c >= _cols ) {
+                    continue;
+                }
+
+                int cell = r * _cols + c;
+                for( int i=_cellStart[cell]; i<_cellStart[cell + 1]; ++i ) {
+                    float distSq = distanceSq( _edges[_cellEdges[i]], x, y, point );
+                    if( best < 0 || distSq < bestDistSq ) {
+                        best = _cellEdges[i];
+                        bestDistSq = distSq;
+                        closest = point;
+                    }
+                }
+            }
+        }
+
+        // every cell past this ring is at least ring cells away
+        float reach = ring * _cellSize;
+        if( best >= 0 && bestDistSq <= reach * reach ) {
+            break;
+        }
+    }
+
+    return best;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexPolygon::getNumEdges() const
+{
+    return _edges.size();
+}
+
+
+//------------------------------------------------------------------------------------
+const ofxLabFlexPolygon::Edge& ofxLabFlexPolygon::getEdge( int index ) const
+{
+    return _edges[index];
+}
+
+
+//------------------------------------------------------------------------------------
+const ofRectangle& ofxLabFlexPolygon::getBounds() const
+{
+    return _bounds;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPolygon::draw()
+{
+    for( unsigned int i=0; i<_edges.size(); ++i ) {
+        ofLine( _edges[i].a.x, _edges[i].a.y, _edges[i].b.x, _edges[i].b.y );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPolygon::getCell( float x,
+                                 float y,
+                                 int& col,
+                                 int& row ) const
+{
+    col = (int) floorf( (x - _bounds.x) * _invCellSize );
+    row = (int) floorf( (y - _bounds.y) * _invCellSize );
+
+    col = MAX( 0, MIN( _cols - 1, col ) );
+    row = MAX( 0, MIN( _rows - 1, row ) );
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexPolygon::edgeTouchesCell( const Edge& edge,
+                                         int col,
+                                         int row ) const
+{
+    float x0 = _bounds.x + col * _cellSize;
+    float y0 = _bounds.y + row * _cellSize;
+    float x1 = x0 + _cellSize;
+    float y1 = y0 + _cellSize;
+
+    // the caller already knows the bounding boxes overlap, so the segment
+    // misses the cell only if all 4 corners are on the same side of its line
+    float s0 = orient( edge.a, edge.b, x0, y0 );
+    float s1 = orient( edge.a, edge.b, x1, y0 );
+    float s2 = orient( edge.a, edge.b, x0, y1 );
+    float s3 = orient( edge.a, edge.b, x1, y1 );
+
+    return !( (s0 > 0 && s1 > 0 && s2 > 0 && s3 > 0) ||
+              (s0 < 0 && s1 < 0 && s2 < 0 && s3 < 0) );
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexPolygon::distanceSq( const Edge& edge,
+                                     float x,
+                                     float y,
+                                     ofVec2f& closest ) const
+{
+    ofVec2f delta = edge.b - edge.a;
+
+    float t = ( (x - edge.a.x) * delta.x + (y - edge.a.y) * delta.y ) * edge.invLengthSq;
+    t = ofClamp( t, 0, 1 );
+
+    closest = edge.a + delta * t;
+
+    float dx = x - closest.x;
+    float dy = y - closest.y;
+    return dx * dx + dy * dy;
+}
@@ -0,0 +1,53 @@
+//
+//  ofxLabFlexProceduralField.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexProceduralField.h"
+
+// step, in noise space, for the curl's derivatives
+static const float CURL_EPSILON = 0.01f;
+
+
+//------------------------------------------------------------------------------------
+ofVec2f ofxLabFlexForceSource::getForceFromPos( float posX,
+                                                float posY ) const
+{
+    float forceX;
+    float forceY;
+    getForces( &posX, &posY, 1, &forceX, &forceY );
+    return ofVec2f( forceX, forceY );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexNoiseField::evaluate( float x,
+                                     float y,
+                                     float& outX,
+                                     float& outY ) const
+{
+    // ofNoise sits mostly around .5, spread it over two turns so every
+    // direction comes up
+    float angle = ofNoise( x * scale, y * scale, time ) * TWO_PI * 2;
+    outX = cosf( angle ) * strength;
+    outY = sinf( angle ) * strength;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexCurlNoiseField::evaluate( float x,
+                                         float y,
+                                         float& outX,
+                                         float& outY ) const
+{
+    float nx = x * scale;
+    float ny = y * scale;
+
+    // (d/dy, -d/dx) of the noise, by central differences
+    float dx = ofNoise( nx + CURL_EPSILON, ny, time ) - ofNoise( nx - CURL_EPSILON, ny, time );
+    float dy = ofNoise( nx, ny + CURL_EPSILON, time ) - ofNoise( nx, ny - CURL_EPSILON, time );
+
+    float f = strength / (2 * CURL_EPSILON);
+    outX = dy * f;
+    outY = -dx * f;
+}
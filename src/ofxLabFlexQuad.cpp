@@ -7,3 +7,86 @@
 //
 
 #include "ofxLabFlexQuad.h"
+
+
+// edge from a to b as nx * x + ny * y + offset, the sign of the cross product
+// (b - a) x (p - a).  Flipped so outside is always positive
+static void buildEdge( const ofVec2f& a,
+                       const ofVec2f& b,
+                       float sign,
+                       float& nx,
+                       float& ny,
+                       float& offset )
+{
+    nx      = -(b.y - a.y) * sign;
+    ny      =  (b.x - a.x) * sign;
+    offset  = -(nx * a.x + ny * a.y);
+}
+
+//------------------------------------------------------------------------------------
+ofxLabFlexQuad::ofxLabFlexQuad()
+{
+    bBuilt = false;
+    update();
+}
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexQuad::setCorners( const ofVec2f& topLeft,
+                                 const ofVec2f& topRight,
+                                 const ofVec2f& bottomLeft,
+                                 const ofVec2f& bottomRight )
+{
+    _tl = topLeft;
+    _tr = topRight;
+    _bl = bottomLeft;
+    _br = bottomRight;
+    
+    update();
+}
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexQuad::update()
+{
+    buildEdge( _tl, _tr, -1, _edges[EDGE_TOP].nx,    _edges[EDGE_TOP].ny,    _edges[EDGE_TOP].offset );
+    buildEdge( _tr, _br, -1, _edges[EDGE_RIGHT].nx,  _edges[EDGE_RIGHT].ny,  _edges[EDGE_RIGHT].offset );
+    buildEdge( _bl, _br,  1, _edges[EDGE_BOTTOM].nx, _edges[EDGE_BOTTOM].ny, _edges[EDGE_BOTTOM].offset );
+    buildEdge( _tl, _bl,  1, _edges[EDGE_LEFT].nx,   _edges[EDGE_LEFT].ny,   _edges[EDGE_LEFT].offset );
+    
+    // a flat edge has no single x per height, use its start
+    _leftSlope  = _bl.y != _tl.y ? (_bl.x - _tl.x) / (_bl.y - _tl.y) : 0;
+    _rightSlope = _br.y != _tr.y ? (_br.x - _tr.x) / (_br.y - _tr.y) : 0;
+    
+    if( bBuilt ) {
+        mesh.clear();
+        bBuilt = false;
+    }
+}
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexQuad::classify( const float* x,
+                               const float* y,
+                               const float* radius,
+                               int count,
+                               unsigned char* masks ) const
+{
+    const EdgeEquation& top     = _edges[EDGE_TOP];
+    const EdgeEquation& right   = _edges[EDGE_RIGHT];
+    const EdgeEquation& bottom  = _edges[EDGE_BOTTOM];
+    const EdgeEquation& left    = _edges[EDGE_LEFT];
+    
+    if( radius ) {
+        for( int i=0; i<count; ++i ) {
+            masks[i] = (unsigned char)( ( top.nx * x[i] + top.ny * y[i] + top.offset > 0 ? TOP : 0 ) |
+                                        ( right.nx * (x[i] - radius[i]) + right.ny * y[i] + right.offset > 0 ? RIGHT : 0 ) |
+                                        ( bottom.nx * x[i] + bottom.ny * y[i] + bottom.offset > 0 ? BOTTOM : 0 ) |
+                                        ( left.nx * (x[i] + radius[i]) + left.ny * y[i] + left.offset > 0 ? LEFT : 0 ) );
+        }
+    } else {
+        for( int i=0; i<count; ++i ) {
+            masks[i] = (unsigned char)( ( top.nx * x[i] + top.ny * y[i] + top.offset > 0 ? TOP : 0 ) |
+                                        ( right.nx * x[i] + right.ny * y[i] + right.offset > 0 ? RIGHT : 0 ) |
+                                        ( bottom.nx * x[i] + bottom.ny * y[i] + bottom.offset > 0 ? BOTTOM : 0 ) |
+                                        ( left.nx * x[i] + left.ny * y[i] + left.offset > 0 ? LEFT : 0 ) );
+        }
+    }
+}
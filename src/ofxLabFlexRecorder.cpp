@@ -0,0 +1,639 @@
+//
+//  ofxLabFlexRecorder.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexRecorder.h"
+#include "ofxLabFlexParticleSystem.h"
+
+const unsigned int ofxLabFlexRecorder::FILE_VERSION = 1;
+
+// frame flags
+static const unsigned char KEYFRAME = (1u << 0);
+
+
+//------------------------------------------------------------------------------------
+// LEB128 style variable length integers, small values take a single byte
+static void writeVarint( vector<unsigned char>& buffer,
+                         unsigned long long value )
+{
+    while( value >= 0x80 ) {
+        buffer.push_back( (unsigned char)(value | 0x80) );
+        value >>= 7;
+    }
+    buffer.push_back( (unsigned char) value );
+}
+
+static unsigned long long readVarint( const unsigned char*& data,
+                                      const unsigned char* end )
+{
+    unsigned long long value = 0;
+    int shift = 0;
+    while( data < end && shift < 64 ) {
+        unsigned char byte = *data++;
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if( !(byte & 0x80) ) {
+            break;
+        }
+        shift += 7;
+    }
+    return value;
+}
+
+static unsigned int floatBits( float value )
+{
+    unsigned int bits;
+    memcpy( &bits, &value, sizeof(bits) );
+    return bits;
+}
+
+static float bitsFloat( unsigned int bits )
+{
+    float value;
+    memcpy( &value, &bits, sizeof(value) );
+    return value;
+}
+
+static bool compareIDs( const ofxLabFlexRecordedParticle& a,
+                        const ofxLabFlexRecordedParticle& b )
+{
+    return a.uniqueID < b.uniqueID;
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexRecorder::ofxLabFlexRecorder() :
+_file(NULL),
+_bRecording(false),
+_startSeconds(0),
+_maxQueuedFrames(0),
+_keyframeInterval(1),
+_current(NULL),
+_dropped(0),
+_written(0),
+_frameReady(true),
+_encodedFrames(0)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexRecorder::~ofxLabFlexRecorder()
+{
+    close();
+
+    delete _current;
+    for( unsigned int i=0; i<_free.size(); ++i ) {
+        delete _free[i];
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexRecorder::open( const string& path,
+                               int maxQueuedFrames,
+                               int keyframeInterval )
+{
+    close();
+
+    string fullPath = ofToDataPath( path, true );
+
+    _file = fopen( fullPath.c_str(), "wb" );
+    if( !_file ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexRecorder: unable to write " + fullPath );
+        return false;
+    }
+
+    ofxLabFlexRecordingHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, "LFRC", 4 );
+    header.version = FILE_VERSION;
+    header.keyframeInterval = MAX( 1, keyframeInterval );
+    fwrite( &header, sizeof(header), 1, _file );
+
+    _maxQueuedFrames = MAX( 1, maxQueuedFrames );
+    _keyframeInterval = header.keyframeInterval;
+    _startSeconds = ofGetElapsedTimef();
+    _dropped = 0;
+    _written = 0;
+    _encodedFrames = 0;
+    _previous.clear();
+
+    if( !_current ) {
+        _current = new Frame();
+    }
+    _current->particles.clear();
+    _current->events.clear();
+
+    _bRecording = true;
+    startThread( true, false );
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexRecorder::close()
+{
+    if( !_bRecording ) {
+        return;
+    }
+
+    _bRecording = false;
+
+    stopThread();
+    _frameReady.set();
+    waitForThread( false );
+
+    // the thread is gone, write whatever it didn't get to
+    writeQueued();
+
+    fclose( _file );
+    _file = NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexRecorder::isRecording() const
+{
+    return _bRecording;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexRecorder::addParticle( ofxLabFlexParticle& p )
+{
+    if( !_bRecording ) {
+        return;
+    }
+
+    ofxLabFlexRecordedParticle record;
+    record.uniqueID = p.getUniqueID();
+    record.data[ofxLabFlexRecordedParticle::POS_X]        = p.x;
+    record.data[ofxLabFlexRecordedParticle::POS_Y]        = p.y;
+    record.data[ofxLabFlexRecordedParticle::VELOCITY_X]   = p.velocity.x;
+    record.data[ofxLabFlexRecordedParticle::VELOCITY_Y]   = p.velocity.y;
+    record.data[ofxLabFlexRecordedParticle::RADIUS]       = p.radius;
+    record.data[ofxLabFlexRecordedParticle::ROTATION_X]   = p.rotation.x;
+    record.data[ofxLabFlexRecordedParticle::ROTATION_Y]   = p.rotation.y;
+    record.data[ofxLabFlexRecordedParticle::ROTATION_Z]   = p.rotation.z;
+
+    _current->particles.push_back( record );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexRecorder::addWallEvent( unsigned long uniqueID,
+                                       int wall )
+{
+    if( !_bRecording ) {
+        return;
+    }
+
+    ofxLabFlexRecordedWallEvent event;
+    event.uniqueID = uniqueID;
+    event.wall = wall;
+
+    _current->events.push_back( event );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexRecorder::endFrame()
+{
+    if( !_bRecording ) {
+        return;
+    }
+
+    _current->seconds = ofGetElapsedTimef() - _startSeconds;
+
+    Frame* next = NULL;
+
+    lock();
+    if( (int)_queue.size() >= _maxQueuedFrames ) {
+        // writer is behind, keep memory bounded and reuse this frame
+        ++_dropped;
+    } else {
+        _queue.push_back( _current );
+        if( !_free.empty() ) {
+            next = _free.back();
+            _free.pop_back();
+        }
+        _current = NULL;
+    }
+    unlock();
+
+    if( !_current ) {
+        _current = next ? next : new Frame();
+        _frameReady.set();
+    }
+
+    _current->particles.clear();
+    _current->events.clear();
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexRecorder::getDroppedFrames()
+{
+    lock();
+    int dropped = _dropped;
+    unlock();
+    return dropped;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexRecorder::getWrittenFrames()
+{
+    lock();
+    int written = _written;
+    unlock();
+    return written;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexRecorder::threadedFunction()
+{
+    while( isThreadRunning() ) {
+        _frameReady.tryWait( 100 );
+        writeQueued();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexRecorder::writeQueued()
+{
+    deque<Frame*> frames;
+
+    lock();
+    frames.swap( _queue );
+    unlock();
+
+    if( frames.empty() ) {
+        return;
+    }
+
+    for( unsigned int i=0; i<frames.size(); ++i ) {
+        writeFrame( frames[i] );
+    }
+    fflush( _file );
+
+    lock();
+    _written += frames.size();
+    _free.insert( _free.end(), frames.begin(), frames.end() );
+    unlock();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexRecorder::writeFrame( Frame* frame )
+{
+    vector<ofxLabFlexRecordedParticle>& particles = frame->particles;
+
+    // deltas rely on matching particles by id, in order
+    std::sort( particles.begin(), particles.end(), compareIDs );
+
+    bool keyframe = (_encodedFrames++ % _keyframeInterval) == 0;
+
+    // the size is patched in once the frame is encoded
+    _buffer.assign( 4, 0 );
+    _buffer.push_back( keyframe ? KEYFRAME : 0 );
+
+    unsigned int seconds = floatBits( frame->seconds );
+    _buffer.insert( _buffer.end(), (unsigned char*) &seconds, (unsigned char*) &seconds + 4 );
+
+    writeVarint( _buffer, particles.size() );
+    writeVarint( _buffer, frame->events.size() );
+
+    unsigned long lastID = 0;
+    unsigned int previous = 0;
+
+    for( unsigned int i=0; i<particles.size(); ++i ) {
+        const ofxLabFlexRecordedParticle& p = particles[i];
+
+        writeVarint( _buffer, p.uniqueID - lastID );
+        lastID = p.uniqueID;
+
+        // walk the previous frame alongside, both are sorted by id
+        while( previous < _previous.size() && _previous[previous].uniqueID < p.uniqueID ) {
+            ++previous;
+        }
+
+        const ofxLabFlexRecordedParticle* ref = NULL;
+        if( !keyframe && previous < _previous.size() && _previous[previous].uniqueID == p.uniqueID ) {
+            ref = &_previous[previous];
+        }
+
+        // unchanged or slowly changing floats share their high bits, so
+        // the XOR is small and the varint short
+        for( int f=0; f<ofxLabFlexRecordedParticle::NUM_FIELDS; ++f ) {
+            unsigned int bits = floatBits( p.data[f] );
+            if( ref ) {
+                bits ^= floatBits( ref->data[f] );
+            }
+            writeVarint( _buffer, bits );
+        }
+    }
+
+    for( unsigned int i=0; i<frame->events.size(); ++i ) {
+        writeVarint( _buffer, frame->events[i].uniqueID );
+        writeVarint( _buffer, (unsigned int) frame->events[i].wall );
+    }
+
+    unsigned int size = _buffer.size() - 4;
+    memcpy( &_buffer[0], &size, 4 );
+
+    fwrite( &_buffer[0], 1, _buffer.size(), _file );
+
+    _previous.swap( particles );
+}
+
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexPlayer::ofxLabFlexPlayer() :
+_currentFrame(-1),
+_system(NULL)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexPlayer::~ofxLabFlexPlayer()
+{
+    releaseParticles();
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexPlayer::load( const string& path )
+{
+    releaseParticles();
+
+    _frameOffsets.clear();
+    _frameSeconds.clear();
+    _keyframes.clear();
+    _particles.clear();
+    _previous.clear();
+    _events.clear();
+    _currentFrame = -1;
+
+    if( !_mapping.open( path ) ) {
+        return false;
+    }
+
+    const unsigned char* data = _mapping.getData();
+    size_t size = _mapping.getSize();
+
+    const ofxLabFlexRecordingHeader* header = (const ofxLabFlexRecordingHeader*) data;
+
+    if( size < sizeof(ofxLabFlexRecordingHeader) || memcmp( header->magic, "LFRC", 4 ) != 0 ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexPlayer: " + path + " is not a recording" );
+        _mapping.close();
+        return false;
+    }
+
+    if( header->version > ofxLabFlexRecorder::FILE_VERSION ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexPlayer: " + path + " was written by a newer version" );
+        _mapping.close();
+        return false;
+    }
+
+    // index the frames, a recording cut short by a crash just ends early
+    size_t offset = sizeof(ofxLabFlexRecordingHeader);
+    while( offset + 4 <= size ) {
+        unsigned int frameSize;
+        memcpy( &frameSize, data + offset, 4 );
+
+        if( frameSize < 5 || offset + 4 + frameSize > size ) {
+            break;
+        }
+
+        unsigned int seconds;
+        memcpy( &seconds, data + offset + 5, 4 );
+
+        _frameOffsets.push_back( offset + 4 );
+        _keyframes.push_back( (data[offset + 4] & KEYFRAME) != 0 );
+        _frameSeconds.push_back( bitsFloat( seconds ) );
+
+        offset += 4 + frameSize;
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexPlayer::getNumFrames() const
+{
+    return _frameOffsets.size();
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexPlayer::getFrameSeconds( int frame ) const
+{
+    if( frame < 0 || frame >= (int)_frameSeconds.size() ) {
+        return 0;
+    }
+    return _frameSeconds[frame];
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexPlayer::getCurrentFrame() const
+{
+    return _currentFrame;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPlayer::seekFrame( int frame )
+{
+    if( _frameOffsets.empty() ) {
+        return;
+    }
+
+    frame = MAX( 0, MIN( frame, (int)_frameOffsets.size() - 1 ) );
+
+    if( frame == _currentFrame ) {
+        return;
+    }
+
+    int start = _currentFrame + 1;
+
+    if( frame < start || !_keyframes[frame] ) {
+        // find the keyframe this frame depends on, unless we can just roll forward
+        int keyframe = frame;
+        while( keyframe > 0 && !_keyframes[keyframe] ) {
+            --keyframe;
+        }
+        if( frame < start || keyframe > start ) {
+            start = keyframe;
+        }
+    } else {
+        start = frame;
+    }
+
+    for( int i=start; i<=frame; ++i ) {
+        decodeFrame( i );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPlayer::seekSeconds( float seconds )
+{
+    if( _frameSeconds.empty() ) {
+        return;
+    }
+
+    // last frame recorded at or before this time
+    vector<float>::const_iterator it = std::upper_bound( _frameSeconds.begin(), _frameSeconds.end(), seconds );
+    int frame = (int)(it - _frameSeconds.begin()) - 1;
+
+    seekFrame( MAX( 0, frame ) );
+}
+
+
+//------------------------------------------------------------------------------------
+const vector<ofxLabFlexRecordedParticle>& ofxLabFlexPlayer::getParticles() const
+{
+    return _particles;
+}
+
+
+//------------------------------------------------------------------------------------
+const vector<ofxLabFlexRecordedWallEvent>& ofxLabFlexPlayer::getWallEvents() const
+{
+    return _events;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPlayer::decodeFrame( int frame )
+{
+    const unsigned char* data = _mapping.getData() + _frameOffsets[frame];
+
+    unsigned int frameSize;
+    memcpy( &frameSize, data - 4, 4 );
+    const unsigned char* end = data + frameSize;
+
+    bool keyframe = (*data & KEYFRAME) != 0;
+    data += 5;
+
+    // the frame we are leaving becomes the reference for the deltas
+    _previous.swap( _particles );
+
+    unsigned int numParticles = readVarint( data, end );
+    unsigned int numEvents    = readVarint( data, end );
+
+    _particles.resize( numParticles );
+
+    unsigned long lastID = 0;
+    unsigned int previous = 0;
+
+    for( unsigned int i=0; i<numParticles; ++i ) {
+        ofxLabFlexRecordedParticle& p = _particles[i];
+
+        p.uniqueID = lastID + (unsigned long) readVarint( data, end );
+        lastID = p.uniqueID;
+
+        while( previous < _previous.size() && _previous[previous].uniqueID < p.uniqueID ) {
+            ++previous;
+        }
+
+        const ofxLabFlexRecordedParticle* ref = NULL;
+        if( !keyframe && previous < _previous.size() && _previous[previous].uniqueID == p.uniqueID ) {
+            ref = &_previous[previous];
+        }
+
+        for( int f=0; f<ofxLabFlexRecordedParticle::NUM_FIELDS; ++f ) {
+            unsigned int bits = (unsigned int) readVarint( data, end );
+            if( ref ) {
+                bits ^= floatBits( ref->data[f] );
+            }
+            p.data[f] = bitsFloat( bits );
+        }
+    }
+
+    _events.resize( numEvents );
+    for( unsigned int i=0; i<numEvents; ++i ) {
+        _events[i].uniqueID = (unsigned long) readVarint( data, end );
+        _events[i].wall = (int)(unsigned int) readVarint( data, end );
+    }
+
+    _currentFrame = frame;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPlayer::apply( ofxLabFlexParticleSystem& system )
+{
+    if( _system && _system != &system ) {
+        releaseParticles();
+    }
+    _system = &system;
+
+    map<unsigned long, ofxLabFlexParticle*> shown;
+
+    for( unsigned int i=0; i<_particles.size(); ++i ) {
+        const ofxLabFlexRecordedParticle& r = _particles[i];
+
+        ofxLabFlexParticle* p;
+
+        map<unsigned long, ofxLabFlexParticle*>::iterator it = _replayed.find( r.uniqueID );
+        if( it != _replayed.end() ) {
+            p = it->second;
+            _replayed.erase( it );
+        } else {
+            p = new ofxLabFlexParticle();
+            system.addParticle( p );
+        }
+
+        p->set( r.data[ofxLabFlexRecordedParticle::POS_X],
+                r.data[ofxLabFlexRecordedParticle::POS_Y] );
+        p->velocity.set( r.data[ofxLabFlexRecordedParticle::VELOCITY_X],
+                         r.data[ofxLabFlexRecordedParticle::VELOCITY_Y] );
+        p->radius = r.data[ofxLabFlexRecordedParticle::RADIUS];
+        p->rotation.set( r.data[ofxLabFlexRecordedParticle::ROTATION_X],
+                         r.data[ofxLabFlexRecordedParticle::ROTATION_Y],
+                         r.data[ofxLabFlexRecordedParticle::ROTATION_Z] );
+
+        shown[r.uniqueID] = p;
+    }
+
+    // whatever is left wasn't in this frame
+    _replayed.swap( shown );
+    releaseParticles( shown );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPlayer::releaseParticles()
+{
+    map<unsigned long, ofxLabFlexParticle*> particles;
+    particles.swap( _replayed );
+    releaseParticles( particles );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexPlayer::releaseParticles( map<unsigned long, ofxLabFlexParticle*>& particles )
+{
+    map<unsigned long, ofxLabFlexParticle*>::iterator it;
+    for( it = particles.begin(); it != particles.end(); ++it ) {
+        if( _system && !_system->removeParticle( it->second->getUniqueID() ) ) {
+            // the system is busy, keep it and try again rather than leave it dangling
+            _replayed[it->first] = it->second;
+            continue;
+        }
+        delete it->second;
+    }
+    particles.clear();
+}
@@ -0,0 +1,274 @@
+//
+//  ofxLabFlexScheduler.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexScheduler.h"
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexScheduler::ofxLabFlexScheduler( ofxLabFlexThreadPool* pool ) :
+_pool(pool),
+_numDone(0)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexScheduler::~ofxLabFlexScheduler()
+{
+    for( unsigned int i=0; i<_queues.size(); ++i ) {
+        delete _queues[i];
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexScheduler::setThreadPool( ofxLabFlexThreadPool* pool )
+{
+    _pool = pool;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexScheduler::addTask( const Task& task )
+{
+    TaskInfo info;
+    info.func               = task;
+    info.numDependencies    = 0;
+    _tasks.push_back( info );
+
+    return _tasks.size() - 1;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexScheduler::addSystem( ofxLabFlexParticleSystem* system )
+{
+    return addTask( std::tr1::bind( &ofxLabFlexParticleSystem::update, system ) );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexScheduler::addDependency( int task,
+                                         int before )
+{
+    int count = _tasks.size();
+    if( task < 0 || task >= count || before < 0 || before >= count || task == before ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexScheduler: invalid dependency" );
+        return;
+    }
+
+    _tasks[before].dependents.push_back( task );
+    ++_tasks[task].numDependencies;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexScheduler::clear()
+{
+    _tasks.clear();
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexScheduler::getNumTasks() const
+{
+    return _tasks.size();
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexScheduler::run()
+{
+    if( _tasks.empty() ) {
+        return true;
+    }
+
+    if( !checkOrder() ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexScheduler: task dependencies form a loop" );
+        return false;
+    }
+
+    int threads = _pool ? _pool->getNumThreads() + 1 : 1;
+
+    while( (int) _queues.size() < threads ) {
+        _queues.push_back( new Queue() );
+    }
+
+    _numDone = 0;
+    _waitingOn.resize( _tasks.size() );
+
+    // tasks with nothing to wait for are dealt out to the threads
+    int next = 0;
+    for( unsigned int i=0; i<_tasks.size(); ++i ) {
+        _waitingOn[i] = _tasks[i].numDependencies;
+        if( _waitingOn[i] == 0 ) {
+            _queues[next]->tasks.push_back( i );
+            next = (next + 1) % threads;
+        }
+    }
+
+    if( _pool && threads > 1 ) {
+        using namespace std::tr1::placeholders;
+        _pool->parallelForThreads( threads, std::tr1::bind( &ofxLabFlexScheduler::runWorker, this, _1, _2, _3 ), 1 );
+    } else {
+        runWorker( 0, 1, 0 );
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexScheduler::checkOrder() const
+{
+    int count = _tasks.size();
+    vector<int> waiting( count );
+    vector<int> ready;
+
+    for( int i=0; i<count; ++i ) {
+        waiting[i] = _tasks[i].numDependencies;
+        if( waiting[i] == 0 ) {
+            ready.push_back( i );
+        }
+    }
+
+    int reached = 0;
+    while( !ready.empty() ) {
+        int task = ready.back();
+        ready.pop_back();
+        ++reached;
+
+        const vector<int>& dependents = _tasks[task].dependents;
+        for( unsigned int d=0; d<dependents.size(); ++d ) {
+            if( --waiting[dependents[d]] == 0 ) {
+                ready.push_back( dependents[d] );
+            }
+        }
+    }
+
+    return reached == count;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexScheduler::runWorker( int /*begin*/,
+                                     int /*end*/,
+                                     int thread )
+{
+    // the pool may hand one thread two of the ranges, it only works one
+    // queue, the other queue gets emptied by stealing
+    int total = _tasks.size();
+
+    while( true ) {
+        int task;
+        if( popTask( thread, task ) ) {
+            _tasks[task].func();
+            finishTask( task, thread );
+            continue;
+        }
+
+        _stateLock.lock();
+        bool done = _numDone == total;
+        _stateLock.unlock();
+
+        if( done || !_pool ) {
+            return;
+        }
+
+        // everything left is running or waiting on something running, help
+        // the running tasks with their loops or sleep until one finishes
+        if( !_pool->help() ) {
+            _pool->waitForWork( std::tr1::bind( &ofxLabFlexScheduler::hasWork, this ) );
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexScheduler::hasWork()
+{
+    _stateLock.lock();
+    bool done = _numDone == (int) _tasks.size();
+    _stateLock.unlock();
+
+    if( done ) {
+        return true;
+    }
+
+    for( unsigned int i=0; i<_queues.size(); ++i ) {
+        Poco::ScopedLock<ofMutex> lock( _queues[i]->lock );
+        if( !_queues[i]->tasks.empty() ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexScheduler::popTask( int thread,
+                                   int& task )
+{
+    int threads = _queues.size();
+
+    // own queue newest first, it is the work this thread just unblocked
+    Queue* own = _queues[thread];
+    own->lock.lock();
+    if( !own->tasks.empty() ) {
+        task = own->tasks.back();
+        own->tasks.pop_back();
+        own->lock.unlock();
+        return true;
+    }
+    own->lock.unlock();
+
+    // steal the oldest from the others
+    for( int i=1; i<threads; ++i ) {
+        Queue* victim = _queues[(thread + i) % threads];
+        victim->lock.lock();
+        if( !victim->tasks.empty() ) {
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+            victim->lock.unlock();
+            return true;
+        }
+        victim->lock.unlock();
+    }
+
+    return false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexScheduler::finishTask( int task,
+                                      int thread )
+{
+    vector<int> unblocked;
+
+    _stateLock.lock();
+    const vector<int>& dependents = _tasks[task].dependents;
+    for( unsigned int d=0; d<dependents.size(); ++d ) {
+        if( --_waitingOn[dependents[d]] == 0 ) {
+            unblocked.push_back( dependents[d] );
+        }
+    }
+    bool done = ++_numDone == (int) _tasks.size();
+    _stateLock.unlock();
+
+    if( !unblocked.empty() ) {
+        Queue* own = _queues[thread];
+        own->lock.lock();
+        for( unsigned int i=0; i<unblocked.size(); ++i ) {
+            own->tasks.push_back( unblocked[i] );
+        }
+        own->lock.unlock();
+    }
+
+    // the sleeping threads have something to take, or can return
+    if( _pool && (done || !unblocked.empty()) ) {
+        _pool->wake();
+    }
+}
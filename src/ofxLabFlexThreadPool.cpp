@@ -0,0 +1,392 @@
+//
+//  ofxLabFlexThreadPool.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexThreadPool.h"
+
+#include <algorithm>
+
+#if defined _WIN64 || defined _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// semaphores need a ceiling, more workers than this are never started
+static const int MAX_THREADS = 256;
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexThreadPool::ofxLabFlexThreadPool( int numThreads ) :
+_bStopping(false),
+_bInLoop(false),
+_func(NULL),
+_threadFunc(NULL),
+_count(0),
+_grain(1),
+_next(0),
+_running(0),
+_start(0, MAX_THREADS),
+_finished(0, MAX_THREADS),
+_numWakes(0)
+{
+    if( numThreads < 0 ) {
+        numThreads = getNumCores() - 1;
+    }
+    numThreads = MIN( numThreads, MAX_THREADS );
+
+    for( int i=0; i<numThreads; ++i ) {
+        Worker* worker = new Worker( this, i );
+        worker->startThread( true, false );
+        _workers.push_back( worker );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexThreadPool::~ofxLabFlexThreadPool()
+{
+    _bStopping = true;
+
+    for( unsigned int i=0; i<_workers.size(); ++i ) {
+        _workers[i]->stopThread();
+        _start.set();
+    }
+
+    for( unsigned int i=0; i<_workers.size(); ++i ) {
+        _workers[i]->waitForThread( false );
+        delete _workers[i];
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexThreadPool::getNumThreads() const
+{
+    return _workers.size();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexThreadPool::parallelFor( int count,
+                                        const RangeFunction& func,
+                                        int grain )
+{
+    run( count, &func, NULL, grain );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexThreadPool::parallelForThreads( int count,
+                                               const ThreadRangeFunction& func,
+                                               int grain )
+{
+    run( count, NULL, &func, grain );
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexThreadPool::getNumCores()
+{
+#if defined _WIN64 || defined _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    int cores = info.dwNumberOfProcessors;
+#else
+    int cores = (int) sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+    return MAX( 1, cores );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexThreadPool::run( int count,
+                                const RangeFunction* func,
+                                const ThreadRangeFunction* threadFunc,
+                                int grain )
+{
+    if( count <= 0 ) {
+        return;
+    }
+
+    int threads = _workers.size() + 1;
+
+    if( grain <= 0 ) {
+        grain = (count + threads - 1) / threads;
+    }
+
+    // not worth waking anyone up, the caller does it all as the last
+    // thread index
+    if( _workers.empty() || grain >= count ) {
+        if( func ) {
+            (*func)( 0, count );
+        } else {
+            (*threadFunc)( 0, count, _workers.size() );
+        }
+        return;
+    }
+
+    // the workers are busy with another loop, possibly the one calling us
+    // (see ofxLabFlexScheduler), so this one is shared with idle threads
+    _rangeLock.lock();
+    bool nested = _bInLoop;
+    if( !nested ) {
+        _bInLoop    = true;
+        _func       = func;
+        _threadFunc = threadFunc;
+        _count      = count;
+        _grain      = grain;
+        _next       = 0;
+        _running    = 0;
+    }
+    _rangeLock.unlock();
+
+    if( nested ) {
+        runNested( count, func, threadFunc, grain );
+        return;
+    }
+
+    for( unsigned int i=0; i<_workers.size(); ++i ) {
+        _start.set();
+    }
+
+    runRanges( _workers.size() );
+
+    // every worker checks in, even the ones that found no work left
+    for( unsigned int i=0; i<_workers.size(); ++i ) {
+        _finished.wait();
+    }
+
+    _rangeLock.lock();
+    _func = NULL;
+    _threadFunc = NULL;
+    _bInLoop = false;
+    _rangeLock.unlock();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexThreadPool::runNested( int count,
+                                      const RangeFunction* func,
+                                      const ThreadRangeFunction* threadFunc,
+                                      int grain )
+{
+    Poco::Semaphore done( 0, 1 );
+
+    NestedLoop loop;
+    loop.func       = func;
+    loop.threadFunc = threadFunc;
+    loop.count      = count;
+    loop.grain      = grain;
+    loop.next       = 0;
+    loop.running    = 0;
+    loop.bWaiting   = false;
+    loop.done       = &done;
+
+    // the caller is thread index 0, helpers take the others
+    loop.slots.assign( _workers.size() + 1, false );
+    loop.slots[0] = true;
+
+    _rangeLock.lock();
+    _nested.push_back( &loop );
+    _rangeLock.unlock();
+
+    wake();
+
+    while( true ) {
+        _rangeLock.lock();
+        int begin = loop.next;
+        loop.next = MIN( count, loop.next + grain );
+        int end = loop.next;
+        _rangeLock.unlock();
+
+        if( begin >= end ) {
+            break;
+        }
+
+        if( func ) {
+            (*func)( begin, end );
+        } else {
+            (*threadFunc)( begin, end, 0 );
+        }
+    }
+
+    // nothing left to hand out, wait for the helpers still running ranges
+    _rangeLock.lock();
+    _nested.erase( std::find( _nested.begin(), _nested.end(), &loop ) );
+    loop.bWaiting = loop.running > 0;
+    bool wait = loop.bWaiting;
+    _rangeLock.unlock();
+
+    if( wait ) {
+        done.wait();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexThreadPool::help()
+{
+    _rangeLock.lock();
+
+    int slot;
+    NestedLoop* loop = findNestedLoop( slot );
+    if( !loop ) {
+        _rangeLock.unlock();
+        return false;
+    }
+
+    int begin = loop->next;
+    loop->next = MIN( loop->count, loop->next + loop->grain );
+    int end = loop->next;
+    loop->slots[slot] = true;
+    ++loop->running;
+    _rangeLock.unlock();
+
+    if( loop->func ) {
+        (*loop->func)( begin, end );
+    } else {
+        (*loop->threadFunc)( begin, end, slot );
+    }
+
+    // the loop lives on its caller's stack, only touch it under the lock
+    // until the caller is released
+    _rangeLock.lock();
+    loop->slots[slot] = false;
+    --loop->running;
+    Poco::Semaphore* done = loop->running == 0 && loop->bWaiting ? loop->done : NULL;
+    _rangeLock.unlock();
+
+    if( done ) {
+        done->set();
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexThreadPool::waitForWork( const std::tr1::function<bool ()>& hasWork )
+{
+    _idleLock.lock();
+
+    // checked under _idleLock, so a wake() for work that turns up after
+    // this is waited for, not missed
+    int slot;
+    _rangeLock.lock();
+    bool nestedWork = findNestedLoop( slot ) != NULL;
+    _rangeLock.unlock();
+
+    // a counter rather than a semaphore, so a thread arriving late can't
+    // take the wake up meant for one already asleep
+    unsigned int wakes = _numWakes;
+    if( !nestedWork && !hasWork() ) {
+        while( wakes == _numWakes ) {
+            _idle.wait( _idleLock );
+        }
+    }
+
+    _idleLock.unlock();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexThreadPool::wake()
+{
+    Poco::ScopedLock<ofMutex> lock( _idleLock );
+    ++_numWakes;
+    _idle.broadcast();
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexThreadPool::NestedLoop* ofxLabFlexThreadPool::findNestedLoop( int& slot ) const
+{
+    for( unsigned int i=0; i<_nested.size(); ++i ) {
+        NestedLoop* loop = _nested[i];
+        if( loop->next >= loop->count ) {
+            continue;
+        }
+        // index 0 is the loop's caller
+        for( unsigned int s=1; s<loop->slots.size(); ++s ) {
+            if( !loop->slots[s] ) {
+                slot = s;
+                return loop;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexThreadPool::isLoopFinished()
+{
+    Poco::ScopedLock<ofMutex> lock( _rangeLock );
+    return _next >= _count && _running == 0;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexThreadPool::runRanges( int thread )
+{
+    while( true ) {
+        _rangeLock.lock();
+        int begin = _next;
+        _next = MIN( _count, _next + _grain );
+        int end = _next;
+        const RangeFunction* func = _func;
+        const ThreadRangeFunction* threadFunc = _threadFunc;
+        if( begin < end ) {
+            ++_running;
+        }
+        _rangeLock.unlock();
+
+        if( begin >= end ) {
+            break;
+        }
+
+        if( func ) {
+            (*func)( begin, end );
+        } else {
+            (*threadFunc)( begin, end, thread );
+        }
+
+        _rangeLock.lock();
+        bool last = --_running == 0 && _next >= _count;
+        _rangeLock.unlock();
+
+        // the threads waiting below can go
+        if( last ) {
+            wake();
+        }
+    }
+
+    // the ranges still running may start loops of their own, help with
+    // those instead of sitting idle
+    while( true ) {
+        if( help() ) {
+            continue;
+        }
+        if( isLoopFinished() ) {
+            return;
+        }
+        waitForWork( std::tr1::bind( &ofxLabFlexThreadPool::isLoopFinished, this ) );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexThreadPool::Worker::threadedFunction()
+{
+    while( true ) {
+        _pool->_start.wait();
+
+        if( _pool->_bStopping ) {
+            return;
+        }
+
+        _pool->runRanges( _index );
+        _pool->_finished.set();
+    }
+}
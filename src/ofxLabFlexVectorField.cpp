@@ -8,6 +8,100 @@ const float ofxLabFlexVectorField::BASELINE_SCALE          = 0.2f;
 // default internal to external scale, pixels to internal mapping
 const float ofxLabFlexVectorField::DEFAULT_SCALE           = 0.1f;
 
+// default magnitude the fixed point storage types can hold
+const float ofxLabFlexVectorField::DEFAULT_FIXED_RANGE     = 10.0f;
+
+// binary file format
+const unsigned int ofxLabFlexVectorField::FILE_VERSION     = 1;
+const unsigned int ofxLabFlexVectorField::FILE_ALIGNMENT   = 4096;
+
+// draw() lines per cell: an origin cross, the force and its base line
+static const int DRAW_VERTS_PER_CELL = 8;
+
+// largest finite half precision value
+static const float HALF_MAX = 65504.0f;
+
+// fadeField() only scales the decay until it drops below this, then the
+// cells are rescaled.  Float cells keep their precision at any scale and
+// only the decay itself must not underflow; half cells hold force / decay
+// and must not overflow; fixed point cells must leave room for new forces
+static float renormalizeBelow( ofxLabFlexVectorField::StorageType storage )
+{
+    switch( storage ) {
+        case ofxLabFlexVectorField::FLOAT_16:   return 1.0f / 64.0f;
+        case ofxLabFlexVectorField::FIXED_16:
+        case ofxLabFlexVectorField::FIXED_8:    return 0.5f;
+        default:                                return 1e-6f;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+// IEEE 754 half precision helpers for the FLOAT_16 storage type.  Rounds to
+// nearest even, overflows to infinity and flushes half denormals to zero, which
+// is well below anything the field can meaningfully hold.
+static unsigned short floatToHalf( float value )
+{
+    unsigned int bits;
+    memcpy( &bits, &value, sizeof(bits) );
+    
+    unsigned int sign     = (bits >> 16) & 0x8000;
+    int          exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x007fffff;
+    
+    if( exponent <= 0 ) {
+        return (unsigned short) sign;
+    }
+    
+    if( exponent >= 0x1f ) {
+        // keep NaN a NaN, everything else saturates to infinity
+        if( ((bits >> 23) & 0xff) == 0xff && mantissa ) {
+            return (unsigned short)(sign | 0x7e00);
+        }
+        return (unsigned short)(sign | 0x7c00);
+    }
+    
+    unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+    
+    // round to nearest even, a carry into the exponent is still correct
+    unsigned int rest = mantissa & 0x1fff;
+    if( rest > 0x1000 || (rest == 0x1000 && (half & 1)) ) {
+        ++half;
+    }
+    
+    return (unsigned short) half;
+}
+
+static float halfToFloat( unsigned short half )
+{
+    unsigned int sign     = (unsigned int)(half & 0x8000) << 16;
+    unsigned int exponent = (half >> 10) & 0x1f;
+    unsigned int mantissa = half & 0x03ff;
+    unsigned int bits;
+    
+    if( exponent == 0 ) {
+        bits = sign;
+    } else if( exponent == 0x1f ) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    
+    float value;
+    memcpy( &value, &bits, sizeof(value) );
+    return value;
+}
+
+// clamps and rounds a force component onto a fixed point step
+static int floatToFixed( float value,
+                         float invStep,
+                         int limit )
+{
+    float steps = value * invStep;
+    int fixed = (int)(steps < 0 ? steps - 0.5f : steps + 0.5f);
+    return MAX( -limit, MIN( fixed, limit ) );
+}
+
 
 //------------------------------------------------------------------------------------
 ofxLabFlexVectorField::ofxLabFlexVectorField() :
@@ -21,7 +115,20 @@ _scale(1),
 _field(),
 _sinPowerValue(1),
 _bUseSinMap(false),
-_bClampSinPositive(false)
+_bClampSinPositive(false),
+_storage(FLOAT_32),
+_fixedRange(DEFAULT_FIXED_RANGE),
+_fixedStep(1),
+_fixedInvStep(1),
+_mappedCells(NULL),
+_decay(1),
+_writtenMinX(0),
+_writtenMinY(0),
+_writtenMaxX(-1),
+_writtenMaxY(-1),
+_bDrawDirty(false),
+_bDrawIndicesDirty(true),
+_drawDecay(1)
 
 {
 	
@@ -38,7 +145,9 @@ ofxLabFlexVectorField::~ofxLabFlexVectorField(){
 void ofxLabFlexVectorField::setupField( int externalWidth, 
                                         int externalHeight,
                                         int fieldWidth, 
-                                        int fieldHeight ) 
+                                        int fieldHeight,
+                                        StorageType storage,
+                                        float fixedRange )
 {
 	
     if( fieldWidth == 0 || fieldHeight == 0 ) {
@@ -46,53 +155,183 @@ void ofxLabFlexVectorField::setupField( int externalWidth,
         fieldHeight = externalHeight * DEFAULT_SCALE;
     }
     
+    setupDimensions( externalWidth, externalHeight, fieldWidth, fieldHeight, storage, fixedRange );
+
+    if( _storage == FLOAT_32 ) {
+        _field.assign( _fieldSize, ofVec2f(0,0) );
+    } else {
+        // every compact type encodes zero as all zero bits
+        _packed.assign( _fieldSize * getBytesPerCell(), 0 );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::setupDimensions( int externalWidth,
+                                             int externalHeight,
+                                             int fieldWidth,
+                                             int fieldHeight,
+                                             StorageType storage,
+                                             float fixedRange )
+{
 	_fieldWidth		= fieldWidth;
 	_fieldHeight	= fieldHeight;
 	_externalWidth	= externalWidth;
 	_externalHeight = externalHeight;
 	
 	_field.clear();
+    _packed.clear();
+    
+    // setting up always goes back to memory we own
+    _mapping.reset();
+    _mappedCells = NULL;
 	
 	_fieldSize = _fieldWidth * _fieldHeight;
-
-    for(int i=0; i<_fieldSize; ++i) {
-        _field.push_back( ofVec2f(0,0) );
+    
+    _storage = storage;
+    _fixedRange = fixedRange > 0 ? fixedRange : DEFAULT_FIXED_RANGE;
+    
+    switch( _storage ) {
+        case FIXED_16:  _fixedStep = _fixedRange / 32767.0f;    break;
+        case FIXED_8:   _fixedStep = _fixedRange / 127.0f;      break;
+        default:        _fixedStep = 1.0f;                      break;
     }
+    _fixedInvStep = 1.0f / _fixedStep;
     
     _horShiftPct = 0.0f;
     _scale = 1.0f;
+    _decay = 1.0f;
+    
+    // whatever the cells get filled with
+    markAllWritten();
+    
+    // new layout, the draw mesh starts over
+    _drawMesh.clear();
+    _drawForces.clear();
+    _bDrawIndicesDirty = true;
+    markAllDirty();
 }
 
 
 //------------------------------------------------------------------------------------
 void ofxLabFlexVectorField::zeroField()
 {
+    if( _fieldSize == 0 || _writtenMaxX < _writtenMinX ) {
+        return;
+    }
     
-	vector<ofVec2f>::iterator it;
-	for(it = _field.begin(); it != _field.end(); ++it) {
-		it->set(0, 0);
-	}
+    // every storage type encodes zero as all zero bits, and only the cells
+    // written since the last zeroField() can be anything else
+    int bytesPerCell = getBytesPerCell();
+    unsigned char* cells = cellData();
+    
+    if( _writtenMinX == 0 && _writtenMaxX == _fieldWidth - 1 ) {
+        memset( cells + _writtenMinY * _fieldWidth * bytesPerCell, 0,
+                (_writtenMaxY - _writtenMinY + 1) * _fieldWidth * bytesPerCell );
+    } else {
+        for( int yy = _writtenMinY; yy <= _writtenMaxY; ++yy ) {
+            memset( cells + (yy * _fieldWidth + _writtenMinX) * bytesPerCell, 0,
+                    (_writtenMaxX - _writtenMinX + 1) * bytesPerCell );
+        }
+    }
+    
+    _decay = 1.0f;
+    _writtenMaxX = _writtenMinX - 1;
+    markAllDirty();
 }
 
 //------------------------------------------------------------------------------------
 void ofxLabFlexVectorField::fadeField(float fadeAmount)
 {
     
-	vector<ofVec2f>::iterator it;
-	for(it = _field.begin(); it != _field.end(); ++it) {
-		it->set(it->x * fadeAmount, it->y * fadeAmount);
-	}
+    if( _fieldSize == 0 ) {
+        return;
+    }
+    
+    // only the decay changes, getCell() and draw() apply it
+    _decay *= fadeAmount;
+    
+    if( _decay < renormalizeBelow( _storage ) ) {
+        renormalize();
+    }
+}
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::renormalize()
+{
+    if( _decay == 1.0f || _fieldSize == 0 ) {
+        _decay = 1.0f;
+        return;
+    }
+    
+    scaleCells( cellData(), cellData(), _decay );
+    
+    // the cached lines follow the cells, and the lines already placed
+    // stay where they are
+    for( int i = 0; i < (int) _drawForces.size(); i++ ) {
+        _drawForces[i] *= _decay;
+    }
+    _drawDecay /= _decay;
+    
+    _decay = 1.0f;
+}
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::scaleCells( const unsigned char* from,
+                                        unsigned char* to,
+                                        float scale ) const
+{
+    // scale the compact types directly, without going through ofVec2f
+    if( _storage == FIXED_16 ) {
+        const short* cell = (const short*) from;
+        const short* end  = cell + _fieldSize * 2;
+        short* out = (short*) to;
+        for( ; cell != end; ++cell, ++out ) {
+            float scaled = *cell * scale;
+            *out = (short) MAX( -32767, MIN( (int)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f), 32767 ) );
+        }
+    } else if( _storage == FIXED_8 ) {
+        const signed char* cell = (const signed char*) from;
+        const signed char* end  = cell + _fieldSize * 2;
+        signed char* out = (signed char*) to;
+        for( ; cell != end; ++cell, ++out ) {
+            float scaled = *cell * scale;
+            *out = (signed char) MAX( -127, MIN( (int)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f), 127 ) );
+        }
+    } else if( _storage == FLOAT_16 ) {
+        const unsigned short* cell = (const unsigned short*) from;
+        const unsigned short* end  = cell + _fieldSize * 2;
+        unsigned short* out = (unsigned short*) to;
+        for( ; cell != end; ++cell, ++out ) {
+            *out = floatToHalf( halfToFloat( *cell ) * scale );
+        }
+    } else {
+        const ofVec2f* cell = (const ofVec2f*) from;
+        const ofVec2f* end  = cell + _fieldSize;
+        ofVec2f* out = (ofVec2f*) to;
+        for( ; cell != end; ++cell, ++out ) {
+            out->set( cell->x * scale, cell->y * scale );
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::markAllWritten()
+{
+    _writtenMinX = 0;
+    _writtenMinY = 0;
+    _writtenMaxX = _fieldWidth - 1;
+    _writtenMaxY = _fieldHeight - 1;
 }
 
 //------------------------------------------------------------------------------------
 void ofxLabFlexVectorField::randomizeField(float range)
 {
-	vector<ofVec2f>::iterator it;
-	for(it = _field.begin(); it != _field.end(); ++it) {
+	for(int i = 0; i < _fieldSize; ++i) {
 		// random between -1 and 1
 		float x = (float)(ofRandom(-1,1)) * range;
 		float y = (float)(ofRandom(-1,1)) * range;
-		it->set(x,y);
+		setCell(i, ofVec2f(x,y));
 	}
 }
 
@@ -103,70 +342,101 @@ void ofxLabFlexVectorField::setHorizontalShift( float shiftPct ) {
         shiftPct -= floor(shiftPct);
     }
     _horShiftPct = shiftPct;
+    markAllDirty();
 }
 
 //------------------------------------------------------------------------------------
 void ofxLabFlexVectorField::setScale( float scale ) {
     _scale = scale;
+    markAllDirty();
 }
 
 void ofxLabFlexVectorField::setExternalOffset( ofVec2f offset ) {
     _externalOffset = offset;
+    _bDrawIndicesDirty = true;
+    markAllDirty();
 }
 
 
 //------------------------------------------------------------------------------------
 void ofxLabFlexVectorField::draw( const ofRectangle& cropSection )
 {
-    ofSetColor(0, 0, 0);
+    if( _fieldSize == 0 ) {
+        return;
+    }
     
-	float scaledX = _externalWidth / _fieldWidth;
-	float scaledY = _externalHeight / _fieldHeight;
-	
-    int startXX;
-    int startYY;
-    int endXX;
-    int endYY;
+    updateDrawRows();
     
-    if( cropSection.width == 0 || cropSection.height == 0 ) {
-        
-        startXX = _externalOffset.x / scaledX;
-        startYY = _externalOffset.y / scaledY;
-        
-        endXX = _fieldWidth / scaledX;
-        endYY = _fieldHeight / scaledY;
+    if( _bDrawIndicesDirty ||
+        cropSection.x != _drawCrop.x || cropSection.y != _drawCrop.y ||
+        cropSection.width != _drawCrop.width || cropSection.height != _drawCrop.height ) {
+        updateDrawIndices( cropSection );
+    }
+    
+    if( _drawMesh.getNumIndices() == 0 ) {
+        return;
+    }
+    
+    ofSetColor(0, 0, 0);
+    _drawMesh.draw();
+}
 
-    } else {
-        
-        startXX = (cropSection.x + _externalOffset.x) / scaledX;
-        startYY = (cropSection.y + _externalOffset.y) / scaledY;
-        
-        endXX = startXX + cropSection.width / scaledX;
-        endYY = startYY + cropSection.height / scaledY;
-        
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::markAllDirty()
+{
+    _dirtyRows.assign( _fieldHeight, 1 );
+    _bDrawDirty = true;
+}
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::updateDrawRows()
+{
+    // a faded field keeps its rows, the cached lines are only scaled again
+    if( _drawDecay != _decay ) {
+        _drawDecay = _decay;
+        if( (int) _drawForces.size() == _fieldSize ) {
+            for( int i = 0; i < _fieldSize; i++ ) {
+                placeForceLine( i );
+            }
+        }
     }
     
-    startXX = MAX(0, startXX);
-    startYY = MAX(0, startYY);
+    if( !_bDrawDirty ) {
+        return;
+    }
+    _bDrawDirty = false;
     
-    endXX = MIN(_fieldWidth, endXX);
-    endYY = MIN(_fieldHeight, endYY);
+    vector<ofVec3f>& vertices = _drawMesh.getVertices();
+    if( (int) vertices.size() != _fieldSize * DRAW_VERTS_PER_CELL ) {
+        _drawMesh.setMode( OF_PRIMITIVE_LINES );
+        vertices.resize( _fieldSize * DRAW_VERTS_PER_CELL );
+    }
+    _drawForces.resize( _fieldSize );
     
-	// loop y to x to optimize reading of our vector in cache
-	for(int yy=startYY; yy < endYY; ++yy) {
-		for(int xx=startXX; xx < endXX; ++xx) {
+	float scaledX = (float) _externalWidth / _fieldWidth;
+	float scaledY = (float) _externalHeight / _fieldHeight;
+    
+	for(int yy=0; yy < _fieldHeight; ++yy) {
+        if( !_dirtyRows[yy] ) {
+            continue;
+        }
+        _dirtyRows[yy] = 0;
+        
+		for(int xx=0; xx < _fieldWidth; ++xx) {
 			
             // shift index as needed
             int shiftXX;
             shiftXX = ((int) (xx + _horShiftPct * _fieldWidth )) % _fieldWidth;
-			int vecPos = yy * (endXX - startXX) + shiftXX;
+			int vecPos = yy * _fieldWidth + shiftXX;
 		
 			// get our main force line
 			ofPoint forceOrigin(xx * scaledX - _externalOffset.x,
                                 yy * scaledY - _externalOffset.y);
 			
-			ofPoint forceEnd(forceOrigin);
+			// the line as stored, placeForceLine() applies the decay
+			ofVec2f force;
             
+            ofVec2f cell = getStoredCell(vecPos);
             
             if( _bUseSinMap ) {
                 
@@ -188,33 +458,97 @@ void ofxLabFlexVectorField::draw( const ofRectangle& cropSection )
                     sinY = MAX(0, sinY);
                 }
                 
-                forceEnd.x += _field[vecPos].x * FORCE_DISPLAY_SCALE * _scale * sinX;
-                forceEnd.y += _field[vecPos].y * FORCE_DISPLAY_SCALE * _scale * sinY;
+                force.x = cell.x * FORCE_DISPLAY_SCALE * _scale * sinX;
+                force.y = cell.y * FORCE_DISPLAY_SCALE * _scale * sinY;
                 
             } else {
-                forceEnd.x += _field[vecPos].x * FORCE_DISPLAY_SCALE * _scale;
-                forceEnd.y += _field[vecPos].y * FORCE_DISPLAY_SCALE * _scale;
+                force.x = cell.x * FORCE_DISPLAY_SCALE * _scale;
+                force.y = cell.y * FORCE_DISPLAY_SCALE * _scale;
             }
-            
-            ofEllipse(forceOrigin.x, forceOrigin.y, 2, 2);
 			
-			ofLine(forceOrigin.x, forceOrigin.y,
-                   forceEnd.x, forceEnd.y);
+			int index = yy * _fieldWidth + xx;
+			_drawForces[index] = force;
 			
-			// draw peprendicular base line
-			ofVec2f baseLine;
-			baseLine.set(forceEnd.x - forceOrigin.x,
-                         forceEnd.y - forceOrigin.y);
-            
-			float forceLength = baseLine.length();
-			baseLine.normalize();
-			baseLine.rotate(90);
+			ofVec3f* v = &vertices[index * DRAW_VERTS_PER_CELL];
+			
+			// small cross marking the origin
+			v[0].set( forceOrigin.x - 1, forceOrigin.y, 0 );
+			v[1].set( forceOrigin.x + 1, forceOrigin.y, 0 );
+			v[2].set( forceOrigin.x, forceOrigin.y - 1, 0 );
+			v[3].set( forceOrigin.x, forceOrigin.y + 1, 0 );
 			
-			ofLine(forceOrigin.x - (baseLine.x * forceLength * BASELINE_SCALE),
-                   forceOrigin.y - (baseLine.y * forceLength * BASELINE_SCALE),
-                   forceOrigin.x + (baseLine.x * forceLength * BASELINE_SCALE),
-                   forceOrigin.y + (baseLine.y * forceLength * BASELINE_SCALE));
+			v[4].set( forceOrigin.x, forceOrigin.y, 0 );
 			
+			placeForceLine( index );
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::placeForceLine( int index )
+{
+    ofVec3f* v = &_drawMesh.getVertices()[index * DRAW_VERTS_PER_CELL];
+    
+    // v[4] is the origin, the force line starts there
+    float forceX = _drawForces[index].x * _drawDecay;
+    float forceY = _drawForces[index].y * _drawDecay;
+    
+    v[5].set( v[4].x + forceX, v[4].y + forceY, 0 );
+    
+    // peprendicular base line, half of it either side of the origin
+    float baseX = -forceY * BASELINE_SCALE;
+    float baseY =  forceX * BASELINE_SCALE;
+    
+    v[6].set( v[4].x - baseX, v[4].y - baseY, 0 );
+    v[7].set( v[4].x + baseX, v[4].y + baseY, 0 );
+}
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::updateDrawIndices( const ofRectangle& cropSection )
+{
+    _bDrawIndicesDirty = false;
+    _drawCrop = cropSection;
+    
+	float scaledX = (float) _externalWidth / _fieldWidth;
+	float scaledY = (float) _externalHeight / _fieldHeight;
+	
+    int startXX;
+    int startYY;
+    int endXX;
+    int endYY;
+    
+    if( cropSection.width == 0 || cropSection.height == 0 ) {
+        
+        startXX = 0;
+        startYY = 0;
+        
+        endXX = _fieldWidth;
+        endYY = _fieldHeight;
+
+    } else {
+        
+        startXX = (cropSection.x + _externalOffset.x) / scaledX;
+        startYY = (cropSection.y + _externalOffset.y) / scaledY;
+        
+        endXX = startXX + cropSection.width / scaledX;
+        endYY = startYY + cropSection.height / scaledY;
+        
+    }
+    
+    startXX = MAX(0, startXX);
+    startYY = MAX(0, startYY);
+    
+    endXX = MIN(_fieldWidth, endXX);
+    endYY = MIN(_fieldHeight, endYY);
+    
+    _drawMesh.clearIndices();
+    
+	for(int yy=startYY; yy < endYY; ++yy) {
+		for(int xx=startXX; xx < endXX; ++xx) {
+            ofIndexType first = (yy * _fieldWidth + xx) * DRAW_VERTS_PER_CELL;
+            for( int i=0; i < DRAW_VERTS_PER_CELL; ++i ) {
+                _drawMesh.addIndex( first + i );
+            }
 		}
 	}
 }
@@ -253,8 +587,7 @@ const
 	// pos in vector
 	int vecPos = fieldPosY * _fieldWidth + fieldPosX;
 	
-    force.set(_field[vecPos].x,
-              _field[vecPos].y);  // scale here as values are pretty large.
+    force = getCell(vecPos);  // scale here as values are pretty large.
     
     if( _bUseSinMap ) {
         //force *= sin(posX * _sinXRepeat + _sinXPhase) * sin(posY * _sinYRepeat + _sinYPhase);
@@ -307,10 +640,435 @@ ofVec2f ofxLabFlexVectorField::getExternalSize()
 //------------------------------------------------------------------------------------
 vector<ofVec2f>* ofxLabFlexVectorField::getField()
 {
+    if( _storage != FLOAT_32 || _mappedCells ) {
+        return NULL;
+    }
+    
+    // the caller sees and can change any cell through this
+    renormalize();
+    markAllWritten();
+    markAllDirty();
     return &_field;
 }
 
 
+//------------------------------------------------------------------------------------
+ofVec2f ofxLabFlexVectorField::getCell( int index ) const
+{
+    return getStoredCell( index ) * _decay;
+}
+
+//------------------------------------------------------------------------------------
+ofVec2f ofxLabFlexVectorField::getStoredCell( int index ) const
+{
+    switch( _storage ) {
+        default:
+        case FLOAT_32:
+            return ((const ofVec2f*) cellData())[index];
+            
+        case FLOAT_16: {
+            const unsigned short* cell = (const unsigned short*) cellData() + index * 2;
+            return ofVec2f( halfToFloat(cell[0]), halfToFloat(cell[1]) );
+        }
+            
+        case FIXED_16: {
+            const short* cell = (const short*) cellData() + index * 2;
+            return ofVec2f( cell[0] * _fixedStep, cell[1] * _fixedStep );
+        }
+            
+        case FIXED_8: {
+            const signed char* cell = (const signed char*) cellData() + index * 2;
+            return ofVec2f( cell[0] * _fixedStep, cell[1] * _fixedStep );
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::setCell( int index,
+                                     const ofVec2f& force )
+{
+    int yy = index / _fieldWidth;
+    int xx = index - yy * _fieldWidth;
+    
+    // only this row of the draw mesh changes
+    _dirtyRows[yy] = 1;
+    _bDrawDirty = true;
+    
+    // grow the area zeroField() has to clear
+    if( force.x != 0 || force.y != 0 ) {
+        if( _writtenMaxX < _writtenMinX ) {
+            _writtenMinX = _writtenMaxX = xx;
+            _writtenMinY = _writtenMaxY = yy;
+        } else {
+            _writtenMinX = MIN( _writtenMinX, xx );
+            _writtenMinY = MIN( _writtenMinY, yy );
+            _writtenMaxX = MAX( _writtenMaxX, xx );
+            _writtenMaxY = MAX( _writtenMaxY, yy );
+        }
+    }
+    
+    // stored as force / decay, so getCell() gets force back.  If that
+    // doesn't fit the storage type the decay is folded in first
+    ofVec2f stored = force;
+    if( _decay != 1.0f ) {
+        stored /= _decay;
+        
+        float limit = _storage == FLOAT_16 ? HALF_MAX : _fixedRange;
+        if( _storage != FLOAT_32 &&
+            (fabsf( stored.x ) > limit || fabsf( stored.y ) > limit) ) {
+            renormalize();
+            stored = force;
+        }
+    }
+    
+    switch( _storage ) {
+        default:
+        case FLOAT_32:
+            ((ofVec2f*) cellData())[index] = stored;
+            break;
+            
+        case FLOAT_16: {
+            unsigned short* cell = (unsigned short*) cellData() + index * 2;
+            cell[0] = floatToHalf(stored.x);
+            cell[1] = floatToHalf(stored.y);
+            break;
+        }
+            
+        case FIXED_16: {
+            short* cell = (short*) cellData() + index * 2;
+            cell[0] = (short) floatToFixed(stored.x, _fixedInvStep, 32767);
+            cell[1] = (short) floatToFixed(stored.y, _fixedInvStep, 32767);
+            break;
+        }
+            
+        case FIXED_8: {
+            signed char* cell = (signed char*) cellData() + index * 2;
+            cell[0] = (signed char) floatToFixed(stored.x, _fixedInvStep, 127);
+            cell[1] = (signed char) floatToFixed(stored.y, _fixedInvStep, 127);
+            break;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+unsigned char* ofxLabFlexVectorField::cellData()
+{
+    if( _mappedCells ) {
+        return _mappedCells;
+    }
+    if( _storage == FLOAT_32 ) {
+        return _field.empty() ? NULL : (unsigned char*) &_field[0];
+    }
+    return _packed.empty() ? NULL : &_packed[0];
+}
+
+
+//------------------------------------------------------------------------------------
+const unsigned char* ofxLabFlexVectorField::cellData() const
+{
+    return const_cast<ofxLabFlexVectorField*>(this)->cellData();
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::fillHeader( ofxLabFlexVectorFieldHeader& header,
+                                        unsigned int frameCount,
+                                        float frameDuration ) const
+{
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, "LFVF", 4 );
+    
+    unsigned int frameBytes = _fieldSize * getBytesPerCell();
+    
+    header.version          = FILE_VERSION;
+    header.headerSize       = FILE_ALIGNMENT;
+    header.storage          = _storage;
+    header.fieldWidth       = _fieldWidth;
+    header.fieldHeight      = _fieldHeight;
+    header.externalWidth    = _externalWidth;
+    header.externalHeight   = _externalHeight;
+    header.fixedRange       = _fixedRange;
+    header.frameCount       = frameCount;
+    header.frameBytes       = frameBytes;
+    header.frameStride      = (frameBytes + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+    header.frameDuration    = frameDuration;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexVectorField::validateHeader( const unsigned char* data,
+                                            size_t size,
+                                            const string& path )
+{
+    if( size < sizeof(ofxLabFlexVectorFieldHeader) ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorField: " + path + " is too small to be a field" );
+        return false;
+    }
+    
+    // copied out, a field inside a checkpoint can start at any alignment
+    ofxLabFlexVectorFieldHeader headerCopy;
+    memcpy( &headerCopy, data, sizeof(headerCopy) );
+    const ofxLabFlexVectorFieldHeader* header = &headerCopy;
+    
+    if( memcmp( header->magic, "LFVF", 4 ) != 0 ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorField: " + path + " is not a vector field file" );
+        return false;
+    }
+    
+    if( header->version > FILE_VERSION ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorField: " + path + " was written by a newer version" );
+        return false;
+    }
+    
+    if( header->storage > FIXED_8 ||
+        header->fieldWidth <= 0 || header->fieldHeight <= 0 ||
+        header->frameCount == 0 ||
+        header->headerSize < sizeof(ofxLabFlexVectorFieldHeader) ||
+        header->frameStride < header->frameBytes ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorField: " + path + " has a corrupt header" );
+        return false;
+    }
+    
+    // figure the size a field with this layout should have
+    ofxLabFlexVectorField layout;
+    layout.setupDimensions( header->externalWidth, header->externalHeight,
+                            header->fieldWidth, header->fieldHeight,
+                            (StorageType) header->storage, header->fixedRange );
+    
+    size_t expected = (size_t) header->headerSize +
+                      (size_t) header->frameStride * (header->frameCount - 1) +
+                      header->frameBytes;
+    
+    if( header->frameBytes != (unsigned int)(layout._fieldSize * layout.getBytesPerCell()) ||
+        size < expected ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorField: " + path + " is truncated" );
+        return false;
+    }
+    
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexVectorField::saveField( const string& path )
+{
+    string fullPath = ofToDataPath( path, true );
+    
+    FILE* file = fopen( fullPath.c_str(), "wb" );
+    if( !file ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorField: unable to write " + fullPath );
+        return false;
+    }
+    
+    // the file holds the forces themselves
+    renormalize();
+    
+    ofxLabFlexVectorFieldHeader header;
+    fillHeader( header, 1, 0 );
+    
+    // pad the header out so the cells start page aligned
+    vector<unsigned char> headerBlock( header.headerSize, 0 );
+    memcpy( &headerBlock[0], &header, sizeof(header) );
+    
+    bool ok = fwrite( &headerBlock[0], 1, headerBlock.size(), file ) == headerBlock.size();
+    if( ok && header.frameBytes ) {
+        ok = fwrite( cellData(), 1, header.frameBytes, file ) == header.frameBytes;
+    }
+    
+    fclose( file );
+    
+    if( !ok ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorField: failed writing " + fullPath );
+    }
+    return ok;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexVectorField::loadField( const string& path,
+                                       bool memoryMap )
+{
+    ofPtr<ofxLabFlexMappedFile> mapping( new ofxLabFlexMappedFile() );
+    
+    if( !mapping->open( path ) || !validateHeader( mapping->getData(), mapping->getSize(), path ) ) {
+        return false;
+    }
+    
+    const ofxLabFlexVectorFieldHeader* header = (const ofxLabFlexVectorFieldHeader*) mapping->getData();
+    
+    // drops whatever storage or mapping we had before
+    setupDimensions( header->externalWidth, header->externalHeight,
+                     header->fieldWidth, header->fieldHeight,
+                     (StorageType) header->storage, header->fixedRange );
+    
+    unsigned char* cells = mapping->getData() + header->headerSize;
+    
+    if( memoryMap ) {
+        // use the pages in place, the mapping lives as long as the field needs it
+        _mapping = mapping;
+        _mappedCells = cells;
+        markAllWritten();
+    } else {
+        if( _storage == FLOAT_32 ) {
+            _field.resize( _fieldSize );
+        } else {
+            _packed.resize( header->frameBytes );
+        }
+        memcpy( cellData(), cells, header->frameBytes );
+    }
+    
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorField::serialize( vector<unsigned char>& buffer ) const
+{
+    ofxLabFlexVectorFieldState state;
+    memset( &state, 0, sizeof(state) );
+    
+    state.scale             = _scale;
+    state.horShiftPct       = _horShiftPct;
+    state.externalOffset[0] = _externalOffset.x;
+    state.externalOffset[1] = _externalOffset.y;
+    state.sinXRepeat        = _sinXRepeat;
+    state.sinYRepeat        = _sinYRepeat;
+    state.sinXPhase         = _sinXPhase;
+    state.sinYPhase         = _sinYPhase;
+    state.sinPowerValue     = _sinPowerValue;
+    state.useSinMap         = _bUseSinMap;
+    state.clampSinPositive  = _bClampSinPositive;
+    state.hasField          = _fieldSize > 0;
+    
+    buffer.insert( buffer.end(), (const unsigned char*) &state, (const unsigned char*) (&state + 1) );
+    
+    if( !state.hasField ) {
+        return;
+    }
+    
+    // same header as the binary files, but no page padding in memory
+    ofxLabFlexVectorFieldHeader header;
+    fillHeader( header, 1, 0 );
+    header.headerSize = sizeof(header);
+    
+    buffer.insert( buffer.end(), (const unsigned char*) &header, (const unsigned char*) (&header + 1) );
+    
+    // the forces are written, so the decay is applied on the way out.  The
+    // cells are scaled aside first, buffer may not be aligned for them
+    if( _decay == 1.0f ) {
+        buffer.insert( buffer.end(), cellData(), cellData() + header.frameBytes );
+    } else {
+        vector<unsigned char> scaled( header.frameBytes );
+        scaleCells( cellData(), &scaled[0], _decay );
+        buffer.insert( buffer.end(), scaled.begin(), scaled.end() );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+size_t ofxLabFlexVectorField::deserialize( const unsigned char* data,
+                                           size_t size )
+{
+    if( size < sizeof(ofxLabFlexVectorFieldState) ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorField: truncated field state" );
+        return 0;
+    }
+    
+    ofxLabFlexVectorFieldState state;
+    memcpy( &state, data, sizeof(state) );
+    
+    size_t used = sizeof(state);
+    
+    if( state.hasField ) {
+        ofxLabFlexVectorFieldHeader header;
+        if( !validateHeader( data + used, size - used, "field state" ) ) {
+            return 0;
+        }
+        memcpy( &header, data + used, sizeof(header) );
+        used += sizeof(header);
+        
+        setupField( header.externalWidth, header.externalHeight,
+                    header.fieldWidth, header.fieldHeight,
+                    (StorageType) header.storage, header.fixedRange );
+        
+        memcpy( cellData(), data + used, header.frameBytes );
+        used += header.frameBytes;
+    } else {
+        _field.clear();
+        _packed.clear();
+        _mapping.reset();
+        _mappedCells = NULL;
+        _fieldSize = _fieldWidth = _fieldHeight = 0;
+        _drawMesh.clear();
+        _drawForces.clear();
+        _dirtyRows.clear();
+    }
+    
+    _scale              = state.scale;
+    _horShiftPct        = state.horShiftPct;
+    _externalOffset.set( state.externalOffset[0], state.externalOffset[1] );
+    _sinXRepeat         = state.sinXRepeat;
+    _sinYRepeat         = state.sinYRepeat;
+    _sinXPhase          = state.sinXPhase;
+    _sinYPhase          = state.sinYPhase;
+    _sinPowerValue      = state.sinPowerValue;
+    _bUseSinMap         = state.useSinMap != 0;
+    _bClampSinPositive  = state.clampSinPositive != 0;
+    
+    markAllDirty();
+    return used;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexVectorField::isMemoryMapped() const
+{
+    return _mappedCells != NULL;
+}
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexVectorField::StorageType ofxLabFlexVectorField::getStorageType() const
+{
+    return _storage;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexVectorField::getBytesPerCell() const
+{
+    switch( _storage ) {
+        case FLOAT_16:  return 4;
+        case FIXED_16:  return 4;
+        case FIXED_8:   return 2;
+        default:        return sizeof(ofVec2f);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexVectorField::getQuantizationError() const
+{
+    switch( _storage ) {
+        // half keeps 11 significant bits, so half an ulp of the largest force
+        case FLOAT_16: {
+            const unsigned short* cell = (const unsigned short*) cellData();
+            const unsigned short* end  = cell + _fieldSize * 2;
+            float largest = 0;
+            for( ; cell != end; ++cell ) {
+                largest = MAX( largest, fabsf( halfToFloat( *cell ) ) );
+            }
+            return largest * _decay / 2048.0f;
+        }
+        case FIXED_16:
+        case FIXED_8:   return _fixedStep * 0.5f;
+        default:        return 0.0f;
+    }
+}
+
+
 //------------------------------------------------------------------------------------
 void ofxLabFlexVectorField::addForce( float x, 
                                float y,
@@ -364,31 +1122,35 @@ void ofxLabFlexVectorField::addForce( float x,
 															 (fieldPosY - yy));
 				unitDirection.normalize();
 				
+				ofVec2f cell = getCell(vecPos);
+				
 				switch(type) {
 					default:
 					case OUT_CIRCLE:
-						_field[vecPos].x -= unitDirection.x * scaledStrength;
-						_field[vecPos].y -= unitDirection.y * scaledStrength;
+						cell.x -= unitDirection.x * scaledStrength;
+						cell.y -= unitDirection.y * scaledStrength;
 						break;
 						
 					case IN_CIRCLE:
-						_field[vecPos].x += unitDirection.x * scaledStrength;
-						_field[vecPos].y += unitDirection.y * scaledStrength;	
+						cell.x += unitDirection.x * scaledStrength;
+						cell.y += unitDirection.y * scaledStrength;	
 						break;
 						
 					case CLOCK_CIRCLE:
 						// noticed flipped x, y
-						_field[vecPos].x += unitDirection.y * scaledStrength;
-						_field[vecPos].y -= unitDirection.x * scaledStrength;
+						cell.x += unitDirection.y * scaledStrength;
+						cell.y -= unitDirection.x * scaledStrength;
 						break;
 						
 					case COUNTER_CLOCK_CIRCLE:
 						// noticed flipped x, y
-						_field[vecPos].x -= unitDirection.y * scaledStrength;
-						_field[vecPos].y += unitDirection.x * scaledStrength;
+						cell.x -= unitDirection.y * scaledStrength;
+						cell.y += unitDirection.x * scaledStrength;
 						break;
 				}
 				
+				setCell(vecPos, cell);
+				
 			}
 		}
 	}
@@ -449,13 +1211,26 @@ void ofxLabFlexVectorField::setUniformForce( const ofRectangle& area,
     
     startY = MAX( 0, startY );
     endY = MIN( _fieldHeight, endY );
+    
+    // clearing only has to touch cells written since the last zeroField()
+    if( force.x == 0 && force.y == 0 ) {
+        if( _writtenMaxX < _writtenMinX ) {
+            return;
+        }
+        
+        startX = MAX( _writtenMinX, startX );
+        endX = MIN( _writtenMaxX + 1, endX );
+        
+        startY = MAX( _writtenMinY, startY );
+        endY = MIN( _writtenMaxY + 1, endY );
+    }
 
 
     for( int yy = startY; yy < endY; ++yy ) {
         for( int xx = startX; xx < endX; ++xx ) {
             int index = yy * _fieldWidth + xx;
             
-            _field[index] = force;
+            setCell(index, force);
         }
     }
 }
@@ -479,12 +1254,14 @@ void ofxLabFlexVectorField::applySinMap( float xRepeat,
     _bClampSinPositive = positiveClamp;
     
     _sinPowerValue = sinPowerValue;
+    markAllDirty();
 }
 
 //------------------------------------------------------------------------------------
 void ofxLabFlexVectorField::clearSinMap()
 {
     _bUseSinMap = false;
+    markAllDirty();
 }
 
 /*
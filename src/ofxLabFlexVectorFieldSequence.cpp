@@ -0,0 +1,222 @@
+//
+//  ofxLabFlexVectorFieldSequence.cpp
+//  ofxLabFlexParticleSystem
+//
+
+#include "ofxLabFlexVectorFieldSequence.h"
+
+
+//------------------------------------------------------------------------------------
+ofxLabFlexVectorFieldSequence::ofxLabFlexVectorFieldSequence() :
+_numFrames(0),
+_frameDuration(0),
+_fromFrame(-1),
+_toFrame(-1),
+_blend(0)
+{
+
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexVectorFieldSequence::saveSequence( const string& path,
+                                                  const vector<ofxLabFlexVectorField*>& frames,
+                                                  float frameDuration )
+{
+    if( frames.empty() ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorFieldSequence: no frames to save" );
+        return false;
+    }
+
+    const ofxLabFlexVectorField* first = frames[0];
+
+    for( unsigned int i=1; i<frames.size(); ++i ) {
+        if( frames[i]->_fieldWidth  != first->_fieldWidth ||
+            frames[i]->_fieldHeight != first->_fieldHeight ||
+            frames[i]->_storage     != first->_storage ) {
+            ofLog( OF_LOG_ERROR, "ofxLabFlexVectorFieldSequence: frames must share size and storage" );
+            return false;
+        }
+    }
+
+    string fullPath = ofToDataPath( path, true );
+
+    FILE* file = fopen( fullPath.c_str(), "wb" );
+    if( !file ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorFieldSequence: unable to write " + fullPath );
+        return false;
+    }
+
+    ofxLabFlexVectorFieldHeader header;
+    first->fillHeader( header, frames.size(), frameDuration );
+
+    // header and every frame are padded so each frame starts page aligned
+    vector<unsigned char> block( header.headerSize, 0 );
+    memcpy( &block[0], &header, sizeof(header) );
+
+    bool ok = fwrite( &block[0], 1, block.size(), file ) == block.size();
+
+    block.assign( header.frameStride - header.frameBytes, 0 );
+
+    for( unsigned int i=0; ok && i<frames.size(); ++i ) {
+        frames[i]->renormalize();
+        ok = fwrite( frames[i]->cellData(), 1, header.frameBytes, file ) == header.frameBytes;
+
+        // the last frame doesn't need padding
+        if( ok && !block.empty() && i + 1 < frames.size() ) {
+            ok = fwrite( &block[0], 1, block.size(), file ) == block.size();
+        }
+    }
+
+    fclose( file );
+
+    if( !ok ) {
+        ofLog( OF_LOG_ERROR, "ofxLabFlexVectorFieldSequence: failed writing " + fullPath );
+    }
+    return ok;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ofxLabFlexVectorFieldSequence::load( const string& path )
+{
+    ofPtr<ofxLabFlexMappedFile> mapping( new ofxLabFlexMappedFile() );
+
+    if( !mapping->open( path ) || !ofxLabFlexVectorField::validateHeader( mapping->getData(), mapping->getSize(), path ) ) {
+        return false;
+    }
+
+    const ofxLabFlexVectorFieldHeader* header = (const ofxLabFlexVectorFieldHeader*) mapping->getData();
+
+    _from.setupDimensions( header->externalWidth, header->externalHeight,
+                           header->fieldWidth, header->fieldHeight,
+                           (ofxLabFlexVectorField::StorageType) header->storage, header->fixedRange );
+    _to.setupDimensions( header->externalWidth, header->externalHeight,
+                         header->fieldWidth, header->fieldHeight,
+                         (ofxLabFlexVectorField::StorageType) header->storage, header->fixedRange );
+
+    _mapping = mapping;
+    _from._mapping = mapping;
+    _to._mapping = mapping;
+
+    _numFrames = header->frameCount;
+    _frameDuration = header->frameDuration > 0 ? header->frameDuration : 1.0f;
+    _fromFrame = -1;
+    _toFrame = -1;
+
+    setTime( 0 );
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+int ofxLabFlexVectorFieldSequence::getNumFrames() const
+{
+    return _numFrames;
+}
+
+
+//------------------------------------------------------------------------------------
+float ofxLabFlexVectorFieldSequence::getDuration() const
+{
+    return _numFrames * _frameDuration;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorFieldSequence::setTime( float seconds,
+                                             bool loop )
+{
+    if( _numFrames == 0 ) {
+        return;
+    }
+
+    float position = MAX( 0.0f, seconds / _frameDuration );
+
+    int from = (int) position;
+    int to   = from + 1;
+
+    if( loop ) {
+        from %= _numFrames;
+        to   %= _numFrames;
+        _blend = position - floor(position);
+    } else if( from >= _numFrames - 1 ) {
+        from = to = _numFrames - 1;
+        _blend = 0;
+    } else {
+        _blend = position - from;
+    }
+
+    if( from != _fromFrame ) {
+        bindFrame( _from, from );
+        _fromFrame = from;
+    }
+
+    if( to != _toFrame ) {
+        bindFrame( _to, to );
+        _toFrame = to;
+
+        // start paging in the frame after this one so we never stall on it
+        const ofxLabFlexVectorFieldHeader* header = (const ofxLabFlexVectorFieldHeader*) _mapping->getData();
+        int next = loop ? (to + 1) % _numFrames : MIN( to + 1, _numFrames - 1 );
+        _mapping->willNeed( header->headerSize + (size_t) header->frameStride * next,
+                            header->frameBytes );
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+ofVec2f ofxLabFlexVectorFieldSequence::getForceFromPos( float posX,
+                                                        float posY ) const
+{
+    if( _numFrames == 0 ) {
+        return ofVec2f(0,0);
+    }
+
+    ofVec2f force = _from.getForceFromPos( posX, posY );
+
+    if( _blend > 0 ) {
+        force += (_to.getForceFromPos( posX, posY ) - force) * _blend;
+    }
+
+    return force;
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorFieldSequence::setScale( float scale )
+{
+    _from.setScale( scale );
+    _to.setScale( scale );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorFieldSequence::setExternalOffset( ofVec2f offset )
+{
+    _from.setExternalOffset( offset );
+    _to.setExternalOffset( offset );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorFieldSequence::setHorizontalShift( float shiftPct )
+{
+    _from.setHorizontalShift( shiftPct );
+    _to.setHorizontalShift( shiftPct );
+}
+
+
+//------------------------------------------------------------------------------------
+void ofxLabFlexVectorFieldSequence::bindFrame( ofxLabFlexVectorField& field,
+                                               int frame )
+{
+    const ofxLabFlexVectorFieldHeader* header = (const ofxLabFlexVectorFieldHeader*) _mapping->getData();
+
+    field._mappedCells = _mapping->getData() + header->headerSize +
+                         (size_t) header->frameStride * frame;
+    field._decay = 1.0f;
+    field.markAllWritten();
+    field.markAllDirty();
+}